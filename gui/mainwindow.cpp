@@ -41,6 +41,7 @@
 #ifdef ENABLE_IOS
 #include "../src/ios_handler.h"
 #endif
+#include "../src/simulated_handler.h"
 
 #include "settingsdialog.h"
 
@@ -726,6 +727,22 @@ void MainWindow::createTransferPanel() {
     destRow->addWidget(destinationEdit_, 1);
     destRow->addWidget(browseBtn_);
     
+    // Transfer order
+    QHBoxLayout *orderRow = new QHBoxLayout();
+    QLabel *orderLabel = new QLabel("Order:");
+    orderLabel->setStyleSheet(QString("color: %1;").arg(Colors::TextMuted));
+    
+    orderCombo_ = new QComboBox();
+    orderCombo_->addItem("As on device", static_cast<int>(SyncPlanner::Order::DEVICE));
+    orderCombo_->addItem("Newest first", static_cast<int>(SyncPlanner::Order::NEWEST_FIRST));
+    orderCombo_->addItem("Smallest first", static_cast<int>(SyncPlanner::Order::SMALLEST_FIRST));
+    orderCombo_->addItem("By folder", static_cast<int>(SyncPlanner::Order::BY_FOLDER));
+    orderCombo_->setFixedWidth(150);
+    
+    orderRow->addWidget(orderLabel);
+    orderRow->addWidget(orderCombo_);
+    orderRow->addStretch();
+    
     // Control buttons
     QHBoxLayout *ctrlRow = new QHBoxLayout();
     ctrlRow->setSpacing(15);
@@ -891,6 +908,7 @@ void MainWindow::createTransferPanel() {
     heicLayout->addWidget(heicCard);
     
     layout->addLayout(destRow);
+    layout->addLayout(orderRow);
     layout->addWidget(heicOptionsWidget_);
     layout->addLayout(ctrlRow);
     layout->addWidget(progressCard);
@@ -1008,30 +1026,30 @@ void MainWindow::onRefreshDevices() {
     deviceCombo_->clear();
     deviceCombo_->addItem("🔍 Searching...");
     
-#ifdef ENABLE_ANDROID
-    #ifdef USE_WPD
-    auto mtp = std::make_unique<WPDHandler>();
-    #else
-    auto mtp = std::make_unique<MTPHandler>();
-    #endif
-    if (mtp->detectDevices()) {
-        deviceCombo_->clear();
-        deviceCombo_->addItem("📱 Android: " + QString::fromStdString(mtp->getDeviceName()), "android");
+    // Every backend at once; the handlers are kept for onConnectDevice()
+    deviceProbe_ = std::make_unique<DeviceProbe>();
+    deviceProbe_->probe();
+    
+    deviceCombo_->clear();
+    for (const auto& candidate : deviceProbe_->getCandidates()) {
+        bool ios = candidate.type == DeviceType::IOS;
+        QString label = ios ? "🍎 iOS" : "📱 Android";
+        if (!candidate.name.empty()) {
+            label += ": " + QString::fromStdString(candidate.name);
+        }
+        deviceCombo_->addItem(label, ios ? "ios" : "android");
+        deviceCombo_->setItemData(deviceCombo_->count() - 1,
+                                  QString::fromStdString(candidate.name), Qt::UserRole + 1);
     }
-#endif
     
-#ifdef ENABLE_IOS
-    auto ios = std::make_unique<iOSHandler>();
-    if (ios->detectDevices()) {
-        if (deviceCombo_->count() == 1 && deviceCombo_->itemText(0).startsWith("🔍")) {
-            deviceCombo_->clear();
-        }
-        deviceCombo_->addItem("🍎 iOS: " + QString::fromStdString(ios->getDeviceName()), "ios");
+    // A simulated phone for trying the app without hardware, e.g.
+    // PHOTO_TRANSFER_SIM=sim:files=2000,bandwidth=30
+    QString simSpec = QString::fromLocal8Bit(qgetenv("PHOTO_TRANSFER_SIM"));
+    if (SimulatedHandler::isSpec(simSpec.toStdString())) {
+        deviceCombo_->addItem("🧪 Simulated: " + simSpec, simSpec);
     }
-#endif
     
-    if (deviceCombo_->count() == 0 || deviceCombo_->itemText(0).startsWith("🔍")) {
-        deviceCombo_->clear();
+    if (deviceCombo_->count() == 0) {
         deviceCombo_->addItem("❌ No devices found");
         statusLabel_->setText("No devices found. Connect a device and try again.");
     } else {
@@ -1054,10 +1072,18 @@ void MainWindow::onConnectDevice() {
     }
     
     QString deviceType = deviceCombo_->currentData().toString();
+    std::string deviceName = deviceCombo_->currentData(Qt::UserRole + 1).toString().toStdString();
     statusLabel_->setText("🔗 Connecting...");
     
+    // Reuse the handler that found the device during the last refresh
+    bool detected = false;
+    if (deviceProbe_ && (deviceType == "android" || deviceType == "ios")) {
+        deviceHandler_ = deviceProbe_->takeHandler(deviceType == "ios" ? DeviceType::IOS : DeviceType::ANDROID);
+        detected = deviceHandler_ != nullptr;
+    }
+    
 #ifdef ENABLE_ANDROID
-    if (deviceType == "android") {
+    if (!detected && deviceType == "android") {
     #ifdef USE_WPD
         deviceHandler_ = std::make_unique<WPDHandler>();
     #else
@@ -1067,22 +1093,35 @@ void MainWindow::onConnectDevice() {
 #endif
     
 #ifdef ENABLE_IOS
-    if (deviceType == "ios") {
+    if (!detected && deviceType == "ios") {
         deviceHandler_ = std::make_unique<iOSHandler>();
     }
+    if (auto* ios = dynamic_cast<iOSHandler*>(deviceHandler_.get())) {
+        ios->setConnectionPoolSize(SettingsDialog::getIosConnections());
+    }
 #endif
     
+    if (SimulatedHandler::isSpec(deviceType.toStdString())) {
+        SimulatedHandler::Options options;
+        std::string error;
+        if (!SimulatedHandler::Options::parse(deviceType.toStdString(), options, error)) {
+            QMessageBox::critical(this, "Error", QString::fromStdString(error));
+            return;
+        }
+        deviceHandler_ = std::make_unique<SimulatedHandler>(options);
+    }
+    
     if (!deviceHandler_) {
         QMessageBox::critical(this, "Error", "Failed to create device handler.");
         return;
     }
     
-    if (!deviceHandler_->detectDevices()) {
+    if (!detected && !deviceHandler_->detectDevices()) {
         QMessageBox::critical(this, "Error", "Device not found. Please reconnect and try again.");
         return;
     }
     
-    if (!deviceHandler_->connectToDevice()) {
+    if (!deviceHandler_->connectToDevice(deviceName)) {
         QMessageBox::critical(this, "Error", 
             QString("Failed to connect: %1").arg(QString::fromStdString(deviceHandler_->getLastError())));
         return;
@@ -1113,8 +1152,23 @@ void MainWindow::onConnectDevice() {
     
     statusLabel_->setText("✓ Connected. Scanning media...");
     
-    // Enumerate media
+    // Enumerate media, reusing the last walk of this device where unchanged
+    QString cachePath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) +
+                        "/device_cache.db";
+    std::string serial = deviceHandler_->getSerialNumber();
+    PhotoDB enumerationCache;
+    bool cacheOpen = !serial.empty() &&
+                     enumerationCache.open(cachePath.toStdString()) &&
+                     enumerationCache.initialize();
+    EnumerationSnapshot snapshot;
+    if (cacheOpen && enumerationCache.loadEnumerationSnapshot(serial, snapshot)) {
+        deviceHandler_->setEnumerationSnapshot(snapshot);
+    }
+    
     mediaList_ = deviceHandler_->enumerateMedia();
+    if (cacheOpen) {
+        enumerationCache.saveEnumerationSnapshot(serial, deviceHandler_->getEnumerationSnapshot());
+    }
     photoCountLabel_->setText(QString("<span style='font-size:24px;font-weight:bold;color:%1;'>%2</span>"
                                       "<span style='color:%3;'> items</span>")
                               .arg(Colors::Accent).arg(mediaList_.size()).arg(Colors::TextMuted));
@@ -1267,13 +1321,25 @@ void MainWindow::onStartTransfer() {
     transferQueue_->setDestinationFolder(dest.toStdString());
     transferQueue_->setDeviceHandler(deviceHandler_.get());
     
+    std::vector<MediaInfo> selectedMedia;
     for (auto *item : selected) {
         int idx = photoList_->row(item);
         if (idx >= 0 && idx < static_cast<int>(mediaList_.size())) {
-            transferQueue_->addItem(mediaList_[idx]);
+            selectedMedia.push_back(mediaList_[idx]);
         }
     }
     
+    // Plan the selection: queue it in the chosen order and show what it costs
+    SyncPlanner planner(database_.get(), deviceHandler_->getSerialNumber(),
+        [this](const MediaInfo &media) { return transferQueue_->getLocalPath(media); },
+        transferQueue_->getDestinationIndex());
+    planner.setLinkRate(lastLinkRate_);
+    auto order = static_cast<SyncPlanner::Order>(orderCombo_->currentData().toInt());
+    SyncPlan plan = planner.plan(selectedMedia, order);
+    for (const auto &file : plan.files) {
+        transferQueue_->addItem(file.media);
+    }
+    
     isTransferring_ = true;
     startBtn_->setEnabled(false);
     pauseBtn_->setEnabled(true);
@@ -1283,7 +1349,10 @@ void MainWindow::onStartTransfer() {
     overallProgress_->setMaximum(selected.size());
     overallProgressLabel_->setText("0%");
     
-    transferStatusLabel_->setText("Starting transfer...");
+    transferStatusLabel_->setText(QString("Starting transfer: %1 to read, about %2%3")
+        .arg(formatSize(static_cast<qint64>(plan.total_bytes)))
+        .arg(formatTime(static_cast<int>(plan.estimated_seconds + 0.5)))
+        .arg(plan.resume_count > 0 ? QString(", %1 resumed").arg(plan.resume_count) : QString()));
     statusLabel_->setText("📤 Transferring...");
     
     transferQueue_->setProgressCallback([this](const TransferStats &stats) {
@@ -1326,7 +1395,12 @@ void MainWindow::onCancelTransfer() {
     
     if (msgBox.exec() == QMessageBox::Yes) {
         transferQueue_->saveState(stateFilePath_.toStdString());
-        transferQueue_->cancel();
+        if (!transferQueue_->cancel()) {
+            // The device is not answering; the read gives up at its deadline
+            cancelBtn_->setEnabled(false);
+            statusLabel_->setText("⏹ Cancelling, waiting for the device...");
+            return;
+        }
         
         isTransferring_ = false;
         startBtn_->setEnabled(true);
@@ -1400,6 +1474,9 @@ void MainWindow::onTransferComplete() {
     pauseBtn_->setText("⏸ Pause");
     
     auto stats = transferQueue_->getStats();
+    if (stats.transfer_speed > 0) {
+        lastLinkRate_ = stats.transfer_speed;
+    }
     
     overallProgress_->setValue(overallProgress_->maximum());
     overallProgressLabel_->setText("100%");
@@ -1528,7 +1605,14 @@ void MainWindow::loadThumbnailsAsync() {
             const auto &media = mediaList_[i];
             std::vector<uint8_t> data;
             
-            if (deviceHandler_->readFile(media.object_id, data)) {
+            // Device-side thumbnail first; a full read is only worth it for
+            // images, Qt cannot draw a frame from a video file anyway
+            bool loaded = deviceHandler_->readThumbnail(media.object_id, data);
+            if (!loaded && media.mime_type.compare(0, 6, "image/") == 0) {
+                loaded = deviceHandler_->readFile(media.object_id, data);
+            }
+            
+            if (loaded) {
                 QPixmap pixmap;
                 pixmap.loadFromData(data.data(), data.size());
                 
@@ -1647,11 +1731,11 @@ void DeviceWorker::performTransfer(QList<int> items, QString destination, std::v
 // ThumbnailLoader implementation
 ThumbnailLoader::ThumbnailLoader(QObject *parent) : QObject(parent) {}
 
-void ThumbnailLoader::loadThumbnail(int index, uint32_t objectId, QString filename) {
+void ThumbnailLoader::loadThumbnail(int index, ObjectId objectId, QString filename) {
     if (!handler_) return;
     
     std::vector<uint8_t> data;
-    if (handler_->readFile(objectId, data)) {
+    if (handler_->readThumbnail(objectId, data) || handler_->readFile(objectId, data)) {
         QIcon icon = createThumbnailFromData(data, filename);
         emit thumbnailLoaded(index, icon);
     }
@@ -14,8 +14,10 @@
 #include <memory>
 
 #include "../src/device_handler.h"
+#include "../src/device_probe.h"
 #include "../src/transfer_queue.h"
 #include "../src/photo_db.h"
+#include "../src/sync_planner.h"
 #include "settingsdialog.h"
 
 class DeviceWorker;
@@ -123,6 +125,7 @@ private:
     
     // Transfer panel
     QLineEdit *destinationEdit_;
+    QComboBox *orderCombo_;
     QPushButton *browseBtn_;
     QPushButton *startBtn_;
     QPushButton *pauseBtn_;
@@ -143,9 +146,11 @@ private:
     
     // Backend
     std::unique_ptr<DeviceHandler> deviceHandler_;
+    std::unique_ptr<DeviceProbe> deviceProbe_;  // Last refresh, handlers reused on connect
     std::unique_ptr<TransferQueue> transferQueue_;
     std::unique_ptr<PhotoDB> database_;
     std::vector<MediaInfo> mediaList_;
+    double lastLinkRate_ = 0;  // Bytes per second of the last transfer, for plan estimates
     
     // Workers
     QThread *workerThread_;
@@ -202,7 +207,7 @@ public:
     void setDeviceHandler(DeviceHandler *handler) { handler_ = handler; }
 
 public slots:
-    void loadThumbnail(int index, uint32_t objectId, QString filename);
+    void loadThumbnail(int index, ObjectId objectId, QString filename);
     void loadThumbnails(std::vector<MediaInfo> *mediaList);
 
 signals:
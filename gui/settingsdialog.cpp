@@ -237,6 +237,16 @@ void SettingsDialog::setJpegQuality(int quality) {
     settings.setValue("jpegQuality", quality);
 }
 
+int SettingsDialog::getIosConnections() {
+    QSettings settings("PhotoTransfer", "PhotoTransfer");
+    return qMax(1, settings.value("iosConnections", 4).toInt());
+}
+
+void SettingsDialog::setIosConnections(int connections) {
+    QSettings settings("PhotoTransfer", "PhotoTransfer");
+    settings.setValue("iosConnections", connections);
+}
+
 SettingsDialog::SettingsDialog(QWidget *parent)
     : QDialog(parent)
 {
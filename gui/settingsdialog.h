@@ -43,6 +43,10 @@ public:
     static void setConvertHeic(bool convert);
     static int getJpegQuality();
     static void setJpegQuality(int quality);
+    
+    // Parallel AFC connections per iOS device
+    static int getIosConnections();
+    static void setIosConnections(int connections);
 
 signals:
     void themeChanged(const Theme &theme);
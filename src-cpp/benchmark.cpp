@@ -0,0 +1,554 @@
+#include "device_handler.h"
+#include "simulated_handler.h"
+#include "photo_db.h"
+#include "photo_sync.h"
+#include "media_types.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <filesystem>
+
+#ifdef ENABLE_IOS
+#include "ios_handler.h"
+#endif
+
+#if defined(ENABLE_ANDROID) && !defined(USE_WPD)
+#include "mtp_handler.h"
+#endif
+
+using namespace std;
+
+/**
+ * Throughput benchmarks against a connected or simulated device.
+ * Each scenario is timed against a baseline run of the same workload so
+ * the printed speedup is the gain from the feature under test.
+ */
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void printTiming(const string& name, size_t items, double seconds, double baseline_seconds) {
+    cout << left << setw(36) << name
+         << right << setw(10) << items
+         << fixed << setprecision(2)
+         << setw(10) << seconds
+         << setw(10) << setprecision(0) << (seconds > 0 ? items / seconds : 0.0)
+         << setw(9) << setprecision(2) << (seconds > 0 ? baseline_seconds / seconds : 0.0) << "x"
+         << endl;
+}
+
+// Reads every file once with the given number of threads and returns the
+// bytes delivered; data is counted and discarded
+static uint64_t readFiles(DeviceHandler& handler, const vector<MediaInfo>& files, size_t threads) {
+    atomic<size_t> next(0);
+    atomic<uint64_t> total(0);
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            uint64_t bytes = 0;
+            bool ok = handler.readFileChunked(files[i].object_id, [&bytes](const uint8_t*, size_t size) {
+                bytes += size;
+                return true;
+            });
+            if (!ok) {
+                cerr << "  Read failed: " << files[i].path << endl;
+            }
+            total += bytes;
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t i = 1; i < threads; i++) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    return total;
+}
+
+#ifdef ENABLE_IOS
+static void printHeader() {
+    cout << left << setw(36) << "Scenario"
+         << right << setw(10) << "MB"
+         << setw(10) << "Seconds"
+         << setw(10) << "MB/s"
+         << setw(10) << "Speedup" << endl;
+}
+
+static void printResult(const string& name, uint64_t bytes, double seconds, double baseline_seconds) {
+    double mb = bytes / (1024.0 * 1024.0);
+    cout << left << setw(36) << name
+         << right << fixed << setprecision(1)
+         << setw(10) << mb
+         << setw(10) << setprecision(2) << seconds
+         << setw(10) << setprecision(1) << (seconds > 0 ? mb / seconds : 0.0)
+         << setw(9) << setprecision(2) << (seconds > 0 ? baseline_seconds / seconds : 0.0) << "x"
+         << endl;
+}
+
+static bool connectIOS(iOSHandler& handler, size_t connections) {
+    handler.setConnectionPoolSize(connections);
+    if (!handler.detectDevices() || !handler.connectToDevice()) {
+        cerr << "ERROR: " << handler.getLastError() << endl;
+        return false;
+    }
+    return true;
+}
+
+// Maps the selected files onto the object ids of a fresh enumeration
+static vector<MediaInfo> remapByPath(const vector<MediaInfo>& selected,
+                                     const vector<MediaInfo>& media) {
+    unordered_map<string, ObjectId> ids;
+    for (const auto& info : media) {
+        ids[info.path] = info.object_id;
+    }
+
+    vector<MediaInfo> remapped;
+    for (auto info : selected) {
+        auto id = ids.find(info.path);
+        if (id != ids.end()) {
+            info.object_id = id->second;
+            remapped.push_back(info);
+        }
+    }
+    return remapped;
+}
+
+// Enumeration with one stat at a time against the parallel stat pass, and
+// against a refresh seeded with the snapshot of the previous walk
+static int benchEnumeration(size_t connections) {
+    cout << "\n== iOS enumeration (" << connections << " connections) ==" << endl;
+    cout << left << setw(36) << "Scenario"
+         << right << setw(10) << "Items"
+         << setw(10) << "Seconds"
+         << setw(10) << "Items/s"
+         << setw(10) << "Speedup" << endl;
+
+    double sequential = 0;
+    {
+        iOSHandler handler;
+        if (!connectIOS(handler, 1)) return 1;
+
+        auto start = chrono::steady_clock::now();
+        auto media = handler.enumerateMedia();
+        sequential = secondsSince(start);
+        printTiming("Full walk, 1 connection", media.size(), sequential, sequential);
+        handler.disconnect();
+    }
+
+    iOSHandler handler;
+    if (!connectIOS(handler, connections)) return 1;
+
+    auto start = chrono::steady_clock::now();
+    auto media = handler.enumerateMedia();
+    printTiming("Full walk, " + to_string(handler.getConnectionPoolSize()) + " connections",
+                media.size(), secondsSince(start), sequential);
+
+    handler.setEnumerationSnapshot(handler.getEnumerationSnapshot());
+    start = chrono::steady_clock::now();
+    media = handler.enumerateMedia();
+    printTiming("Cached refresh, unchanged device", media.size(), secondsSince(start), sequential);
+
+    handler.disconnect();
+    return 0;
+}
+
+// Sequential reads over one AFC connection against the same files read
+// through a pool of connections, for many small files and one large one
+static int benchAfcPool(size_t connections, size_t file_count) {
+    vector<MediaInfo> files;
+    vector<MediaInfo> large;
+    double sequential_files = 0;
+    double sequential_large = 0;
+
+    cout << "\n== AFC connection pool (" << connections << " connections) ==" << endl;
+
+    {
+        iOSHandler handler;
+        if (!connectIOS(handler, 1)) return 1;
+
+        auto media = handler.enumerateMedia();
+        if (media.empty()) {
+            cerr << "ERROR: No media on device" << endl;
+            return 1;
+        }
+
+        files.assign(media.begin(), media.begin() + min(file_count, media.size()));
+        large.push_back(*max_element(media.begin(), media.end(),
+                                     [](const MediaInfo& a, const MediaInfo& b) {
+                                         return a.file_size < b.file_size;
+                                     }));
+
+        printHeader();
+
+        auto start = chrono::steady_clock::now();
+        uint64_t bytes = readFiles(handler, files, 1);
+        sequential_files = secondsSince(start);
+        printResult(to_string(files.size()) + " files, 1 connection", bytes, sequential_files,
+                    sequential_files);
+
+        start = chrono::steady_clock::now();
+        bytes = readFiles(handler, large, 1);
+        sequential_large = secondsSince(start);
+        printResult("Largest file, 1 connection", bytes, sequential_large, sequential_large);
+
+        handler.disconnect();
+    }
+
+    iOSHandler handler;
+    if (!connectIOS(handler, connections)) return 1;
+
+    auto media = handler.enumerateMedia();
+    files = remapByPath(files, media);
+    large = remapByPath(large, media);
+    size_t opened = handler.getConnectionPoolSize();
+
+    auto start = chrono::steady_clock::now();
+    uint64_t bytes = readFiles(handler, files, opened);
+    printResult(to_string(files.size()) + " files, " + to_string(opened) + " connections",
+                bytes, secondsSince(start), sequential_files);
+
+    start = chrono::steady_clock::now();
+    bytes = readFiles(handler, large, 1);
+    printResult("Largest file, " + to_string(opened) + " stripes", bytes, secondsSince(start),
+                sequential_large);
+
+    handler.disconnect();
+    return 0;
+}
+#endif
+
+#if defined(ENABLE_ANDROID) && !defined(USE_WPD)
+// Time to open the first MTP device: once while the desktop may still hold
+// it, then reconnects of a device already released. Connect polls for the
+// release, so neither should include a fixed wait.
+static int benchMtpConnect(size_t rounds) {
+    cout << "\n== MTP connect (" << rounds << " reconnects) ==" << endl;
+    cout << left << setw(36) << "Scenario"
+         << right << setw(10) << "Rounds"
+         << setw(10) << "Seconds"
+         << setw(10) << "ms each" << endl;
+
+    auto printConnect = [](const string& name, size_t count, double seconds) {
+        cout << left << setw(36) << name
+             << right << setw(10) << count
+             << fixed << setprecision(2) << setw(10) << seconds
+             << setprecision(0) << setw(10) << (count > 0 ? seconds * 1000 / count : 0.0)
+             << endl;
+    };
+
+    MTPHandler handler;
+    if (!handler.detectDevices()) {
+        cerr << "ERROR: " << handler.getLastError() << endl;
+        return 1;
+    }
+    string name = handler.getDetectedDevices().front();
+
+    auto start = chrono::steady_clock::now();
+    if (!handler.connectToDevice(name, true)) {
+        cerr << "ERROR: " << handler.getLastError() << endl;
+        return 1;
+    }
+    printConnect("First connect, with GVFS release", 1, secondsSince(start));
+    handler.disconnect(false);
+
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; i++) {
+        if (!handler.connectToDevice(name, true)) {
+            cerr << "ERROR: " << handler.getLastError() << endl;
+            return 1;
+        }
+        handler.disconnect(false);
+    }
+    printConnect("Reconnect, device already free", rounds, secondsSince(start));
+    return 0;
+}
+#endif
+
+// Discards cout while alive, for the per-file logging of sync runs
+class QuietOutput {
+public:
+    QuietOutput() : saved_(cout.rdbuf(&sink_)) {}
+    ~QuietOutput() { cout.rdbuf(saved_); }
+private:
+    struct NullBuffer : streambuf {
+        int overflow(int c) override { return c; }
+    } sink_;
+    streambuf* saved_;
+};
+
+// Enumeration, reads and full syncs against a simulated device, so runs at
+// 100k-file scale are reproducible without a phone
+static int benchSimulated(const string& spec, size_t threads) {
+    SimulatedHandler::Options options;
+    string error;
+    if (!SimulatedHandler::Options::parse(spec, options, error)) {
+        cerr << "ERROR: " << error << endl;
+        return 1;
+    }
+
+    cout << "\n== Simulated device (" << spec << ") ==" << endl;
+    cout << left << setw(36) << "Scenario"
+         << right << setw(10) << "Items"
+         << setw(10) << "Seconds"
+         << setw(10) << "Items/s"
+         << setw(10) << "Speedup" << endl;
+
+    SimulatedHandler handler(options);
+    {
+        QuietOutput quiet;
+        if (!handler.detectDevices() || !handler.connectToDevice()) {
+            return 1;
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    auto media = handler.enumerateMedia();
+    double walk = secondsSince(start);
+    printTiming("Enumerate", media.size(), walk, walk);
+
+    start = chrono::steady_clock::now();
+    readFiles(handler, media, 1);
+    double sequential = secondsSince(start);
+    printTiming("Read all, 1 thread", media.size(), sequential, sequential);
+
+    start = chrono::steady_clock::now();
+    readFiles(handler, media, threads);
+    printTiming("Read all, " + to_string(threads) + " threads", media.size(), secondsSince(start),
+                sequential);
+
+    // Full syncs into a scratch destination: the first copies everything
+    // but content duplicates, the second finds every file by fingerprint
+    namespace fs = std::filesystem;
+    error_code ec;
+    fs::path destination = fs::temp_directory_path(ec) /
+                           ("photo_transfer_bench_" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+    fs::create_directories(destination, ec);
+    if (ec) {
+        cerr << "ERROR: Failed to create " << destination.string() << ": " << ec.message() << endl;
+        return 1;
+    }
+
+    int result = 0;
+    {
+        PhotoDB db;
+        if (!db.open((destination / ".photo_transfer.db").string()) || !db.initialize()) {
+            cerr << "ERROR: " << db.getLastError() << endl;
+            result = 1;
+        } else {
+            PhotoSync sync(&handler, &db, destination.string());
+            PhotoSync::SyncResult first;
+            PhotoSync::SyncResult second;
+
+            start = chrono::steady_clock::now();
+            {
+                QuietOutput quiet;
+                first = sync.syncPhotos(false);
+            }
+            double initial = secondsSince(start);
+            auto first_stages = sync.getStageStats();
+            printTiming("Sync, empty destination", first.total_photos, initial, initial);
+
+            start = chrono::steady_clock::now();
+            {
+                QuietOutput quiet;
+                second = sync.syncPhotos(false);
+            }
+            printTiming("Re-sync, unchanged device", second.total_photos, secondsSince(start), initial);
+
+            cout << "  First sync: " << first.new_photos << " copied, " << first.skipped_photos
+                 << " duplicates skipped, " << first.failed_photos << " failed" << endl;
+            for (const auto& stage : first_stages) {
+                cout << "    " << left << setw(8) << stage.name << right
+                     << setw(3) << stage.workers << " workers, "
+                     << setw(3) << static_cast<int>(stage.utilisation * 100 + 0.5) << "% busy, queue "
+                     << fixed << setprecision(1) << stage.average_queue_depth << " avg / "
+                     << stage.max_queue_depth << " peak" << endl;
+            }
+            cout << "  Re-sync: " << second.new_photos << " copied, " << second.skipped_photos
+                 << " skipped" << endl;
+        }
+    }
+
+    fs::remove_all(destination, ec);
+    handler.disconnect();
+    return result;
+}
+
+// The per-handler classifier the table replaced: a lowercase copy of the
+// name, then a suffix compare per extension, repeated for the MIME type
+static bool legacyEndsWith(const string& str, const string& suffix) {
+    return str.length() >= suffix.length() &&
+           str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+}
+
+static bool legacyIsMediaFile(const string& filename) {
+    string lower = filename;
+    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    return legacyEndsWith(lower, ".jpg") || legacyEndsWith(lower, ".jpeg") ||
+           legacyEndsWith(lower, ".png") || legacyEndsWith(lower, ".gif") ||
+           legacyEndsWith(lower, ".bmp") || legacyEndsWith(lower, ".webp") ||
+           legacyEndsWith(lower, ".heic") || legacyEndsWith(lower, ".heif") ||
+           legacyEndsWith(lower, ".mp4") || legacyEndsWith(lower, ".mov") ||
+           legacyEndsWith(lower, ".avi") || legacyEndsWith(lower, ".mkv") ||
+           legacyEndsWith(lower, ".m4v") || legacyEndsWith(lower, ".3gp") ||
+           legacyEndsWith(lower, ".webm") || legacyEndsWith(lower, ".flv");
+}
+
+static string legacyGetMimeType(const string& filename) {
+    string lower = filename;
+    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (legacyEndsWith(lower, ".jpg") || legacyEndsWith(lower, ".jpeg")) return "image/jpeg";
+    if (legacyEndsWith(lower, ".png")) return "image/png";
+    if (legacyEndsWith(lower, ".gif")) return "image/gif";
+    if (legacyEndsWith(lower, ".bmp")) return "image/bmp";
+    if (legacyEndsWith(lower, ".webp")) return "image/webp";
+    if (legacyEndsWith(lower, ".heic") || legacyEndsWith(lower, ".heif")) return "image/heic";
+    if (legacyEndsWith(lower, ".mp4") || legacyEndsWith(lower, ".m4v")) return "video/mp4";
+    if (legacyEndsWith(lower, ".mov")) return "video/quicktime";
+    if (legacyEndsWith(lower, ".avi")) return "video/x-msvideo";
+    if (legacyEndsWith(lower, ".mkv")) return "video/x-matroska";
+    if (legacyEndsWith(lower, ".3gp")) return "video/3gpp";
+    if (legacyEndsWith(lower, ".webm")) return "video/webm";
+    if (legacyEndsWith(lower, ".flv")) return "video/x-flv";
+    return "application/octet-stream";
+}
+
+// Classifies a listing-sized batch of names the way enumeration does:
+// filter to media, then look up the MIME type of each match
+static int benchMediaTypes(size_t count) {
+    static const char* NAMES[] = {
+        "IMG_%06zu.jpg", "IMG_%06zu.JPG", "PXL_%06zu.heic", "VID_%06zu.mp4",
+        "Screenshot_%06zu.png", "DSC%06zu.jpeg", "MOV_%06zu.MOV", "notes_%06zu.txt",
+        ".thumbnail_%06zu", "album_%06zu.json", "clip_%06zu.webm", "scan_%06zu.pdf",
+    };
+    constexpr size_t NAME_COUNT = sizeof(NAMES) / sizeof(NAMES[0]);
+
+    vector<string> filenames;
+    filenames.reserve(count);
+    char buffer[64];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(buffer, sizeof(buffer), NAMES[i % NAME_COUNT], i);
+        filenames.emplace_back(buffer);
+    }
+
+    cout << "\n== Media type classification ==" << endl;
+    cout << left << setw(36) << "Scenario"
+         << right << setw(10) << "Names"
+         << setw(10) << "Seconds"
+         << setw(10) << "Names/s"
+         << setw(10) << "Speedup" << endl;
+
+    // Checksums keep the loops from being optimized away and confirm both
+    // classifiers agree on the names the old one knew
+    size_t legacy_media = 0;
+    size_t legacy_mime = 0;
+    auto start = chrono::steady_clock::now();
+    for (const auto& filename : filenames) {
+        if (legacyIsMediaFile(filename)) {
+            legacy_media++;
+            legacy_mime += legacyGetMimeType(filename).size();
+        }
+    }
+    double baseline = secondsSince(start);
+    printTiming("Suffix chain, per handler", filenames.size(), baseline, baseline);
+
+    size_t table_media = 0;
+    size_t table_mime = 0;
+    start = chrono::steady_clock::now();
+    for (const auto& filename : filenames) {
+        const MediaTypes::MediaType* type = MediaTypes::classify(filename);
+        if (type) {
+            table_media++;
+            table_mime += strlen(type->mime_type);
+        }
+    }
+    printTiming("Compile-time table", filenames.size(), secondsSince(start), baseline);
+
+    if (legacy_media != table_media || legacy_mime != table_mime) {
+        cerr << "ERROR: Classifiers disagree (" << legacy_media << " vs " << table_media
+             << " media files)" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// 100k small files, a few of them duplicates, on an unthrottled link
+static const char* DEFAULT_SIM_SPEC = "sim:files=100000,size=8K,dup=0.05";
+
+static void printUsage(const char* program_name) {
+    cout << "Usage: " << program_name << " [OPTIONS]" << endl;
+    cout << "\nOptions:" << endl;
+    cout << "  --connections N           AFC connections or reader threads for the pooled runs (default 4)" << endl;
+    cout << "  --files N                 Number of files to read (default 32)" << endl;
+    cout << "  --only NAME               Run one benchmark: types, sim, enum, reads," << endl;
+    cout << "                            or connect (MTP, opt-in)" << endl;
+    cout << "  --sim SPEC                Simulated device for the sim benchmark" << endl;
+    cout << "                            (default " << DEFAULT_SIM_SPEC << ")" << endl;
+    cout << "  -h, --help                Show this help message" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t connections = 4;
+    size_t file_count = 32;
+    string only;
+    string sim_spec = DEFAULT_SIM_SPEC;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            printUsage(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            connections = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--files") == 0 && i + 1 < argc) {
+            file_count = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--only") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--sim") == 0 && i + 1 < argc) {
+            sim_spec = argv[++i];
+        } else {
+            cerr << "Unknown option: " << argv[i] << endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    int result = 0;
+
+    if (only.empty() || only == "types") {
+        result = benchMediaTypes(1000000);
+    }
+    if (result == 0 && (only.empty() || only == "sim")) {
+        result = benchSimulated(sim_spec, connections);
+    }
+
+#ifdef ENABLE_IOS
+    if (result == 0 && (only.empty() || only == "enum")) {
+        result = benchEnumeration(connections);
+    }
+    if (result == 0 && (only.empty() || only == "reads")) {
+        result = benchAfcPool(connections, file_count);
+    }
+#else
+    (void)file_count;
+#endif
+
+#if defined(ENABLE_ANDROID) && !defined(USE_WPD)
+    // Opt-in only: it releases the phone from the desktop's MTP mounts
+    if (result == 0 && only == "connect") {
+        result = benchMtpConnect(5);
+    }
+#endif
+
+    return result;
+}
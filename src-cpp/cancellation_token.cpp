@@ -0,0 +1,25 @@
+#include "cancellation_token.h"
+
+using namespace std;
+
+CancellationToken::CancellationToken(const CancellationToken* parent, Clock::duration timeout)
+    : parent_(parent), deadline_(Clock::now() + timeout) {
+}
+
+bool CancellationToken::isCancelled() const {
+    if (cancelled_ || Clock::now() >= deadline_) {
+        return true;
+    }
+    return parent_ != nullptr && parent_->isCancelled();
+}
+
+bool CancellationToken::timedOut() const {
+    if (Clock::now() >= deadline_) {
+        return true;
+    }
+    return parent_ != nullptr && parent_->timedOut();
+}
+
+CancellationToken::Clock::duration CancellationToken::readTimeout(uint64_t bytes) {
+    return READ_START_ALLOWANCE + chrono::seconds(bytes / MIN_READ_RATE);
+}
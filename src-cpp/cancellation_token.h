@@ -0,0 +1,58 @@
+#ifndef CANCELLATION_TOKEN_H
+#define CANCELLATION_TOKEN_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Tells a device read to give up: when its owner cancels it, or when the
+ * operation runs past its deadline.
+ *
+ * Backends check the token between chunks and before each request they
+ * send, so a read on a stalled phone ends at the next chunk boundary
+ * instead of waiting for data that will not come. A token made with a
+ * parent also stops when the parent is cancelled, which lets one queue-wide
+ * token bound every per-file read.
+ */
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CancellationToken() = default;
+    // Stops with the parent, or by itself once timeout has passed
+    CancellationToken(const CancellationToken* parent, Clock::duration timeout);
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void cancel() { cancelled_ = true; }
+    // Clears a cancellation so the token can be used for another run
+    void reset() { cancelled_ = false; }
+
+    // Whether the read should stop now, for either reason
+    bool isCancelled() const;
+    // Whether this token or a parent ran out of time
+    bool timedOut() const;
+    // "timed out" or "cancelled", for error messages
+    const char* reason() const { return timedOut() ? "timed out" : "cancelled"; }
+
+    // Time allowed to read a file of this size: a fixed allowance for the
+    // device to start sending plus the transfer at a floor rate
+    static Clock::duration readTimeout(uint64_t bytes);
+
+private:
+    const CancellationToken* parent_ = nullptr;
+    std::atomic<bool> cancelled_{false};
+    Clock::time_point deadline_ = Clock::time_point::max();
+
+    static constexpr std::chrono::seconds READ_START_ALLOWANCE{30};
+    static constexpr uint64_t MIN_READ_RATE = 512 * 1024; // Bytes per second
+};
+
+// Checks a token that may be absent; reads without one never stop early
+inline bool isCancelled(const CancellationToken* token) {
+    return token != nullptr && token->isCancelled();
+}
+
+#endif // CANCELLATION_TOKEN_H
@@ -0,0 +1,131 @@
+#include "capture_date_probe.h"
+#include "media_metadata.h"
+#include <iostream>
+
+using namespace std;
+
+static const size_t NONE = static_cast<size_t>(-1);
+
+CaptureDateProbe::CaptureDateProbe(DeviceHandler* device, const vector<MediaInfo>& media,
+                                   const CancellationToken* cancel)
+    : device_(device), cancel_(cancel), media_(media), dates_(media.size(), 0),
+      probed_(media.size(), false), in_flight_(NONE) {
+    for (size_t i = 0; i < media_.size(); i++) {
+        index_[media_[i].object_id] = i;
+    }
+
+    if (device_ && !media_.empty() && !device_->supportsRangedReads()) {
+        cerr << "Device has no ranged reads; folders use modification dates" << endl;
+        ranged_reads_ok_ = false;
+    }
+
+    if (ranged_reads_ok_ && device_ && device_->supportsConcurrentReads() && !media_.empty()) {
+        worker_ = thread(&CaptureDateProbe::run, this);
+    }
+}
+
+CaptureDateProbe::~CaptureDateProbe() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    changed_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+uint64_t CaptureDateProbe::captureDate(const MediaInfo& media) {
+    auto found = index_.find(media.object_id);
+    if (found == index_.end()) {
+        return 0;
+    }
+    size_t index = found->second;
+
+    unique_lock<mutex> lock(mutex_);
+    if (index > wanted_) {
+        // Files the consumer went past without asking are never probed
+        wanted_ = index;
+        changed_.notify_all();
+    }
+
+    if (worker_.joinable()) {
+        changed_.wait(lock, [this, index]() {
+            return probed_[index] || stop_ || !ranged_reads_ok_ ||
+                   (index < next_ && in_flight_ != index);
+        });
+    }
+    if (probed_[index]) {
+        return dates_[index];
+    }
+
+    lock.unlock();
+    uint64_t date = probe(index);
+    lock.lock();
+
+    dates_[index] = date;
+    probed_[index] = true;
+    return date;
+}
+
+void CaptureDateProbe::run() {
+    unique_lock<mutex> lock(mutex_);
+
+    while (!stop_) {
+        next_ = max(next_, wanted_);
+        if (next_ >= media_.size() || next_ >= wanted_ + LOOKAHEAD || !ranged_reads_ok_) {
+            changed_.wait(lock);
+            continue;
+        }
+
+        size_t index = next_++;
+        if (probed_[index]) {
+            continue;
+        }
+
+        in_flight_ = index;
+        lock.unlock();
+        uint64_t date = probe(index);
+        lock.lock();
+
+        dates_[index] = date;
+        probed_[index] = true;
+        in_flight_ = NONE;
+        changed_.notify_all();
+    }
+}
+
+uint64_t CaptureDateProbe::probe(size_t index) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (!ranged_reads_ok_) {
+            return 0;
+        }
+    }
+
+    ObjectId object_id = media_[index].object_id;
+    bool read_failed = false;
+    uint64_t date = 0;
+    MediaMetadata::readCaptureDate(
+        [this, object_id, &read_failed](uint64_t offset, uint32_t length, vector<uint8_t>& data) {
+            CancellationToken deadline(cancel_, CancellationToken::readTimeout(length));
+            read_failed = !device_->readRange(object_id, offset, length, data, &deadline);
+            return !read_failed;
+        },
+        date);
+
+    lock_guard<mutex> lock(mutex_);
+    if (!read_failed) {
+        consecutive_failures_ = 0;
+    } else if (++consecutive_failures_ >= MAX_CONSECUTIVE_FAILURES && ranged_reads_ok_) {
+        // One failure may be a file the device cannot read; a run of them
+        // means every probe would wait out its deadline for nothing
+        cerr << "Capture date probes failed " << consecutive_failures_
+             << " times in a row; remaining folders use modification dates" << endl;
+        ranged_reads_ok_ = false;
+        changed_.notify_all();
+    }
+
+    return date;
+}
@@ -0,0 +1,66 @@
+#ifndef CAPTURE_DATE_PROBE_H
+#define CAPTURE_DATE_PROBE_H
+
+#include "device_handler.h"
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+/**
+ * Reads capture dates from file headers for date-based organization.
+ *
+ * On backends that accept concurrent reads, a background thread probes a
+ * few files ahead of the one being transferred, so its date is usually
+ * known by the time the destination folder is chosen. Other backends are
+ * probed on demand from the calling thread. Each probe is a ranged read of
+ * a few KB, so correct dating adds little USB traffic. Every read has its
+ * own deadline and also stops when the optional cancel token does. A
+ * device without ranged reads, or one that keeps failing them, is no
+ * longer probed.
+ */
+class CaptureDateProbe {
+public:
+    // The media list is copied; dates are looked up by object id
+    CaptureDateProbe(DeviceHandler* device, const std::vector<MediaInfo>& media,
+                     const CancellationToken* cancel = nullptr);
+    ~CaptureDateProbe();
+
+    CaptureDateProbe(const CaptureDateProbe&) = delete;
+    CaptureDateProbe& operator=(const CaptureDateProbe&) = delete;
+
+    // Capture date of a file, waiting for its probe if needed.
+    // Returns 0 when the file is unknown or carries no date.
+    uint64_t captureDate(const MediaInfo& media);
+
+private:
+    // How far the background thread may run ahead of the consumer
+    static constexpr size_t LOOKAHEAD = 16;
+    // Failed reads in a row after which the device is taken to refuse
+    // ranged reads, and files are left undated
+    static constexpr size_t MAX_CONSECUTIVE_FAILURES = 8;
+
+    DeviceHandler* device_;
+    const CancellationToken* cancel_;
+    std::vector<MediaInfo> media_;
+    std::unordered_map<ObjectId, size_t> index_;
+    std::vector<uint64_t> dates_;
+    std::vector<bool> probed_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::thread worker_;
+    size_t next_ = 0;       // Next file the background thread probes
+    size_t wanted_ = 0;     // Last file the consumer asked for
+    size_t in_flight_;      // File being probed by the background thread
+    bool stop_ = false;
+    bool ranged_reads_ok_ = true;
+    size_t consecutive_failures_ = 0;
+
+    void run();
+    uint64_t probe(size_t index);
+};
+
+#endif // CAPTURE_DATE_PROBE_H
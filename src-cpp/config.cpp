@@ -19,6 +19,7 @@ Config::Config()
       device_type_("auto"),
       transfer_mode_("new_only"),
       remember_settings_(true),
+      afc_connections_(4),
       first_run_(true) {
 }
 
@@ -147,6 +148,7 @@ bool Config::reset() {
     device_type_ = "auto";
     transfer_mode_ = "new_only";
     remember_settings_ = true;
+    afc_connections_ = 4;
     first_run_ = true;
     
     std::string config_path = getConfigPath();
@@ -179,6 +181,12 @@ bool Config::parseJson(const std::string& json) {
         if (json.substr(pos, 4) == "true") return "true";
         if (json.substr(pos, 5) == "false") return "false";
         
+        // Check for number
+        if (json[pos] >= '0' && json[pos] <= '9') {
+            size_t end = json.find_first_not_of("0123456789", pos);
+            return json.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        }
+        
         // Check for string (quoted)
         if (json[pos] == '"') {
             size_t end = json.find("\"", pos + 1);
@@ -203,6 +211,9 @@ bool Config::parseJson(const std::string& json) {
     if (remember == "true") remember_settings_ = true;
     else if (remember == "false") remember_settings_ = false;
     
+    std::string connections = getValue("afc_connections");
+    if (!connections.empty()) setAfcConnections(std::atoi(connections.c_str()));
+    
     return true;
 }
 
@@ -212,7 +223,8 @@ std::string Config::toJson() const {
     ss << "  \"destination_folder\": \"" << destination_folder_ << "\",\n";
     ss << "  \"device_type\": \"" << device_type_ << "\",\n";
     ss << "  \"transfer_mode\": \"" << transfer_mode_ << "\",\n";
-    ss << "  \"remember_settings\": " << (remember_settings_ ? "true" : "false") << "\n";
+    ss << "  \"remember_settings\": " << (remember_settings_ ? "true" : "false") << ",\n";
+    ss << "  \"afc_connections\": " << afc_connections_ << "\n";
     ss << "}\n";
     return ss.str();
 }
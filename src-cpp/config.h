@@ -33,6 +33,10 @@ public:
     bool getRememberSettings() const { return remember_settings_; }
     void setRememberSettings(bool remember) { remember_settings_ = remember; }
     
+    // Parallel AFC connections per iOS device (1 = sequential reads)
+    int getAfcConnections() const { return afc_connections_; }
+    void setAfcConnections(int connections) { afc_connections_ = connections < 1 ? 1 : connections; }
+    
     // Check if this is first run (no config file exists)
     bool isFirstRun() const { return first_run_; }
     
@@ -47,6 +51,7 @@ private:
     std::string device_type_;
     std::string transfer_mode_;
     bool remember_settings_;
+    int afc_connections_;
     bool first_run_;
     
     // Get platform-specific config directory
@@ -0,0 +1,192 @@
+#include "destination_index.h"
+#include "utils.h"
+#include <filesystem>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <ctime>
+#include <sys/stat.h>
+
+using namespace std;
+
+void DestinationIndex::build(const string& root, size_t threads) {
+    namespace fs = std::filesystem;
+
+    string base = root;
+    while (base.size() > 1 && (base.back() == '/' || base.back() == '\\')) {
+        base.pop_back();
+    }
+
+    unordered_map<string, Entry> files;
+    unordered_set<string> directories;
+    mutex scan_mutex;
+    condition_variable scan_changed;
+    deque<string> pending;
+    size_t listing = 0;
+
+    error_code ec;
+    if (fs::is_directory(base, ec)) {
+        directories.insert(base);
+        pending.push_back(base);
+    }
+
+    // Each worker lists one directory at a time and queues its subdirectories
+    auto scan = [&]() {
+        unique_lock<mutex> lock(scan_mutex);
+        for (;;) {
+            scan_changed.wait(lock, [&]() { return !pending.empty() || listing == 0; });
+            if (pending.empty()) {
+                return; // Nothing queued and nobody listing: the walk is done
+            }
+            string dir = move(pending.front());
+            pending.pop_front();
+            listing++;
+            lock.unlock();
+
+            vector<pair<string, Entry>> found_files;
+            vector<string> found_dirs;
+            error_code list_error;
+            for (fs::directory_iterator it(dir, list_error), end; !list_error && it != end;
+                 it.increment(list_error)) {
+                string path = Utils::joinPath(dir, it->path().filename().string());
+                error_code type_error;
+                if (it->is_directory(type_error)) {
+                    found_dirs.push_back(path);
+                    continue;
+                }
+
+                struct stat info;
+                if (stat(path.c_str(), &info) == 0) {
+                    Entry entry;
+                    entry.size = info.st_size;
+                    entry.modification_time = info.st_mtime;
+                    found_files.emplace_back(move(path), entry);
+                }
+            }
+
+            lock.lock();
+            for (auto& file : found_files) {
+                files.insert(move(file));
+            }
+            for (auto& found : found_dirs) {
+                directories.insert(found);
+                pending.push_back(move(found));
+            }
+            listing--;
+            scan_changed.notify_all();
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t i = 0; i < max<size_t>(threads, 1); i++) {
+        workers.emplace_back(scan);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    root_ = base;
+    files_ = move(files);
+    directories_ = move(directories);
+    built_ = true;
+}
+
+void DestinationIndex::clear() {
+    lock_guard<mutex> lock(mutex_);
+    root_.clear();
+    files_.clear();
+    directories_.clear();
+    built_ = false;
+}
+
+bool DestinationIndex::isBuilt() const {
+    lock_guard<mutex> lock(mutex_);
+    return built_;
+}
+
+bool DestinationIndex::covers(const string& path) const {
+    if (!built_ || path.compare(0, root_.size(), root_) != 0) {
+        return false;
+    }
+    return path.size() == root_.size() || path[root_.size()] == '/' || path[root_.size()] == '\\';
+}
+
+bool DestinationIndex::fileExists(const string& path) const {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (covers(path)) {
+            return files_.count(path) > 0 || directories_.count(path) > 0;
+        }
+    }
+    return Utils::fileExists(path);
+}
+
+uint64_t DestinationIndex::getFileSize(const string& path) const {
+    Entry entry;
+    return findFile(path, entry) ? entry.size : 0;
+}
+
+bool DestinationIndex::findFile(const string& path, Entry& entry) const {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (covers(path)) {
+            auto it = files_.find(path);
+            if (it == files_.end()) {
+                return false;
+            }
+            entry = it->second;
+            return true;
+        }
+    }
+
+    if (!Utils::fileExists(path)) {
+        return false;
+    }
+    entry.size = Utils::getFileSize(path);
+    entry.modification_time = Utils::getFileModificationTime(path);
+    return true;
+}
+
+bool DestinationIndex::createDirectory(const string& path) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (covers(path) && directories_.count(path) > 0) {
+            return true;
+        }
+    }
+
+    // Only directories the run creates reach the filesystem
+    if (!Utils::createDirectory(path)) {
+        return false;
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    for (string dir = path; covers(dir) && directories_.insert(dir).second;
+         dir = Utils::getDirectory(dir)) {
+    }
+    return true;
+}
+
+void DestinationIndex::addFile(const string& path, uint64_t size) {
+    lock_guard<mutex> lock(mutex_);
+    if (covers(path)) {
+        Entry entry;
+        entry.size = size;
+        entry.modification_time = static_cast<uint64_t>(time(nullptr));
+        files_[path] = entry;
+    }
+}
+
+void DestinationIndex::removeFile(const string& path) {
+    lock_guard<mutex> lock(mutex_);
+    if (covers(path)) {
+        files_.erase(path);
+    }
+}
+
+size_t DestinationIndex::getFileCount() const {
+    lock_guard<mutex> lock(mutex_);
+    return files_.size();
+}
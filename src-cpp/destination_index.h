@@ -0,0 +1,66 @@
+#ifndef DESTINATION_INDEX_H
+#define DESTINATION_INDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <cstdint>
+
+/**
+ * Snapshot of the destination folder taken once per run, so per-file
+ * existence and size checks are hash lookups instead of stat calls.
+ *
+ * build() walks the tree with several threads, which hides the latency of
+ * network mounts and spinning disks. Files the run writes are added as it
+ * goes. Until build() is called, and for paths outside the indexed folder,
+ * every query goes to the filesystem, so callers need no separate path for
+ * single-file operations. All methods are thread-safe.
+ */
+class DestinationIndex {
+public:
+    struct Entry {
+        uint64_t size = 0;
+        uint64_t modification_time = 0;
+    };
+
+    DestinationIndex() = default;
+
+    DestinationIndex(const DestinationIndex&) = delete;
+    DestinationIndex& operator=(const DestinationIndex&) = delete;
+
+    // Replaces the index with a scan of root; a missing root indexes as empty
+    void build(const std::string& root, size_t threads = SCAN_THREADS);
+    // Back to querying the filesystem directly
+    void clear();
+    bool isBuilt() const;
+
+    // Files and directories, like Utils::fileExists()
+    bool fileExists(const std::string& path) const;
+    // 0 for a missing file, like Utils::getFileSize()
+    uint64_t getFileSize(const std::string& path) const;
+    bool findFile(const std::string& path, Entry& entry) const;
+
+    // Creates the directory and its parents unless the index already has it
+    bool createDirectory(const std::string& path);
+
+    // Keep the index in step with files the run writes or deletes
+    void addFile(const std::string& path, uint64_t size);
+    void removeFile(const std::string& path);
+
+    size_t getFileCount() const;
+
+private:
+    static constexpr size_t SCAN_THREADS = 8;
+
+    std::string root_;
+    bool built_ = false;
+    std::unordered_map<std::string, Entry> files_;
+    std::unordered_set<std::string> directories_;
+    mutable std::mutex mutex_;
+
+    // Whether path lies inside the indexed folder; caller holds mutex_
+    bool covers(const std::string& path) const;
+};
+
+#endif // DESTINATION_INDEX_H
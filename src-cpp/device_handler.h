@@ -1,20 +1,34 @@
 #ifndef DEVICE_HANDLER_H
 #define DEVICE_HANDLER_H
 
+#include "path_filter.h"
+#include "media_metadata.h"
+#include "cancellation_token.h"
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <functional>
+
+/**
+ * Identifies a file on the device. MTP uses the object handle; iOS derives
+ * it from the path, size and modification time so the same file keeps the
+ * same id across enumerations and connections.
+ */
+using ObjectId = uint64_t;
 
 /**
  * Represents a photo/video file on the mobile device
  */
 struct MediaInfo {
-    uint32_t object_id;
+    ObjectId object_id;
     std::string filename;
     std::string path;
     uint64_t file_size;
     uint64_t modification_date;
     std::string mime_type;
+    uint32_t storage_id = 0;
+    uint64_t capture_date = 0;  // From the file header once probed; 0 if unknown
 };
 
 /**
@@ -28,13 +42,44 @@ struct DeviceStorageInfo {
     uint16_t storage_type;
 };
 
+/**
+ * A device folder as last seen by enumeration. When the device still reports
+ * the same modification date and entry count, the folder's cached listing
+ * is current and does not need to be read again.
+ */
+struct FolderStamp {
+    uint32_t storage_id = 0;
+    std::string path;
+    uint32_t folder_id = 0;          // Device handle, where the backend has one
+    uint64_t modification_date = 0;  // 0 if the device does not report it
+    uint32_t entry_count = 0;        // Link count, where the backend reports one
+    bool listed = false;             // False if only seen in its parent's listing
+};
+
+/**
+ * Persistable result of a device walk: every folder seen plus the media
+ * files of the folders that were listed
+ */
+struct EnumerationSnapshot {
+    std::vector<FolderStamp> folders;
+    std::vector<MediaInfo> media;
+};
+
+/**
+ * Receives consecutive chunks of a file as they arrive from the device.
+ * The buffer is only valid for the duration of the call.
+ * Return false to abort the read.
+ */
+using ChunkSink = std::function<bool(const uint8_t* data, size_t size)>;
+
 /**
  * Device type enumeration
  */
 enum class DeviceType {
     UNKNOWN,
     ANDROID,
-    IOS
+    IOS,
+    SIMULATED
 };
 
 /**
@@ -50,18 +95,60 @@ public:
     virtual bool connectToDevice(const std::string& device_name = "", bool auto_unmount = true) = 0;
     virtual void disconnect(bool auto_unmount = true) = 0;
     virtual bool isConnected() const = 0;
+    // Devices found by detectDevices(), as names connectToDevice() accepts
+    virtual std::vector<std::string> getDetectedDevices() const { return {}; }
 
     // Device information
     virtual std::string getDeviceName() const = 0;
     virtual std::string getDeviceManufacturer() const = 0;
     virtual std::string getDeviceModel() const = 0;
+    virtual std::string getSerialNumber() const = 0;
     virtual DeviceType getDeviceType() const = 0;
     virtual std::vector<DeviceStorageInfo> getStorageInfo() const = 0;
 
     // File operations
     virtual std::vector<MediaInfo> enumerateMedia(const std::string& directory_path = "") = 0;
-    virtual bool readFile(uint32_t object_id, std::vector<uint8_t>& data) = 0;
-    virtual bool fileExists(uint32_t object_id) = 0;
+    virtual bool readFile(ObjectId object_id, std::vector<uint8_t>& data) = 0;
+    // Reads give up between chunks once the token, if any, is cancelled or
+    // past its deadline
+    virtual bool readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                                 const CancellationToken* cancel = nullptr) = 0;
+    // Reads up to length bytes starting at offset; data is shorter at end of file
+    virtual bool readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                           std::vector<uint8_t>& data,
+                           const CancellationToken* cancel = nullptr) = 0;
+    virtual bool fileExists(ObjectId object_id) = 0;
+    // Small preview image kept by the device or embedded in the file header.
+    // Returns false when there is none; callers then fall back to readFile().
+    virtual bool readThumbnail(ObjectId object_id, std::vector<uint8_t>& data) {
+        return MediaMetadata::readEmbeddedThumbnail(
+            [this, object_id](uint64_t offset, uint32_t length, std::vector<uint8_t>& range) {
+                return readRange(object_id, offset, length, range);
+            },
+            data);
+    }
+
+    // Enumeration cache: seed with a stored snapshot before enumerateMedia()
+    // so unchanged folders are not listed again, export it afterwards.
+    // Backends without incremental refresh ignore the seed.
+    virtual void setEnumerationSnapshot(const EnumerationSnapshot& snapshot) { (void)snapshot; }
+    virtual EnumerationSnapshot getEnumerationSnapshot() const { return {}; }
+
+    // Include/exclude rules pushed down into enumeration
+    void setPathFilter(const PathFilter& filter) { path_filter_ = filter; }
+    const PathFilter& getPathFilter() const { return path_filter_; }
+
+    // Whether reads may be issued from several threads at once
+    virtual bool supportsConcurrentReads() const { return false; }
+    // False when the device is known to refuse readRange(), so callers
+    // need not find out one failed read at a time
+    virtual bool supportsRangedReads() const { return true; }
+    // Whether a file added to the device gets a larger object id than the
+    // files already on it, so ids can mark how far a sync has got
+    virtual bool hasIncreasingObjectIds() const { return false; }
+    // Whether the last enumeration found that object ids recorded in an
+    // earlier session were reassigned, so they no longer mark anything
+    virtual bool objectIdsRenumbered() const { return false; }
 
     // Error handling
     virtual std::string getLastError() const = 0;
@@ -71,9 +158,13 @@ public:
         switch (type) {
             case DeviceType::ANDROID: return "Android";
             case DeviceType::IOS: return "iOS";
+            case DeviceType::SIMULATED: return "Simulated";
             default: return "Unknown";
         }
     }
+
+protected:
+    PathFilter path_filter_ = PathFilter::defaults();
 };
 
 #endif // DEVICE_HANDLER_H
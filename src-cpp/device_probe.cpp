@@ -0,0 +1,106 @@
+#include "device_probe.h"
+#include <thread>
+
+#ifdef ENABLE_ANDROID
+    #ifdef USE_WPD
+        #include "wpd_handler.h"
+    #else
+        #include "mtp_handler.h"
+    #endif
+#endif
+
+#ifdef ENABLE_IOS
+#include "ios_handler.h"
+#endif
+
+using namespace std;
+
+static unique_ptr<DeviceHandler> createBackend(DeviceType type) {
+    switch (type) {
+#ifdef ENABLE_ANDROID
+        case DeviceType::ANDROID:
+    #ifdef USE_WPD
+            return make_unique<WPDHandler>();
+    #else
+            return make_unique<MTPHandler>();
+    #endif
+#endif
+#ifdef ENABLE_IOS
+        case DeviceType::IOS:
+            return make_unique<iOSHandler>();
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+bool DeviceProbe::probe(const string& device_type) {
+    backends_.clear();
+    candidates_.clear();
+    last_error_.clear();
+
+#if defined(ENABLE_ANDROID) || defined(ENABLE_IOS)
+    bool any = device_type == "auto" || device_type.empty();
+#endif
+#ifdef ENABLE_ANDROID
+    if (any || device_type == "android") {
+        backends_.push_back({DeviceType::ANDROID, nullptr, false});
+    }
+#endif
+#ifdef ENABLE_IOS
+    if (any || device_type == "ios") {
+        backends_.push_back({DeviceType::IOS, nullptr, false});
+    }
+#endif
+    if (backends_.empty()) {
+        last_error_ = "Device type not available in this build: " + device_type;
+        return false;
+    }
+
+    // Backend setup (LIBMTP_Init, the usbmuxd connection) is part of the
+    // probe, so it runs on the probing thread too
+    auto detect = [](Backend& backend) {
+        backend.handler = createBackend(backend.type);
+        backend.found = backend.handler && backend.handler->detectDevices();
+    };
+
+    vector<thread> probes;
+    for (size_t i = 1; i < backends_.size(); i++) {
+        probes.emplace_back(detect, ref(backends_[i]));
+    }
+    detect(backends_[0]);
+    for (auto& probe : probes) {
+        probe.join();
+    }
+
+    for (const auto& backend : backends_) {
+        if (!backend.found) {
+            if (backend.handler) {
+                last_error_ += (last_error_.empty() ? "" : "\n") +
+                               DeviceHandler::getDeviceTypeName(backend.type) + ": " +
+                               backend.handler->getLastError();
+            }
+            continue;
+        }
+
+        auto names = backend.handler->getDetectedDevices();
+        if (names.empty()) {
+            // Backend without device names: connectToDevice() opens the first
+            names.push_back("");
+        }
+        for (const auto& name : names) {
+            candidates_.push_back({backend.type, name});
+        }
+    }
+
+    return !candidates_.empty();
+}
+
+unique_ptr<DeviceHandler> DeviceProbe::takeHandler(DeviceType type) {
+    for (auto& backend : backends_) {
+        if (backend.type == type && backend.found && backend.handler) {
+            return move(backend.handler);
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,58 @@
+#ifndef DEVICE_PROBE_H
+#define DEVICE_PROBE_H
+
+#include "device_handler.h"
+#include <string>
+#include <vector>
+#include <memory>
+
+/**
+ * A device found by probing, named as its backend's connectToDevice() expects
+ */
+struct DeviceCandidate {
+    DeviceType type;
+    std::string name;
+};
+
+/**
+ * Finds devices on every compiled-in backend at once.
+ *
+ * Each backend is created and runs detectDevices() on its own thread, so
+ * auto-detection takes as long as the slowest backend rather than the sum
+ * of all of them. The handlers are kept with their detection results and
+ * handed to the caller, which connects without scanning again.
+ */
+class DeviceProbe {
+public:
+    DeviceProbe() = default;
+
+    DeviceProbe(const DeviceProbe&) = delete;
+    DeviceProbe& operator=(const DeviceProbe&) = delete;
+
+    // Probes one backend ("android", "ios") or all of them ("auto" or empty).
+    // Returns false if no device was found.
+    bool probe(const std::string& device_type = "auto");
+
+    // Android devices first, then iOS, in detection order
+    const std::vector<DeviceCandidate>& getCandidates() const { return candidates_; }
+
+    // Hands over the backend that found a candidate, detection already done.
+    // Each backend can be taken once.
+    std::unique_ptr<DeviceHandler> takeHandler(DeviceType type);
+
+    // Why backends found nothing, one line per backend
+    std::string getLastError() const { return last_error_; }
+
+private:
+    struct Backend {
+        DeviceType type;
+        std::unique_ptr<DeviceHandler> handler;
+        bool found = false;
+    };
+
+    std::vector<Backend> backends_;
+    std::vector<DeviceCandidate> candidates_;
+    std::string last_error_;
+};
+
+#endif // DEVICE_PROBE_H
@@ -0,0 +1,188 @@
+#include "hotplug_monitor.h"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+HotplugMonitor::~HotplugMonitor() {
+    stop();
+}
+
+void HotplugMonitor::setError(const string& error) {
+    last_error_ = error;
+    cerr << "Hotplug Error: " << error << endl;
+}
+
+#ifdef __linux__
+
+bool HotplugMonitor::start() {
+    stop();
+
+    socket_ = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (socket_ < 0) {
+        setError(string("Failed to open uevent socket: ") + strerror(errno));
+        return false;
+    }
+
+    // Room for the burst of events a phone sends while it enumerates
+    int buffer_size = 1024 * 1024;
+    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = 1; // Kernel uevents
+    if (bind(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        setError(string("Failed to listen for uevents: ") + strerror(errno));
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void HotplugMonitor::stop() {
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+// Interfaces phones sync over: PTP/MTP ("6/1/1"), Android's vendor-specific
+// MTP interface ("255/255/0"), and anything from Apple (VID 0x05ac)
+static bool isPhoneInterface(const string& interface, const string& product) {
+    if (interface == "6/1/1" || interface == "255/255/0") {
+        return true;
+    }
+    return product.compare(0, product.find('/'), "5ac") == 0;
+}
+
+// Classifies one uevent: "ACTION@DEVPATH\0KEY=VALUE\0..."
+static HotplugMonitor::Event parseUevent(const char* message, size_t length,
+                                         string& device_path) {
+    string action;
+    string subsystem;
+    string devtype;
+    string devpath;
+    string interface;
+    string product;
+
+    for (size_t offset = 0; offset < length;) {
+        const char* field = message + offset;
+        size_t field_length = strnlen(field, length - offset);
+        if (strncmp(field, "ACTION=", 7) == 0) {
+            action.assign(field + 7, field_length - 7);
+        } else if (strncmp(field, "SUBSYSTEM=", 10) == 0) {
+            subsystem.assign(field + 10, field_length - 10);
+        } else if (strncmp(field, "DEVTYPE=", 8) == 0) {
+            devtype.assign(field + 8, field_length - 8);
+        } else if (strncmp(field, "DEVPATH=", 8) == 0) {
+            devpath.assign(field + 8, field_length - 8);
+        } else if (strncmp(field, "INTERFACE=", 10) == 0) {
+            interface.assign(field + 10, field_length - 10);
+        } else if (strncmp(field, "PRODUCT=", 8) == 0) {
+            product.assign(field + 8, field_length - 8);
+        }
+        offset += field_length + 1;
+    }
+
+    // Only interface events carry the class; the device is their parent
+    if (subsystem != "usb" || devtype != "usb_interface" ||
+        !isPhoneInterface(interface, product)) {
+        return HotplugMonitor::Event::NONE;
+    }
+    size_t slash = devpath.find_last_of('/');
+    if (slash == string::npos || slash == 0) {
+        return HotplugMonitor::Event::NONE;
+    }
+
+    HotplugMonitor::Event event = HotplugMonitor::Event::NONE;
+    if (action == "add") {
+        event = HotplugMonitor::Event::ADDED;
+    } else if (action == "remove") {
+        event = HotplugMonitor::Event::REMOVED;
+    }
+    if (event != HotplugMonitor::Event::NONE) {
+        device_path = devpath.substr(0, slash);
+    }
+    return event;
+}
+
+HotplugMonitor::Event HotplugMonitor::wait(int timeout_ms, string* device_path) {
+    string path;
+    if (device_path) {
+        device_path->clear();
+    }
+    if (socket_ < 0) {
+        setError("Monitor not started");
+        return Event::NONE;
+    }
+
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    char message[8192];
+
+    while (true) {
+        int remaining = -1;
+        if (timeout_ms >= 0) {
+            auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+            remaining = static_cast<int>(max<int64_t>(left.count(), 0));
+        }
+
+        pollfd descriptor = {socket_, POLLIN, 0};
+        int ready = poll(&descriptor, 1, remaining);
+        if (ready <= 0) {
+            // Timeout, or EINTR so the caller can check for a stop request
+            return Event::NONE;
+        }
+
+        ssize_t length = recv(socket_, message, sizeof(message), MSG_DONTWAIT);
+        if (length < 0) {
+            if (errno == ENOBUFS) {
+                // Events were dropped; one of them may have been a phone
+                return Event::ADDED;
+            }
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            setError(string("Failed to read uevent: ") + strerror(errno));
+            return Event::NONE;
+        }
+
+        Event event = parseUevent(message, static_cast<size_t>(length), path);
+        if (event != Event::NONE) {
+            if (device_path) {
+                *device_path = path;
+            }
+            return event;
+        }
+    }
+}
+
+#else
+
+bool HotplugMonitor::start() {
+    setError("Hot-plug monitoring is only supported on Linux");
+    return false;
+}
+
+void HotplugMonitor::stop() {
+}
+
+HotplugMonitor::Event HotplugMonitor::wait(int timeout_ms, string* device_path) {
+    (void)timeout_ms;
+    if (device_path) {
+        device_path->clear();
+    }
+    return Event::NONE;
+}
+
+#endif
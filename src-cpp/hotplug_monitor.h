@@ -0,0 +1,48 @@
+#ifndef HOTPLUG_MONITOR_H
+#define HOTPLUG_MONITOR_H
+
+#include <string>
+
+/**
+ * Waits for phones to be plugged in or removed.
+ *
+ * On Linux this reads kernel uevents from a netlink socket, so a process
+ * waiting for a phone sleeps in poll() and uses no CPU. Only USB devices
+ * with a PTP/MTP interface, or from Apple, are reported; keyboards, disks
+ * and hubs coming and going are not. Other platforms are not supported
+ * yet; start() fails there.
+ */
+class HotplugMonitor {
+public:
+    enum class Event {
+        NONE,       // Timed out or interrupted by a signal
+        ADDED,
+        REMOVED
+    };
+
+    HotplugMonitor() = default;
+    ~HotplugMonitor();
+
+    HotplugMonitor(const HotplugMonitor&) = delete;
+    HotplugMonitor& operator=(const HotplugMonitor&) = delete;
+
+    bool start();
+    void stop();
+
+    // Blocks until a phone is added or removed or timeout_ms passes; a
+    // negative timeout waits indefinitely. Other uevents are skipped.
+    // device_path, if given, is set to the sysfs path of the USB device,
+    // which stays the same until it is unplugged; it is left empty when
+    // dropped events make the device unknown.
+    Event wait(int timeout_ms, std::string* device_path = nullptr);
+
+    std::string getLastError() const { return last_error_; }
+
+private:
+    int socket_ = -1;
+    std::string last_error_;
+
+    void setError(const std::string& error);
+};
+
+#endif // HOTPLUG_MONITOR_H
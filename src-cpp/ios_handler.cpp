@@ -2,9 +2,15 @@
 
 #include "ios_handler.h"
 #include "utils.h"
+#include "media_types.h"
 #include <iostream>
 #include <algorithm>
 #include <cstring>
+#include <cstdio>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
 
 using namespace std;
 
@@ -17,6 +23,7 @@ iOSHandler::~iOSHandler() {
 }
 
 void iOSHandler::setError(const string& error) {
+    lock_guard<mutex> lock(error_mutex_);
     last_error_ = error;
     cerr << "iOS Error: " << error << endl;
 }
@@ -85,6 +92,7 @@ bool iOSHandler::connectToDevice(const string& device_name, bool auto_unmount) {
     }
     
     // Get device info
+    device_udid_ = target_udid;
     device_name_ = getDeviceValue("DeviceName");
     device_model_ = getDeviceValue("ProductType");
     product_type_ = getDeviceValue("ProductType");
@@ -115,16 +123,86 @@ bool iOSHandler::connectToDevice(const string& device_name, bool auto_unmount) {
         return false;
     }
     
+    // Further clients share the lockdown session; fewer than requested is
+    // not an error, reads simply have less to work with
+    afc_pool_.push_back(afc_);
+    while (afc_pool_.size() < pool_size_) {
+        afc_client_t client = nullptr;
+        if (!openAfcClient(client)) {
+            cerr << "Opened " << afc_pool_.size() << " of " << pool_size_
+                 << " AFC connections" << endl;
+            break;
+        }
+        afc_pool_.push_back(client);
+    }
+    
+    {
+        lock_guard<mutex> lock(pool_mutex_);
+        idle_clients_ = afc_pool_;
+    }
+    
     return true;
 }
 
+bool iOSHandler::openAfcClient(afc_client_t& client) {
+    lockdownd_service_descriptor_t service = nullptr;
+    lockdownd_error_t lock_ret = lockdownd_start_service(lockdown_, "com.apple.afc", &service);
+    if (lock_ret != LOCKDOWN_E_SUCCESS || service == nullptr) {
+        return false;
+    }
+    
+    afc_error_t afc_ret = afc_client_new(device_, service, &client);
+    lockdownd_service_descriptor_free(service);
+    return afc_ret == AFC_E_SUCCESS;
+}
+
+afc_client_t iOSHandler::acquireClient() {
+    unique_lock<mutex> lock(pool_mutex_);
+    client_available_.wait(lock, [this] {
+        return !idle_clients_.empty() || afc_pool_.empty();
+    });
+    
+    if (idle_clients_.empty()) {
+        return nullptr;
+    }
+    
+    afc_client_t client = idle_clients_.back();
+    idle_clients_.pop_back();
+    return client;
+}
+
+afc_client_t iOSHandler::tryAcquireClient() {
+    lock_guard<mutex> lock(pool_mutex_);
+    if (idle_clients_.empty()) {
+        return nullptr;
+    }
+    
+    afc_client_t client = idle_clients_.back();
+    idle_clients_.pop_back();
+    return client;
+}
+
+void iOSHandler::releaseClient(afc_client_t client) {
+    {
+        lock_guard<mutex> lock(pool_mutex_);
+        idle_clients_.push_back(client);
+    }
+    client_available_.notify_one();
+}
+
 void iOSHandler::disconnect(bool auto_unmount) {
     (void)auto_unmount;
     
-    if (afc_) {
-        afc_client_free(afc_);
+    {
+        lock_guard<mutex> lock(pool_mutex_);
+        for (afc_client_t client : afc_pool_) {
+            afc_client_free(client);
+        }
+        afc_pool_.clear();
+        idle_clients_.clear();
         afc_ = nullptr;
     }
+    client_available_.notify_all();
     
     if (lockdown_) {
         lockdownd_client_free(lockdown_);
@@ -136,7 +214,12 @@ void iOSHandler::disconnect(bool auto_unmount) {
         device_ = nullptr;
     }
     
-    file_paths_.clear();
+    object_paths_.clear();
+    device_udid_.clear();
+    seeded_folders_.clear();
+    seeded_subfolders_.clear();
+    seeded_files_.clear();
+    snapshot_ = EnumerationSnapshot();
 }
 
 string iOSHandler::getDeviceName() const {
@@ -217,7 +300,8 @@ vector<DeviceStorageInfo> iOSHandler::getStorageInfo() const {
 }
 
 vector<MediaInfo> iOSHandler::enumerateMedia(const string& directory_path) {
-    file_paths_.clear();
+    // Object IDs from earlier walks stay resolvable; only the snapshot restarts
+    snapshot_ = EnumerationSnapshot();
     
     if (!afc_) {
         setError("Not connected to device");
@@ -227,221 +311,626 @@ vector<MediaInfo> iOSHandler::enumerateMedia(const string& directory_path) {
     string search_path = directory_path.empty() ? "/DCIM" : directory_path;
     cout << "Enumerating media from: " << search_path << endl;
     
-    return enumerateDirectory(search_path, "");
+    // Without the root's stamp it is simply listed
+    PathInfo root;
+    getPathInfo(afc_, search_path, root);
+    
+    return enumerateDirectory(search_path, "", root.modification_date, root.link_count);
+}
+
+// Parses an AFC info dictionary in place: keys are compared with strcmp and
+// numbers read with strtoull, so no strings are built per entry
+static void parseFileInfo(char** file_info, bool& is_dir, uint64_t& size,
+                          uint64_t& modification_date, uint32_t& link_count) {
+    for (int j = 0; file_info[j]; j += 2) {
+        const char* key = file_info[j];
+        const char* value = file_info[j + 1];
+        if (value == nullptr) break;
+        
+        if (strcmp(key, "st_ifmt") == 0) {
+            is_dir = strcmp(value, "S_IFDIR") == 0;
+        } else if (strcmp(key, "st_size") == 0) {
+            size = strtoull(value, nullptr, 10);
+        } else if (strcmp(key, "st_mtime") == 0) {
+            modification_date = strtoull(value, nullptr, 10);
+        } else if (strcmp(key, "st_nlink") == 0) {
+            link_count = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+    }
+}
+
+bool iOSHandler::getPathInfo(afc_client_t client, const string& path, PathInfo& info) {
+    info = PathInfo();
+    
+    char** file_info = nullptr;
+    afc_error_t ret = afc_get_file_info(client, path.c_str(), &file_info);
+    
+    if (ret != AFC_E_SUCCESS || !file_info) {
+        return false;
+    }
+    
+    parseFileInfo(file_info, info.is_dir, info.size, info.modification_date, info.link_count);
+    afc_dictionary_free(file_info);
+    
+    info.exists = true;
+    return true;
+}
+
+vector<iOSHandler::PathInfo> iOSHandler::statPaths(const vector<string>& paths) {
+    vector<PathInfo> infos(paths.size());
+    if (paths.empty()) return infos;
+    
+    ClientLease lease(*this);
+    if (!lease.client) return infos;
+    
+    // AFC has no batched stat and each request is a full round trip, so a
+    // large folder is spread over every idle client instead
+    vector<afc_client_t> clients = {lease.client};
+    if (paths.size() >= PARALLEL_STAT_MIN_ENTRIES) {
+        while (clients.size() < afc_pool_.size()) {
+            afc_client_t extra = tryAcquireClient();
+            if (!extra) break;
+            clients.push_back(extra);
+        }
+    }
+    
+    atomic<size_t> next(0);
+    auto worker = [&](afc_client_t client) {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            getPathInfo(client, paths[i], infos[i]);
+        }
+    };
+    
+    vector<thread> workers;
+    for (size_t i = 1; i < clients.size(); i++) {
+        workers.emplace_back(worker, clients[i]);
+    }
+    worker(clients[0]);
+    
+    for (auto& t : workers) {
+        t.join();
+    }
+    for (size_t i = 1; i < clients.size(); i++) {
+        releaseClient(clients[i]);
+    }
+    
+    return infos;
+}
+
+void iOSHandler::addMedia(MediaInfo info, vector<MediaInfo>& media) {
+    info.object_id = registerObject(info);
+    
+    // The snapshot keeps every media file of a listed folder; the filter
+    // only decides what this enumeration returns
+    snapshot_.media.push_back(info);
+    
+    string rule_path = info.path.substr(info.path.find_first_not_of('/'));
+    if (!path_filter_.shouldInclude(rule_path)) {
+        return;
+    }
+    
+    media.push_back(info);
+}
+
+ObjectId iOSHandler::registerObject(const MediaInfo& info) {
+    // FNV-1a over the path, size and mtime: the same file gets the same ID
+    // in every session, and a replaced file gets a new one
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    mix(info.path.data(), info.path.size());
+    mix(&info.file_size, sizeof(info.file_size));
+    mix(&info.modification_date, sizeof(info.modification_date));
+    
+    // Step past the astronomically unlikely collision with another path
+    ObjectId object_id = hash;
+    auto existing = object_paths_.find(object_id);
+    while (existing != object_paths_.end() && existing->second != info.path) {
+        existing = object_paths_.find(++object_id);
+    }
+    
+    object_paths_[object_id] = info.path;
+    return object_id;
 }
 
-vector<MediaInfo> iOSHandler::enumerateDirectory(const string& path, const string& base_path) {
+const string* iOSHandler::findObjectPath(ObjectId object_id) const {
+    auto found = object_paths_.find(object_id);
+    return found == object_paths_.end() ? nullptr : &found->second;
+}
+
+void iOSHandler::setEnumerationSnapshot(const EnumerationSnapshot& snapshot) {
+    seeded_folders_.clear();
+    seeded_subfolders_.clear();
+    seeded_files_.clear();
+    
+    for (const auto& folder : snapshot.folders) {
+        seeded_folders_[folder.path] = folder;
+        size_t slash = folder.path.rfind('/');
+        if (slash != string::npos && slash > 0) {
+            seeded_subfolders_[folder.path.substr(0, slash)].push_back(folder.path.substr(slash + 1));
+        }
+    }
+    
+    for (const auto& info : snapshot.media) {
+        size_t slash = info.path.rfind('/');
+        if (slash != string::npos) {
+            seeded_files_[info.path.substr(0, slash)].push_back(info);
+        }
+    }
+}
+
+bool iOSHandler::restoreSeededDirectory(const string& path, const string& base_path,
+                                        const FolderStamp& stamp, vector<MediaInfo>& media) {
+    // Adding, removing or renaming an entry changes the folder's mtime and
+    // usually its link count; if neither moved the last listing still holds
+    auto seeded = seeded_folders_.find(path);
+    if (seeded == seeded_folders_.end() || !seeded->second.listed ||
+        stamp.modification_date == 0 ||
+        seeded->second.modification_date != stamp.modification_date ||
+        seeded->second.entry_count != stamp.entry_count) {
+        return false;
+    }
+    
+    auto files = seeded_files_.find(path);
+    if (files != seeded_files_.end()) {
+        for (const auto& info : files->second) {
+            addMedia(info, media);
+        }
+    }
+    
+    // Subfolders still need a stat each, since their own contents may differ
+    bool complete = true;
+    vector<string> names;
+    vector<string> full_paths;
+    auto folders = seeded_subfolders_.find(path);
+    if (folders != seeded_subfolders_.end()) {
+        for (const auto& name : folders->second) {
+            string full_path = path + "/" + name;
+            string rule_path = full_path.substr(full_path.find_first_not_of('/'));
+            
+            if (!path_filter_.shouldDescend(rule_path)) {
+                // Keep the excluded folder known without listing it
+                FolderStamp skipped = seeded_folders_[full_path];
+                skipped.listed = false;
+                snapshot_.folders.push_back(skipped);
+                continue;
+            }
+            
+            names.push_back(name);
+            full_paths.push_back(full_path);
+        }
+    }
+    
+    vector<PathInfo> infos = statPaths(full_paths);
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!infos[i].exists || !infos[i].is_dir) {
+            complete = false;
+            continue;
+        }
+        
+        string relative_path = base_path.empty() ? names[i] : base_path + "/" + names[i];
+        auto sub_media = enumerateDirectory(full_paths[i], relative_path,
+                                            infos[i].modification_date, infos[i].link_count);
+        media.insert(media.end(), sub_media.begin(), sub_media.end());
+    }
+    
+    FolderStamp listed = stamp;
+    listed.listed = complete;
+    snapshot_.folders.push_back(listed);
+    return true;
+}
+
+vector<MediaInfo> iOSHandler::enumerateDirectory(const string& path, const string& base_path,
+                                                 uint64_t modification_date, uint32_t link_count) {
     vector<MediaInfo> media;
     
     if (!afc_) return media;
     
+    FolderStamp stamp;
+    stamp.storage_id = 1;
+    stamp.path = path;
+    stamp.modification_date = modification_date;
+    stamp.entry_count = link_count;
+    
+    if (restoreSeededDirectory(path, base_path, stamp, media)) {
+        return media;
+    }
+    
     char** dir_list = nullptr;
     afc_error_t ret = afc_read_directory(afc_, path.c_str(), &dir_list);
     
     if (ret != AFC_E_SUCCESS || !dir_list) {
+        snapshot_.folders.push_back(stamp);
         return media;
     }
     
+    // The listing is only reusable next time if every entry was seen
+    bool complete = true;
+    
+    vector<string> names;
+    vector<string> full_paths;
     for (int i = 0; dir_list[i]; i++) {
-        string name = dir_list[i];
+        const char* name = dir_list[i];
         
         // Skip . and ..
-        if (name == "." || name == "..") continue;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
         
         string full_path = path + "/" + name;
-        string relative_path = base_path.empty() ? name : base_path + "/" + name;
         
-        // Get file info
-        char** file_info = nullptr;
-        ret = afc_get_file_info(afc_, full_path.c_str(), &file_info);
+        // Rules are relative to the AFC root, e.g. "DCIM/100APPLE"
+        string rule_path = full_path.substr(full_path.find_first_not_of('/'));
         
-        if (ret == AFC_E_SUCCESS && file_info) {
-            bool is_dir = false;
-            uint64_t file_size = 0;
-            uint64_t mod_time = 0;
-            
-            for (int j = 0; file_info[j]; j += 2) {
-                if (file_info[j + 1] == nullptr) break;
-                
-                string key = file_info[j];
-                string value = file_info[j + 1];
-                
-                if (key == "st_ifmt" && value == "S_IFDIR") {
-                    is_dir = true;
-                } else if (key == "st_size") {
-                    file_size = stoull(value);
-                } else if (key == "st_mtime") {
-                    // Convert nanoseconds to seconds
-                    mod_time = stoull(value) / 1000000000ULL;
-                }
-            }
-            
-            afc_dictionary_free(file_info);
+        // Excluded entries are skipped before any stat or listing
+        if (!path_filter_.shouldDescend(rule_path)) {
+            complete = false;
+            continue;
+        }
+        
+        names.push_back(name);
+        full_paths.push_back(full_path);
+    }
+    afc_dictionary_free(dir_list);
+    
+    // Stat the whole folder in one parallel pass before descending
+    vector<PathInfo> infos = statPaths(full_paths);
+    
+    for (size_t i = 0; i < names.size(); i++) {
+        const string& name = names[i];
+        const PathInfo& entry = infos[i];
+        
+        if (!entry.exists) {
+            complete = false;
+            continue;
+        }
+        
+        if (entry.is_dir) {
+            // Recurse into subdirectory
+            string relative_path = base_path.empty() ? name : base_path + "/" + name;
+            auto sub_media = enumerateDirectory(full_paths[i], relative_path,
+                                                entry.modification_date, entry.link_count);
+            media.insert(media.end(), sub_media.begin(), sub_media.end());
+        } else if (MediaTypes::isMediaFile(name)) {
+            // Add media file
+            MediaInfo info;
+            info.object_id = 0; // Assigned by addMedia
+            info.filename = name;
+            info.path = full_paths[i]; // Store full path for reading
+            info.file_size = entry.size;
+            info.modification_date = entry.modification_date / 1000000000ULL; // Nanoseconds to seconds
+            info.mime_type = MediaTypes::getMimeType(name);
+            info.storage_id = 1; // Single AFC media storage
             
-            if (is_dir) {
-                // Recurse into subdirectory
-                auto sub_media = enumerateDirectory(full_path, relative_path);
-                media.insert(media.end(), sub_media.begin(), sub_media.end());
-            } else if (isMediaFile(name)) {
-                // Add media file
-                MediaInfo info;
-                info.object_id = file_paths_.size(); // Use index as object ID
-                info.filename = name;
-                info.path = full_path; // Store full path for reading
-                info.file_size = file_size;
-                info.modification_date = mod_time;
-                info.mime_type = getMimeType(name);
-                
-                file_paths_.push_back(full_path);
-                media.push_back(info);
-            }
+            addMedia(info, media);
         }
     }
     
-    afc_dictionary_free(dir_list);
+    stamp.listed = complete;
+    snapshot_.folders.push_back(stamp);
     return media;
 }
 
-bool iOSHandler::readFile(uint32_t object_id, vector<uint8_t>& data) {
-    if (object_id >= file_paths_.size()) {
+bool iOSHandler::readFile(ObjectId object_id, vector<uint8_t>& data) {
+    const string* path = findObjectPath(object_id);
+    if (!path) {
         setError("Invalid object ID");
         return false;
     }
     
-    return readFileByPath(file_paths_[object_id], data);
+    return readFileByPath(*path, data);
 }
 
-bool iOSHandler::readFileByPath(const string& path, vector<uint8_t>& data) {
-    if (!afc_) {
-        setError("Not connected to device");
+bool iOSHandler::readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                                 const CancellationToken* cancel) {
+    const string* path = findObjectPath(object_id);
+    if (!path) {
+        setError("Invalid object ID");
         return false;
     }
     
-    uint64_t handle = 0;
-    afc_error_t ret = afc_file_open(afc_, path.c_str(), AFC_FOPEN_RDONLY, &handle);
+    return readFileByPathChunked(*path, sink, cancel);
+}
+
+bool iOSHandler::readFileByPath(const string& path, vector<uint8_t>& data) {
+    data.clear();
+    return readFileByPathChunked(path, [&data](const uint8_t* chunk, size_t size) {
+        data.insert(data.end(), chunk, chunk + size);
+        return true;
+    });
+}
+
+// Reads length bytes from the current position in 1MB requests; stops
+// early at end of file, and fails once the token is cancelled
+static bool readFully(afc_client_t client, uint64_t handle, char* buffer,
+                      uint32_t length, uint32_t& total_read, const CancellationToken* cancel) {
+    total_read = 0;
+    while (total_read < length) {
+        if (isCancelled(cancel)) {
+            return false;
+        }
+        
+        uint32_t bytes_read = 0;
+        uint32_t to_read = min(static_cast<uint32_t>(1024 * 1024), length - total_read);
+        afc_error_t ret = afc_file_read(client, handle, buffer + total_read, to_read, &bytes_read);
+        
+        if (ret != AFC_E_SUCCESS) {
+            return false;
+        }
+        if (bytes_read == 0) {
+            break; // End of file
+        }
+        
+        total_read += bytes_read;
+    }
     
-    if (ret != AFC_E_SUCCESS) {
-        setError("Failed to open file: " + path);
+    return true;
+}
+
+bool iOSHandler::readFileByPathChunked(const string& path, const ChunkSink& sink,
+                                       const CancellationToken* cancel) {
+    ClientLease lease(*this);
+    if (!lease.client) {
+        setError("Not connected to device");
         return false;
     }
+    afc_client_t client = lease.client;
     
     // Get file size
-    char** file_info = nullptr;
-    ret = afc_get_file_info(afc_, path.c_str(), &file_info);
+    PathInfo file_info;
+    getPathInfo(client, path, file_info);
+    uint64_t file_size = file_info.size;
     
-    uint64_t file_size = 0;
-    if (ret == AFC_E_SUCCESS && file_info) {
-        for (int i = 0; file_info[i]; i += 2) {
-            if (file_info[i + 1] && string(file_info[i]) == "st_size") {
-                file_size = stoull(file_info[i + 1]);
-                break;
+    if (file_size == 0) {
+        setError("File size is 0 or could not be determined");
+        return false;
+    }
+    
+    // Large files go out as stripes over every client that is free right now
+    if (file_size >= STRIPE_MIN_FILE_SIZE) {
+        vector<afc_client_t> clients = {client};
+        while (clients.size() < afc_pool_.size()) {
+            afc_client_t extra = tryAcquireClient();
+            if (!extra) break;
+            clients.push_back(extra);
+        }
+        
+        if (clients.size() > 1) {
+            bool ok = readStriped(path, file_size, clients, sink, cancel);
+            for (size_t i = 1; i < clients.size(); i++) {
+                releaseClient(clients[i]);
             }
+            return ok;
         }
-        afc_dictionary_free(file_info);
     }
     
-    if (file_size == 0) {
-        afc_file_close(afc_, handle);
-        setError("File size is 0 or could not be determined");
+    uint64_t handle = 0;
+    afc_error_t ret = afc_file_open(client, path.c_str(), AFC_FOPEN_RDONLY, &handle);
+    
+    if (ret != AFC_E_SUCCESS) {
+        setError("Failed to open file: " + path);
         return false;
     }
     
-    // Read file in chunks
-    data.resize(file_size);
+    // Read file in 1MB chunks through a single reusable buffer
+    vector<char> buffer(1024 * 1024);
     uint32_t bytes_read = 0;
     uint64_t total_read = 0;
     
     while (total_read < file_size) {
-        uint32_t to_read = min((uint64_t)(1024 * 1024), file_size - total_read); // 1MB chunks
-        ret = afc_file_read(afc_, handle, reinterpret_cast<char*>(data.data() + total_read), to_read, &bytes_read);
+        // A locked phone stops answering; give up before the next request
+        if (isCancelled(cancel)) {
+            afc_file_close(client, handle);
+            setError(string("Read ") + cancel->reason() + ": " + path);
+            return false;
+        }
+        
+        uint32_t to_read = min((uint64_t)buffer.size(), file_size - total_read);
+        ret = afc_file_read(client, handle, buffer.data(), to_read, &bytes_read);
         
         if (ret != AFC_E_SUCCESS || bytes_read == 0) {
             break;
         }
         
+        if (!sink(reinterpret_cast<const uint8_t*>(buffer.data()), bytes_read)) {
+            afc_file_close(client, handle);
+            setError("Read aborted: " + path);
+            return false;
+        }
+        
         total_read += bytes_read;
     }
     
-    afc_file_close(afc_, handle);
+    afc_file_close(client, handle);
     
     if (total_read != file_size) {
-        data.resize(total_read);
+        setError("Short read: " + path);
+        return false;
     }
     
-    return total_read > 0;
+    return true;
 }
 
-bool iOSHandler::fileExists(uint32_t object_id) {
-    if (object_id >= file_paths_.size()) {
-        return false;
+bool iOSHandler::readStriped(const string& path, uint64_t file_size,
+                             const vector<afc_client_t>& clients, const ChunkSink& sink,
+                             const CancellationToken* cancel) {
+    // Client i reads stripes i, i + n, i + 2n, ... into a small reorder
+    // window; the calling thread hands them to the sink strictly in order
+    const uint64_t stripe_count = (file_size + STRIPE_SIZE - 1) / STRIPE_SIZE;
+    const uint64_t window = clients.size() * 2;
+    
+    mutex stripes_mutex;
+    condition_variable stripes_changed;
+    map<uint64_t, vector<char>> ready;
+    uint64_t next_stripe = 0;
+    bool failed = false;
+    string failure;
+    
+    auto reader = [&](size_t index) {
+        afc_client_t client = clients[index];
+        uint64_t handle = 0;
+        bool ok = afc_file_open(client, path.c_str(), AFC_FOPEN_RDONLY, &handle) == AFC_E_SUCCESS;
+        
+        for (uint64_t stripe = index; ok && stripe < stripe_count; stripe += clients.size()) {
+            {
+                unique_lock<mutex> lock(stripes_mutex);
+                stripes_changed.wait(lock, [&] {
+                    return failed || stripe < next_stripe + window;
+                });
+                if (failed) break;
+            }
+            
+            uint64_t offset = stripe * STRIPE_SIZE;
+            uint32_t length = static_cast<uint32_t>(min<uint64_t>(STRIPE_SIZE, file_size - offset));
+            vector<char> data(length);
+            uint32_t total_read = 0;
+            ok = afc_file_seek(client, handle, static_cast<int64_t>(offset), SEEK_SET) == AFC_E_SUCCESS &&
+                 readFully(client, handle, data.data(), length, total_read, cancel) &&
+                 total_read == length;
+            
+            {
+                lock_guard<mutex> lock(stripes_mutex);
+                if (ok) {
+                    ready.emplace(stripe, move(data));
+                } else if (!failed) {
+                    failed = true;
+                    failure = isCancelled(cancel) ? string("Read ") + cancel->reason() + ": " + path
+                                                  : "Failed to read file: " + path;
+                }
+            }
+            stripes_changed.notify_all();
+        }
+        
+        if (handle != 0) {
+            afc_file_close(client, handle);
+        }
+        if (!ok) {
+            lock_guard<mutex> lock(stripes_mutex);
+            if (!failed) {
+                failed = true;
+                failure = "Failed to open file: " + path;
+            }
+            stripes_changed.notify_all();
+        }
+    };
+    
+    vector<thread> readers;
+    for (size_t i = 0; i < clients.size(); i++) {
+        readers.emplace_back(reader, i);
     }
     
-    if (!afc_) return false;
+    while (true) {
+        vector<char> data;
+        {
+            unique_lock<mutex> lock(stripes_mutex);
+            if (next_stripe == stripe_count) break;
+            stripes_changed.wait(lock, [&] {
+                return failed || ready.count(next_stripe) != 0;
+            });
+            if (failed) break;
+            
+            auto stripe = ready.find(next_stripe);
+            data = move(stripe->second);
+            ready.erase(stripe);
+        }
+        
+        bool accepted = sink(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        
+        {
+            lock_guard<mutex> lock(stripes_mutex);
+            if (!accepted) {
+                failed = true;
+                failure = "Read aborted: " + path;
+            } else {
+                next_stripe++;
+            }
+        }
+        stripes_changed.notify_all();
+        if (!accepted) break;
+    }
     
-    char** file_info = nullptr;
-    afc_error_t ret = afc_get_file_info(afc_, file_paths_[object_id].c_str(), &file_info);
+    for (auto& t : readers) {
+        t.join();
+    }
     
-    if (ret == AFC_E_SUCCESS && file_info) {
-        afc_dictionary_free(file_info);
-        return true;
+    if (failed) {
+        setError(failure);
+        return false;
     }
     
-    return false;
-}
-
-// C++17 compatible ends_with helper
-static bool endsWith(const string& str, const string& suffix) {
-    return str.length() >= suffix.length() &&
-           str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
+    return true;
 }
 
-bool iOSHandler::isPhotoFile(const string& filename) const {
-    string lower = filename;
-    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+bool iOSHandler::readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                           vector<uint8_t>& data, const CancellationToken* cancel) {
+    const string* path = findObjectPath(object_id);
+    if (!path) {
+        setError("Invalid object ID");
+        return false;
+    }
     
-    return endsWith(lower, ".jpg") || endsWith(lower, ".jpeg") ||
-           endsWith(lower, ".png") || endsWith(lower, ".gif") ||
-           endsWith(lower, ".bmp") || endsWith(lower, ".webp") ||
-           endsWith(lower, ".heic") || endsWith(lower, ".heif") ||
-           endsWith(lower, ".dng") || endsWith(lower, ".raw");
+    return readRangeByPath(*path, offset, length, data, cancel);
 }
 
-bool iOSHandler::isVideoFile(const string& filename) const {
-    string lower = filename;
-    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+bool iOSHandler::readRangeByPath(const string& path, uint64_t offset, uint32_t length,
+                                 vector<uint8_t>& data, const CancellationToken* cancel) {
+    data.clear();
     
-    return endsWith(lower, ".mp4") || endsWith(lower, ".mov") ||
-           endsWith(lower, ".m4v") || endsWith(lower, ".avi") ||
-           endsWith(lower, ".mkv") || endsWith(lower, ".3gp") ||
-           endsWith(lower, ".webm");
-}
-
-bool iOSHandler::isMediaFile(const string& filename) const {
-    return isPhotoFile(filename) || isVideoFile(filename);
+    ClientLease lease(*this);
+    if (!lease.client) {
+        setError("Not connected to device");
+        return false;
+    }
+    afc_client_t client = lease.client;
+    
+    uint64_t handle = 0;
+    afc_error_t ret = afc_file_open(client, path.c_str(), AFC_FOPEN_RDONLY, &handle);
+    
+    if (ret != AFC_E_SUCCESS) {
+        setError("Failed to open file: " + path);
+        return false;
+    }
+    
+    ret = afc_file_seek(client, handle, static_cast<int64_t>(offset), SEEK_SET);
+    if (ret != AFC_E_SUCCESS) {
+        afc_file_close(client, handle);
+        setError("Failed to seek in file: " + path);
+        return false;
+    }
+    
+    data.resize(length);
+    uint32_t total_read = 0;
+    bool ok = readFully(client, handle, reinterpret_cast<char*>(data.data()), length, total_read, cancel);
+    afc_file_close(client, handle);
+    
+    if (!ok) {
+        data.clear();
+        setError(isCancelled(cancel) ? string("Read ") + cancel->reason() + ": " + path
+                                     : "Failed to read file: " + path);
+        return false;
+    }
+    
+    data.resize(total_read);
+    return true;
 }
 
-string iOSHandler::getMimeType(const string& filename) const {
-    string lower = filename;
-    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+bool iOSHandler::fileExists(ObjectId object_id) {
+    const string* path = findObjectPath(object_id);
+    if (!path || !afc_) {
+        return false;
+    }
     
-    // Image MIME types
-    if (endsWith(lower, ".jpg") || endsWith(lower, ".jpeg")) return "image/jpeg";
-    if (endsWith(lower, ".png")) return "image/png";
-    if (endsWith(lower, ".gif")) return "image/gif";
-    if (endsWith(lower, ".bmp")) return "image/bmp";
-    if (endsWith(lower, ".webp")) return "image/webp";
-    if (endsWith(lower, ".heic") || endsWith(lower, ".heif")) return "image/heic";
-    if (endsWith(lower, ".dng")) return "image/x-adobe-dng";
+    char** file_info = nullptr;
+    afc_error_t ret = afc_get_file_info(afc_, path->c_str(), &file_info);
     
-    // Video MIME types
-    if (endsWith(lower, ".mp4") || endsWith(lower, ".m4v")) return "video/mp4";
-    if (endsWith(lower, ".mov")) return "video/quicktime";
-    if (endsWith(lower, ".avi")) return "video/x-msvideo";
-    if (endsWith(lower, ".mkv")) return "video/x-matroska";
-    if (endsWith(lower, ".3gp")) return "video/3gpp";
-    if (endsWith(lower, ".webm")) return "video/webm";
+    if (ret == AFC_E_SUCCESS && file_info) {
+        afc_dictionary_free(file_info);
+        return true;
+    }
     
-    return "application/octet-stream";
+    return false;
 }
 
 #endif // ENABLE_IOS
@@ -9,6 +9,9 @@
 #include <libimobiledevice/lockdown.h>
 #include <string>
 #include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
 
 /**
  * iOS Handler class for communicating with iPhone/iPad devices
@@ -23,25 +26,50 @@ public:
     bool detectDevices() override;
     bool connectToDevice(const std::string& device_name = "", bool auto_unmount = true) override;
     void disconnect(bool auto_unmount = true) override;
+    std::vector<std::string> getDetectedDevices() const override { return device_udids_; }
     bool isConnected() const override { return device_ != nullptr && afc_ != nullptr; }
     
     // Device information
     std::string getDeviceName() const override;
     std::string getDeviceManufacturer() const override;
     std::string getDeviceModel() const override;
+    std::string getSerialNumber() const override { return device_udid_; }
     DeviceType getDeviceType() const override { return DeviceType::IOS; }
     std::vector<DeviceStorageInfo> getStorageInfo() const override;
 
     // File operations
     std::vector<MediaInfo> enumerateMedia(const std::string& directory_path = "") override;
-    bool readFile(uint32_t object_id, std::vector<uint8_t>& data) override;
-    bool fileExists(uint32_t object_id) override;
+    bool readFile(ObjectId object_id, std::vector<uint8_t>& data) override;
+    bool readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                         const CancellationToken* cancel = nullptr) override;
+    bool readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                   std::vector<uint8_t>& data,
+                   const CancellationToken* cancel = nullptr) override;
+    bool fileExists(ObjectId object_id) override;
+    bool supportsConcurrentReads() const override { return true; }
+
+    // Enumeration cache
+    void setEnumerationSnapshot(const EnumerationSnapshot& snapshot) override;
+    EnumerationSnapshot getEnumerationSnapshot() const override { return snapshot_; }
 
     // Error handling
-    std::string getLastError() const override { return last_error_; }
+    std::string getLastError() const override {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        return last_error_;
+    }
+
+    // Number of AFC connections opened by connectToDevice(). Each read leases
+    // one, so several files, or several stripes of one large file, can be in
+    // flight at once instead of waiting on each round trip in turn.
+    void setConnectionPoolSize(size_t size) { pool_size_ = size < 1 ? 1 : size; }
+    size_t getConnectionPoolSize() const { return afc_pool_.size(); }
 
     // iOS-specific methods
     bool readFileByPath(const std::string& path, std::vector<uint8_t>& data);
+    bool readFileByPathChunked(const std::string& path, const ChunkSink& sink,
+                               const CancellationToken* cancel = nullptr);
+    bool readRangeByPath(const std::string& path, uint64_t offset, uint32_t length,
+                         std::vector<uint8_t>& data, const CancellationToken* cancel = nullptr);
 
 private:
     idevice_t device_;
@@ -49,22 +77,82 @@ private:
     afc_client_t afc_;
     std::vector<std::string> device_udids_;
     std::string last_error_;
+    mutable std::mutex error_mutex_;
+    
+    // AFC client pool; afc_ is the first client and also serves metadata
+    // calls, which libimobiledevice serialises per client
+    std::vector<afc_client_t> afc_pool_;
+    std::vector<afc_client_t> idle_clients_;
+    std::mutex pool_mutex_;
+    std::condition_variable client_available_;
+    size_t pool_size_ = 4;
+    
+    // Files at least this large are read as parallel stripes when more than
+    // one client is free
+    static constexpr uint64_t STRIPE_MIN_FILE_SIZE = 16ULL * 1024 * 1024;
+    static constexpr uint32_t STRIPE_SIZE = 4 * 1024 * 1024;
     
-    // File path to object ID mapping (since iOS doesn't use object IDs)
-    std::vector<std::string> file_paths_;
+    // Folders with at least this many entries are stat'ed over several clients
+    static constexpr size_t PARALLEL_STAT_MIN_ENTRIES = 16;
+    
+    // Returns a leased client to the pool when it goes out of scope
+    struct ClientLease {
+        explicit ClientLease(iOSHandler& handler)
+            : handler_(handler), client(handler.acquireClient()) {}
+        ~ClientLease() {
+            if (client) handler_.releaseClient(client);
+        }
+        ClientLease(const ClientLease&) = delete;
+        ClientLease& operator=(const ClientLease&) = delete;
+        
+        iOSHandler& handler_;
+        afc_client_t client;
+    };
+    
+    // Object ID to AFC path (AFC addresses files by path only). IDs are
+    // derived from path, size and mtime, so they survive reconnects.
+    std::unordered_map<ObjectId, std::string> object_paths_;
+    
+    // Folders from the last walk, keyed by AFC path; a folder whose mtime and
+    // link count are unchanged is rebuilt from here instead of being listed
+    std::unordered_map<std::string, FolderStamp> seeded_folders_;
+    std::unordered_map<std::string, std::vector<std::string>> seeded_subfolders_;
+    std::unordered_map<std::string, std::vector<MediaInfo>> seeded_files_;
+    EnumerationSnapshot snapshot_;
     
     // Device info cache
+    std::string device_udid_;
     std::string device_name_;
     std::string device_model_;
     std::string product_type_;
     
     // Helper functions
     void setError(const std::string& error);
-    std::vector<MediaInfo> enumerateDirectory(const std::string& path, const std::string& base_path);
-    bool isMediaFile(const std::string& filename) const;
-    bool isPhotoFile(const std::string& filename) const;
-    bool isVideoFile(const std::string& filename) const;
-    std::string getMimeType(const std::string& filename) const;
+    bool openAfcClient(afc_client_t& client);
+    afc_client_t acquireClient();
+    afc_client_t tryAcquireClient();
+    void releaseClient(afc_client_t client);
+    bool readStriped(const std::string& path, uint64_t file_size,
+                     const std::vector<afc_client_t>& clients, const ChunkSink& sink,
+                     const CancellationToken* cancel);
+    std::vector<MediaInfo> enumerateDirectory(const std::string& path, const std::string& base_path,
+                                              uint64_t modification_date, uint32_t link_count);
+    bool restoreSeededDirectory(const std::string& path, const std::string& base_path,
+                                const FolderStamp& stamp, std::vector<MediaInfo>& media);
+    void addMedia(MediaInfo info, std::vector<MediaInfo>& media);
+    ObjectId registerObject(const MediaInfo& info);
+    const std::string* findObjectPath(ObjectId object_id) const;
+    
+    // The fields of an AFC file info dictionary that enumeration needs
+    struct PathInfo {
+        bool exists = false;
+        bool is_dir = false;
+        uint64_t size = 0;
+        uint64_t modification_date = 0; // Nanoseconds
+        uint32_t link_count = 0;
+    };
+    bool getPathInfo(afc_client_t client, const std::string& path, PathInfo& info);
+    std::vector<PathInfo> statPaths(const std::vector<std::string>& paths);
     
     // Get device info from lockdown
     std::string getDeviceValue(const std::string& key) const;
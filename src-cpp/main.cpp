@@ -1,20 +1,19 @@
 #include "device_handler.h"
 #include "photo_db.h"
 #include "photo_sync.h"
+#include "session_manager.h"
+#include "device_probe.h"
+#include "simulated_handler.h"
+#include "hotplug_monitor.h"
 #include "utils.h"
 #include <iostream>
 #include <iomanip>
 #include <ctime>
 #include <cstring>
+#include <csignal>
 #include <memory>
-
-#ifdef ENABLE_ANDROID
-    #ifdef USE_WPD
-        #include "wpd_handler.h"
-    #else
-        #include "mtp_handler.h"
-    #endif
-#endif
+#include <set>
+#include <map>
 
 #ifdef ENABLE_IOS
 #include "ios_handler.h"
@@ -167,13 +166,36 @@ void printMediaInfo(const vector<MediaInfo>& photos) {
     }
 }
 
+void printPlan(const SyncPlan& plan) {
+    cout << "\n=== Sync Plan ===" << endl;
+    for (const auto& file : plan.files) {
+        if (file.action == PlannedFile::Action::SKIP) {
+            continue;
+        }
+        cout << "  " << left << setw(7) << SyncPlanner::getActionName(file.action) << right
+             << setw(10) << fixed << setprecision(1) << (file.bytes_to_read / 1024.0) << " KB  "
+             << file.media.path << " -> " << file.local_path << endl;
+    }
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    if (plan.skip_count > 0) {
+        cout << "  (" << plan.skip_count << " files already in the library are skipped)" << endl;
+    }
+}
+
 void printUsage(const char* program_name) {
     cout << "Usage: " << program_name << " [OPTIONS]" << endl;
     cout << "\nOptions:" << endl;
     cout << "  -d, --destination PATH    Destination folder for photos" << endl;
-    cout << "  -t, --device-type TYPE    Device type: android, ios, or auto" << endl;
+    cout << "  -t, --device-type TYPE    Device type: android, ios, auto, or sim[:DIR][,key=value...]" << endl;
     cout << "  -a, --all                 Transfer all photos (not just new ones)" << endl;
     cout << "  -l, --list-only           Only list photos, don't transfer" << endl;
+    cout << "  --dry-run                 Show what a sync would copy, and how long it would take" << endl;
+    cout << "  --order ORDER             Transfer order: device, newest, smallest, or folder" << endl;
+    cout << "  --include PATH            Only walk this device folder (repeatable)" << endl;
+    cout << "  --exclude PATH            Never walk this device folder (repeatable)" << endl;
+    cout << "  --all-devices             Sync every connected phone at once" << endl;
+    cout << "  --daemon                  Keep running and sync phones as they are plugged in" << endl;
     cout << "  --no-interactive          Skip interactive prompts, use saved config" << endl;
     cout << "  --reset-config            Reset configuration to defaults" << endl;
     cout << "  -h, --help                Show this help message" << endl;
@@ -183,52 +205,242 @@ void printUsage(const char* program_name) {
     cout << "  " << program_name << " -d ~/Desktop/Photos          # Transfer to custom location" << endl;
     cout << "  " << program_name << " -t android                   # Force Android/MTP mode" << endl;
     cout << "  " << program_name << " -t ios                       # Force iOS mode" << endl;
+    cout << "  " << program_name << " -t sim:files=5000,bandwidth=30 # Simulated phone, no hardware" << endl;
     cout << "  " << program_name << " -a                           # Transfer all photos" << endl;
     cout << "  " << program_name << " -l                           # Just list photos, don't transfer" << endl;
+    cout << "  " << program_name << " --dry-run --order newest      # Preview a newest-first sync" << endl;
+    cout << "  " << program_name << " --include DCIM --exclude .hidden # Restrict the device walk" << endl;
+    cout << "  " << program_name << " --all-devices --no-interactive # Intake station: every phone" << endl;
+    cout << "  " << program_name << " --daemon --no-interactive     # Sync each phone on plug-in" << endl;
 }
 
-// Create device handler based on type
-unique_ptr<DeviceHandler> createDeviceHandler(const string& device_type) {
-#ifdef ENABLE_ANDROID
-    if (device_type == "android") {
-    #ifdef USE_WPD
-        return make_unique<WPDHandler>();
-    #else
-        return make_unique<MTPHandler>();
-    #endif
+// Opens the transfer database kept in the destination folder
+bool openLibrary(const string& destination, PhotoDB& db) {
+    string dest_folder = Utils::expandPath(destination);
+    if (!Utils::createDirectory(dest_folder)) {
+        cerr << "ERROR: Failed to create destination directory: " << dest_folder << endl;
+        return false;
     }
-#endif
+    
+    string db_path = dest_folder + "/.photo_transfer.db";
+    if (!db.open(db_path) || !db.initialize()) {
+        cerr << "ERROR: Failed to open database: " << db.getLastError() << endl;
+        return false;
+    }
+    return true;
+}
 
-#ifdef ENABLE_IOS
-    if (device_type == "ios") {
-        return make_unique<iOSHandler>();
+// Prints the outcome of each device and returns the number of failed files
+int printDeviceResults(const vector<SessionManager::DeviceResult>& results) {
+    int failed = 0;
+    for (const auto& result : results) {
+        cout << result.device_name << " (" << result.serial << ")" << endl;
+        cout << "  Total media on device: " << result.total_photos << endl;
+        cout << "  New media transferred: " << result.new_photos << endl;
+        cout << "  Skipped (already exist): " << result.skipped_photos << endl;
+        cout << "  Failed: " << result.failed_photos << endl;
+        cout << "  Total size transferred: " << (result.transferred_size / (1024.0 * 1024.0)) << " MB" << endl;
+        failed += result.failed_photos;
     }
-#endif
+    return failed;
+}
 
-    // Auto-detect: try Android first, then iOS
-    if (device_type == "auto" || device_type.empty()) {
-#ifdef ENABLE_ANDROID
-    #ifdef USE_WPD
-        auto handler = make_unique<WPDHandler>();
-    #else
-        auto handler = make_unique<MTPHandler>();
-    #endif
-        if (handler->detectDevices()) {
-            cout << "Auto-detected Android device" << endl;
-            return handler;
-        }
-#endif
+// Sync every connected Android and iOS device concurrently
+int syncAllDevices(const Config& config, const string& destination,
+                   const PathFilter& path_filter, bool transfer_all) {
+    PhotoDB db;
+    if (!openLibrary(destination, db)) {
+        return 1;
+    }
+    
+    SessionManager sessions(&db, destination);
+    sessions.setPathFilter(path_filter);
+    sessions.setAfcConnections(config.getAfcConnections());
+    
+    cout << "Opening all connected devices..." << endl;
+    if (sessions.connectAll() == 0) {
+        cerr << "ERROR: No devices could be opened" << endl;
+        return 1;
+    }
+    cout << "✓ " << sessions.getSessionCount() << " devices connected" << endl;
+    
+    auto results = sessions.syncAll(!transfer_all);
+    
+    cout << "\n=== Final Summary ===" << endl;
+    int failed = printDeviceResults(results);
+    cout << "Database now contains: " << db.getPhotoCount() << " photos" << endl;
+    
+    sessions.disconnectAll(true);
+    cout << "\n✓ Photo transfer completed" << (failed > 0 ? " with failures" : " successfully") << "!" << endl;
+    return 0;
+}
 
-#ifdef ENABLE_IOS
-        auto ios = make_unique<iOSHandler>();
-        if (ios->detectDevices()) {
-            cout << "Auto-detected iOS device" << endl;
-            return ios;
+// Daemon timing: plug-in events arrive in bursts while a phone enumerates,
+// and a phone is often not ready when it appears (locked, not yet trusted,
+// still in charging mode), so it is looked for again a few times
+static const int HOTPLUG_SETTLE_MS = 1000;
+static const int HOTPLUG_RETRY_MS = 3000;
+static const int HOTPLUG_RETRIES = 10;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void requestStop(int signal_number) {
+    if (stop_requested) {
+        // Second Ctrl+C: don't wait for the running sync
+        signal(signal_number, SIG_DFL);
+        raise(signal_number);
+    }
+    stop_requested = 1;
+}
+
+// Syncs phones as they are plugged in until interrupted. Phones attached at
+// startup are synced right away; between plug-ins the process sleeps on
+// the hot-plug monitor.
+int runDaemon(const Config& config, const string& destination,
+              const PathFilter& path_filter, bool transfer_all) {
+    PhotoDB db;
+    if (!openLibrary(destination, db)) {
+        return 1;
+    }
+    
+    HotplugMonitor monitor;
+    if (!monitor.start()) {
+        cerr << "ERROR: " << monitor.getLastError() << endl;
+        return 1;
+    }
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    
+    cout << "Watching for devices (Ctrl+C to stop)..." << endl;
+    
+    // Serials synced since their USB device was plugged in, keyed by its
+    // sysfs path. Phones attached at startup, or plugged in while events
+    // were dropped, are kept under "".
+    map<string, set<string>> synced;
+    set<string> plugged; // Device paths added since the last scan
+    bool scan = true;
+    int retries = 0;
+    
+    auto note = [&synced, &plugged](HotplugMonitor::Event event, const string& path) {
+        if (event == HotplugMonitor::Event::ADDED) {
+            plugged.insert(path);
+        } else if (event == HotplugMonitor::Event::REMOVED) {
+            // The phones of a device that left sync again when it returns.
+            // Which device the unkeyed ones were on is unknown.
+            synced.erase(path);
+            synced.erase("");
+            plugged.erase(path);
+        }
+    };
+    
+    while (!stop_requested) {
+        if (scan) {
+            string path;
+            HotplugMonitor::Event event;
+            while (!stop_requested &&
+                   (event = monitor.wait(HOTPLUG_SETTLE_MS, &path)) != HotplugMonitor::Event::NONE) {
+                note(event, path);
+            }
+            if (stop_requested) {
+                break;
+            }
+            
+            SessionManager sessions(&db, destination);
+            sessions.setPathFilter(path_filter);
+            sessions.setAfcConnections(config.getAfcConnections());
+            sessions.connectAll();
+            
+            // A scan with only synced phones found the new one not ready yet
+            set<string> known;
+            for (const auto& entry : synced) {
+                known.insert(entry.second.begin(), entry.second.end());
+            }
+            vector<string> found;
+            for (const auto& serial : sessions.getSerialNumbers()) {
+                if (known.count(serial) == 0) {
+                    found.push_back(serial);
+                }
+            }
+            
+            if (!found.empty()) {
+                cout << "\n[" << Utils::formatDate(time(nullptr)) << "] Syncing "
+                     << sessions.getSessionCount() << " device(s)..." << endl;
+                printDeviceResults(sessions.syncAll(!transfer_all));
+                
+                // Credited to the devices plugged in since the last scan
+                if (plugged.empty()) {
+                    plugged.insert("");
+                }
+                for (const auto& device : plugged) {
+                    synced[device].insert(found.begin(), found.end());
+                }
+                plugged.clear();
+                cout << "[" << Utils::formatDate(time(nullptr)) << "] Done, library has "
+                     << db.getPhotoCount() << " photos. Watching for devices..." << endl;
+            }
+            sessions.disconnectAll(true);
+            
+            if (found.empty() && retries > 0) {
+                retries--;
+                event = monitor.wait(HOTPLUG_RETRY_MS, &path);
+                note(event, path);
+                continue;
+            }
+            scan = false;
+        }
+        
+        string path;
+        HotplugMonitor::Event event = monitor.wait(-1, &path);
+        note(event, path);
+        if (event == HotplugMonitor::Event::ADDED) {
+            scan = true;
+            retries = HOTPLUG_RETRIES;
         }
-#endif
     }
     
-    return nullptr;
+    cout << "\nStopped watching for devices." << endl;
+    return 0;
+}
+
+// Detects devices of the given type and returns the handler of the one to
+// use, with detection done. In auto mode every backend is probed at once.
+unique_ptr<DeviceHandler> detectDevice(const string& device_type, string& device_name, string& error) {
+    if (SimulatedHandler::isSpec(device_type)) {
+        SimulatedHandler::Options options;
+        if (!SimulatedHandler::Options::parse(device_type, options, error)) {
+            return nullptr;
+        }
+        auto handler = make_unique<SimulatedHandler>(options);
+        if (!handler->detectDevices()) {
+            error = handler->getLastError();
+            return nullptr;
+        }
+        return handler;
+    }
+
+    DeviceProbe probe;
+    if (!probe.probe(device_type)) {
+        error = probe.getLastError();
+        return nullptr;
+    }
+
+    // Android first, then iOS, as before probing was concurrent
+    const auto& candidates = probe.getCandidates();
+    if (candidates.size() > 1) {
+        cout << "Found " << candidates.size() << " devices:" << endl;
+        for (const auto& candidate : candidates) {
+            cout << "  " << DeviceHandler::getDeviceTypeName(candidate.type)
+                 << (candidate.name.empty() ? "" : ": " + candidate.name) << endl;
+        }
+        cout << "Using the first one; --all-devices syncs every device" << endl;
+    }
+
+    const DeviceCandidate& chosen = candidates.front();
+    if (device_type == "auto" || device_type.empty()) {
+        cout << "Auto-detected " << DeviceHandler::getDeviceTypeName(chosen.type) << " device" << endl;
+    }
+    device_name = chosen.name;
+    return probe.takeHandler(chosen.type);
 }
 
 // Check which device backends are available
@@ -243,6 +455,7 @@ void printAvailableBackends() {
 #if !defined(ENABLE_ANDROID) && !defined(ENABLE_IOS)
     cout << "  (No device backends available - install libmtp-dev or libimobiledevice-dev)" << endl;
 #endif
+    cout << "  - sim (simulated phone serving a folder or synthetic media)" << endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -256,6 +469,11 @@ int main(int argc, char* argv[]) {
     bool list_only = false;
     bool interactive = true;
     bool reset_config = false;
+    bool all_devices = false;
+    bool daemon_mode = false;
+    bool dry_run = false;
+    SyncPlanner::Order order = SyncPlanner::Order::DEVICE;
+    PathFilter path_filter = PathFilter::defaults();
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -273,8 +491,16 @@ int main(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--device-type") == 0) {
             if (i + 1 < argc) {
                 device_type = argv[++i];
-                if (device_type != "android" && device_type != "ios" && device_type != "auto") {
-                    cerr << "Error: device type must be 'android', 'ios', or 'auto'" << endl;
+                if (device_type != "android" && device_type != "ios" && device_type != "auto" &&
+                    !SimulatedHandler::isSpec(device_type)) {
+                    cerr << "Error: device type must be 'android', 'ios', 'auto', or 'sim'" << endl;
+                    return 1;
+                }
+                SimulatedHandler::Options sim_options;
+                string sim_error;
+                if (SimulatedHandler::isSpec(device_type) &&
+                    !SimulatedHandler::Options::parse(device_type, sim_options, sim_error)) {
+                    cerr << "Error: " << sim_error << endl;
                     return 1;
                 }
                 interactive = false; // Skip device type prompt
@@ -288,6 +514,32 @@ int main(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--list-only") == 0) {
             list_only = true;
             interactive = false;
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dry_run = true;
+            interactive = false;
+        } else if (strcmp(argv[i], "--order") == 0) {
+            if (i + 1 < argc && SyncPlanner::parseOrder(argv[i + 1], order)) {
+                i++;
+            } else {
+                cerr << "Error: --order must be 'device', 'newest', 'smallest', or 'folder'" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--include") == 0 || strcmp(argv[i], "--exclude") == 0) {
+            if (i + 1 < argc) {
+                if (strcmp(argv[i], "--include") == 0) {
+                    path_filter.addInclude(argv[i + 1]);
+                } else {
+                    path_filter.addExclude(argv[i + 1]);
+                }
+                i++;
+            } else {
+                cerr << "Error: " << argv[i] << " requires a path argument" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--all-devices") == 0) {
+            all_devices = true;
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            daemon_mode = true;
         } else if (strcmp(argv[i], "--no-interactive") == 0) {
             interactive = false;
         } else if (strcmp(argv[i], "--reset-config") == 0) {
@@ -338,19 +590,37 @@ int main(int argc, char* argv[]) {
     
     cout << "Destination: " << destination << endl;
     cout << "Device Type: " << (device_type == "auto" ? "Auto-detect" : device_type) << endl;
-    cout << "Mode: " << (list_only ? "List only" : (transfer_all ? "Transfer all photos/videos" : "Transfer new photos/videos")) << "\n" << endl;
+    cout << "Mode: " << (list_only ? "List only" : (transfer_all ? "Transfer all photos/videos" : "Transfer new photos/videos"))
+         << (dry_run ? " (dry run)" : "") << "\n" << endl;
 
-    // Create device handler
-    unique_ptr<DeviceHandler> handler = createDeviceHandler(device_type);
-    if (!handler) {
-        cerr << "ERROR: Invalid device type or device handler not available" << endl;
+    if (dry_run && (daemon_mode || all_devices || list_only)) {
+        cerr << "ERROR: --dry-run only applies to a single-device sync" << endl;
         return 1;
     }
 
+    if (daemon_mode) {
+        if (list_only) {
+            cerr << "ERROR: --daemon cannot be combined with --list-only" << endl;
+            return 1;
+        }
+        return runDaemon(config, destination, path_filter, transfer_all);
+    }
+
+    if (all_devices) {
+        if (list_only) {
+            cerr << "ERROR: --all-devices cannot be combined with --list-only" << endl;
+            return 1;
+        }
+        return syncAllDevices(config, destination, path_filter, transfer_all);
+    }
+
     // Step 1: Detect devices
     cout << "Step 1: Detecting devices..." << endl;
-    if (!handler->detectDevices()) {
-        cerr << "ERROR: " << handler->getLastError() << endl;
+    string device_name;
+    string detect_error;
+    unique_ptr<DeviceHandler> handler = detectDevice(device_type, device_name, detect_error);
+    if (!handler) {
+        cerr << "ERROR: " << detect_error << endl;
         cerr << "\nTroubleshooting:" << endl;
         cerr << "1. Make sure your phone is connected via USB" << endl;
         cerr << "2. Unlock your phone" << endl;
@@ -359,11 +629,17 @@ int main(int argc, char* argv[]) {
         cerr << "5. Make sure you have proper USB permissions" << endl;
         return 1;
     }
+    handler->setPathFilter(path_filter);
+#ifdef ENABLE_IOS
+    if (auto* ios = dynamic_cast<iOSHandler*>(handler.get())) {
+        ios->setConnectionPoolSize(config.getAfcConnections());
+    }
+#endif
     cout << "✓ Devices detected!" << endl;
 
     // Step 2: Connect to device
     cout << "\nStep 2: Connecting to device..." << endl;
-    if (!handler->connectToDevice()) {
+    if (!handler->connectToDevice(device_name)) {
         cerr << "ERROR: " << handler->getLastError() << endl;
         return 1;
     }
@@ -383,7 +659,24 @@ int main(int argc, char* argv[]) {
 
     // Step 5: Enumerate photos and videos
     cout << "\nStep 5: Enumerating photos and videos..." << endl;
+    string dest_folder = Utils::expandPath(destination);
+    string db_path = dest_folder + "/.photo_transfer.db";
+    string serial = handler->getSerialNumber();
+    PhotoDB db;
+    
+    // Reuse the last walk of this device if the destination has one
+    bool cache_open = !serial.empty() && Utils::fileExists(db_path) &&
+                      db.open(db_path) && db.initialize();
+    EnumerationSnapshot snapshot;
+    if (cache_open && db.loadEnumerationSnapshot(serial, snapshot)) {
+        cout << "Using cached listing of " << snapshot.folders.size() << " folders" << endl;
+        handler->setEnumerationSnapshot(snapshot);
+    }
+    
     auto photos = handler->enumerateMedia();
+    if (cache_open) {
+        db.saveEnumerationSnapshot(serial, handler->getEnumerationSnapshot());
+    }
     printMediaInfo(photos);
 
     // Summary
@@ -399,9 +692,18 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    // A dry run plans against whatever library is already there and writes nothing
+    if (dry_run) {
+        PhotoSync sync(handler.get(), &db, destination);
+        SyncPlan plan = sync.planSync(!transfer_all, order);
+        printPlan(plan);
+        handler->disconnect();
+        cout << "\n✓ Dry run completed, nothing was transferred" << endl;
+        return 0;
+    }
+
     // Initialize database
     cout << "\n=== Initializing Database ===" << endl;
-    string dest_folder = Utils::expandPath(destination);
     
     // Create destination directory if it doesn't exist
     if (!Utils::createDirectory(dest_folder)) {
@@ -411,10 +713,7 @@ int main(int argc, char* argv[]) {
     }
     cout << "Destination folder: " << dest_folder << endl;
     
-    string db_path = dest_folder + "/.photo_transfer.db";
-    PhotoDB db;
-    
-    if (!db.open(db_path)) {
+    if (!db.isOpen() && !db.open(db_path)) {
         cerr << "ERROR: Failed to open database: " << db.getLastError() << endl;
         handler->disconnect();
         return 1;
@@ -426,6 +725,10 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    if (!cache_open && !serial.empty()) {
+        db.saveEnumerationSnapshot(serial, handler->getEnumerationSnapshot());
+    }
+    
     cout << "Database: " << db_path << endl;
     cout << "Photos in database: " << db.getPhotoCount() << endl;
     uint64_t total_size = db.getTotalSizeTransferred();
@@ -433,7 +736,7 @@ int main(int argc, char* argv[]) {
 
     // Perform sync
     PhotoSync sync(handler.get(), &db, destination);
-    PhotoSync::SyncResult result = sync.syncPhotos(!transfer_all);
+    PhotoSync::SyncResult result = sync.syncPhotos(!transfer_all, order);
 
     // Final summary
     cout << "\n=== Final Summary ===" << endl;
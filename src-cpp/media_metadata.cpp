@@ -0,0 +1,515 @@
+#include "media_metadata.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using namespace std;
+
+namespace {
+
+// Headers are fetched in blocks of this size so most files need one read;
+// the EXIF thumbnail sits at the end of an APP1 segment of up to 64 KB
+const uint32_t THUMBNAIL_BLOCK_SIZE = 64 * 1024;
+// Capture dates sit near the start of the EXIF block or in the movie header
+const uint32_t DATE_BLOCK_SIZE = 8 * 1024;
+// Larger metadata structures are treated as corrupt rather than fetched
+const uint32_t MAX_METADATA_SIZE = 1024 * 1024;
+
+const uint16_t TIFF_TAG_THUMBNAIL_OFFSET = 0x0201;
+const uint16_t TIFF_TAG_THUMBNAIL_LENGTH = 0x0202;
+const uint16_t TIFF_TAG_EXIF_IFD = 0x8769;
+const uint16_t EXIF_TAG_DATE_TIME_ORIGINAL = 0x9003;
+const uint16_t EXIF_TAG_DATE_TIME_DIGITIZED = 0x9004;
+
+// QuickTime/MP4 times count seconds from 1904-01-01 UTC
+const uint64_t MP4_EPOCH_OFFSET = 2082844800ULL;
+
+uint16_t be16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t be32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+uint64_t be64(const uint8_t* p) {
+    return (static_cast<uint64_t>(be32(p)) << 32) | be32(p + 4);
+}
+
+constexpr uint32_t fourcc(const char (&s)[5]) {
+    return (static_cast<uint32_t>(static_cast<uint8_t>(s[0])) << 24) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(s[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(s[2])) << 8) |
+           static_cast<uint32_t>(static_cast<uint8_t>(s[3]));
+}
+
+// Big-endian field of 0, 4 or 8 bytes as used by the HEIF iloc box
+uint64_t beSized(const uint8_t* p, int size) {
+    switch (size) {
+        case 4: return be32(p);
+        case 8: return be64(p);
+        default: return 0;
+    }
+}
+
+/**
+ * Keeps one window of the file in memory and refills it from the device
+ * whenever a parser asks for bytes outside of it.
+ */
+class ByteWindow {
+public:
+    ByteWindow(const MediaMetadata::RangeReader& read, uint32_t block_size)
+        : read_(read), block_size_(block_size) {}
+
+    // Returns [offset, offset + length) or nullptr past end of file.
+    // The pointer is valid until the next fetch().
+    const uint8_t* fetch(uint64_t offset, uint32_t length) {
+        if (offset < base_ || offset + length > base_ + data_.size()) {
+            if (length > MAX_METADATA_SIZE) {
+                return nullptr;
+            }
+            if (!read_(offset, max(length, block_size_), data_)) {
+                data_.clear();
+                return nullptr;
+            }
+            base_ = offset;
+            if (data_.size() < length) {
+                return nullptr;
+            }
+        }
+        return data_.data() + (offset - base_);
+    }
+
+private:
+    const MediaMetadata::RangeReader& read_;
+    uint32_t block_size_;
+    uint64_t base_ = 0;
+    vector<uint8_t> data_;
+};
+
+/**
+ * Read access to a TIFF structure (the payload of an EXIF block) in the
+ * byte order it declares. Offsets are relative to the TIFF header.
+ */
+class TiffReader {
+public:
+    bool init(const vector<uint8_t>& tiff) {
+        tiff_ = &tiff;
+        if (tiff.size() < 8) return false;
+        if (tiff[0] == 'I' && tiff[1] == 'I') {
+            little_endian_ = true;
+        } else if (tiff[0] == 'M' && tiff[1] == 'M') {
+            little_endian_ = false;
+        } else {
+            return false;
+        }
+        return u16(2) == 42;
+    }
+
+    size_t size() const { return tiff_->size(); }
+    const uint8_t* data() const { return tiff_->data(); }
+
+    uint16_t u16(size_t offset) const {
+        const uint8_t* p = data() + offset;
+        return little_endian_ ? static_cast<uint16_t>(p[0] | (p[1] << 8)) : be16(p);
+    }
+
+    uint32_t u32(size_t offset) const {
+        const uint8_t* p = data() + offset;
+        if (!little_endian_) return be32(p);
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    uint32_t firstIfd() const { return u32(4); }
+
+    // Offset of the IFD chained after this one, 0 at the end of the chain
+    uint32_t nextIfd(uint32_t ifd) const {
+        size_t entries_end = 0;
+        if (!entriesEnd(ifd, entries_end) || entries_end + 4 > size()) return 0;
+        return u32(entries_end);
+    }
+
+    // Value of a SHORT or LONG tag, or the offset of a larger value
+    bool findTag(uint32_t ifd, uint16_t tag, uint32_t& value) const {
+        size_t entries_end = 0;
+        if (!entriesEnd(ifd, entries_end)) return false;
+
+        for (size_t entry = ifd + 2; entry < entries_end; entry += 12) {
+            if (u16(entry) != tag) continue;
+            // SHORT values sit left-aligned in the 4-byte field
+            value = u16(entry + 2) == 3 ? u16(entry + 8) : u32(entry + 8);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    bool entriesEnd(uint32_t ifd, size_t& end) const {
+        if (ifd == 0 || static_cast<size_t>(ifd) + 2 > size()) return false;
+        end = static_cast<size_t>(ifd) + 2 + static_cast<size_t>(u16(ifd)) * 12;
+        return end <= size();
+    }
+
+    const vector<uint8_t>* tiff_ = nullptr;
+    bool little_endian_ = false;
+};
+
+// Copies up to max_size bytes of the TIFF payload of the JPEG APP1 Exif
+// segment. Tags past a truncated payload simply fail to resolve.
+bool findJpegExif(ByteWindow& window, uint32_t max_size, vector<uint8_t>& tiff) {
+    uint64_t pos = 2; // Past SOI
+
+    while (true) {
+        const uint8_t* marker = window.fetch(pos, 4);
+        if (!marker || marker[0] != 0xFF) return false;
+        if (marker[1] == 0xFF) {
+            pos++; // Fill byte
+            continue;
+        }
+        // Metadata segments all precede the scan data
+        if (marker[1] == 0xDA || marker[1] == 0xD9) return false;
+
+        uint16_t length = be16(marker + 2);
+        if (length < 2) return false;
+
+        if (marker[1] == 0xE1 && length > 8) {
+            uint32_t size = min<uint32_t>(length - 2, max_size + 6);
+            const uint8_t* segment = window.fetch(pos + 4, size);
+            if (!segment) return false;
+            if (memcmp(segment, "Exif\0\0", 6) == 0) {
+                tiff.assign(segment + 6, segment + size);
+                return true;
+            }
+        }
+        pos += 2 + length;
+    }
+}
+
+struct Box {
+    uint32_t type;
+    size_t body;  // Offset of the payload
+    size_t end;   // Offset just past the box
+};
+
+// Parses the box header at pos within data[0, limit)
+bool readBox(const uint8_t* data, size_t pos, size_t limit, Box& box) {
+    if (pos + 8 > limit) return false;
+
+    uint64_t size = be32(data + pos);
+    box.type = be32(data + pos + 4);
+    box.body = pos + 8;
+    if (size == 1) {
+        if (pos + 16 > limit) return false;
+        size = be64(data + pos + 8);
+        box.body = pos + 16;
+    } else if (size == 0) {
+        size = limit - pos; // Extends to the end of the container
+    }
+
+    if (size < box.body - pos || size > limit - pos) return false;
+    box.end = pos + static_cast<size_t>(size);
+    return true;
+}
+
+// Finds the item id of the Exif item declared in an iinf box
+bool findExifItem(const uint8_t* data, const Box& iinf, uint32_t& item_id) {
+    if (iinf.body + 4 > iinf.end) return false;
+    size_t pos = iinf.body + 4 + (data[iinf.body] == 0 ? 2 : 4);
+
+    Box infe;
+    while (readBox(data, pos, iinf.end, infe)) {
+        pos = infe.end;
+        if (infe.type != fourcc("infe") || infe.body + 4 > infe.end) continue;
+
+        // Versions 0 and 1 predate item types
+        uint8_t version = data[infe.body];
+        size_t field = infe.body + 4;
+        if (version < 2) continue;
+
+        size_t id_size = version == 2 ? 2 : 4;
+        if (field + id_size + 6 > infe.end) continue;
+        uint32_t id = id_size == 2 ? be16(data + field) : be32(data + field);
+        field += id_size + 2; // Skip item_protection_index
+
+        if (be32(data + field) == fourcc("Exif")) {
+            item_id = id;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Resolves an item to its first extent in the file through the iloc box
+bool locateItem(const uint8_t* data, const Box& iloc, uint32_t item_id,
+                uint64_t& offset, uint64_t& length) {
+    size_t pos = iloc.body;
+    if (pos + 8 > iloc.end) return false;
+
+    uint8_t version = data[pos];
+    int offset_size = data[pos + 4] >> 4;
+    int length_size = data[pos + 4] & 0x0F;
+    int base_offset_size = data[pos + 5] >> 4;
+    int index_size = version > 0 ? (data[pos + 5] & 0x0F) : 0;
+    pos += 6;
+
+    uint32_t item_count = 0;
+    if (version < 2) {
+        item_count = be16(data + pos);
+        pos += 2;
+    } else {
+        item_count = be32(data + pos);
+        pos += 4;
+    }
+
+    for (uint32_t i = 0; i < item_count; i++) {
+        size_t id_size = version < 2 ? 2 : 4;
+        size_t header = id_size + (version > 0 ? 2 : 0) + 2 + base_offset_size + 2;
+        if (pos + header > iloc.end) return false;
+
+        uint32_t id = id_size == 2 ? be16(data + pos) : be32(data + pos);
+        pos += id_size;
+        uint16_t construction_method = 0;
+        if (version > 0) {
+            construction_method = be16(data + pos) & 0x0F;
+            pos += 2;
+        }
+        uint16_t data_reference_index = be16(data + pos);
+        pos += 2;
+        uint64_t base_offset = beSized(data + pos, base_offset_size);
+        pos += base_offset_size;
+        uint16_t extent_count = be16(data + pos);
+        pos += 2;
+
+        size_t extent_size = index_size + offset_size + length_size;
+        if (pos + extent_size * extent_count > iloc.end) return false;
+
+        if (id == item_id) {
+            // Only items stored as plain byte ranges of this file
+            if (construction_method != 0 || data_reference_index != 0 || extent_count == 0) {
+                return false;
+            }
+            pos += index_size;
+            offset = base_offset + beSized(data + pos, offset_size);
+            length = beSized(data + pos + offset_size, length_size);
+            return length > 0;
+        }
+        pos += extent_size * extent_count;
+    }
+    return false;
+}
+
+// Finds a top-level box of an ISO base media file (HEIF, MP4, QuickTime)
+bool findTopLevelBox(ByteWindow& window, uint32_t type, uint64_t& offset, uint64_t& size) {
+    uint64_t pos = 0;
+    for (int boxes = 0; boxes < 16; boxes++) {
+        const uint8_t* header = window.fetch(pos, 16);
+        if (!header) return false;
+
+        uint64_t box_size = be32(header);
+        uint32_t box_type = be32(header + 4);
+        if (box_size == 1) box_size = be64(header + 8);
+        // A box running to end of file (size 0) is the last one
+        if (box_size < 8) return false;
+        if (boxes == 0 && box_type != fourcc("ftyp")) return false;
+
+        if (box_type == type) {
+            offset = pos;
+            size = box_size;
+            return true;
+        }
+        pos += box_size;
+    }
+    return false;
+}
+
+// Copies up to max_size bytes of the TIFF payload of the Exif item of a
+// HEIF/HEIC file
+bool findHeifExif(ByteWindow& window, uint32_t max_size, vector<uint8_t>& tiff) {
+    uint64_t meta_offset = 0;
+    uint64_t meta_size = 0;
+    if (!findTopLevelBox(window, fourcc("meta"), meta_offset, meta_size) ||
+        meta_size > MAX_METADATA_SIZE) {
+        return false;
+    }
+
+    const uint8_t* body = window.fetch(meta_offset, static_cast<uint32_t>(meta_size));
+    if (!body) return false;
+    vector<uint8_t> meta(body, body + meta_size);
+
+    // meta is a full box: skip its header plus version and flags
+    Box meta_box;
+    if (!readBox(meta.data(), 0, meta.size(), meta_box)) return false;
+
+    Box iinf = {};
+    Box iloc = {};
+    Box child;
+    for (size_t child_pos = meta_box.body + 4;
+         readBox(meta.data(), child_pos, meta_box.end, child); child_pos = child.end) {
+        if (child.type == fourcc("iinf")) iinf = child;
+        else if (child.type == fourcc("iloc")) iloc = child;
+    }
+    if (iinf.type == 0 || iloc.type == 0) return false;
+
+    uint32_t item_id = 0;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    if (!findExifItem(meta.data(), iinf, item_id) ||
+        !locateItem(meta.data(), iloc, item_id, offset, length) || length < 4) {
+        return false;
+    }
+
+    // The item starts with the offset of the TIFF header past its own prefix
+    const uint8_t* prefix = window.fetch(offset, 4);
+    if (!prefix) return false;
+    uint64_t tiff_start = 4 + static_cast<uint64_t>(be32(prefix));
+    if (tiff_start >= length) return false;
+
+    uint32_t size = static_cast<uint32_t>(min<uint64_t>(length - tiff_start, max_size));
+    const uint8_t* item = window.fetch(offset + tiff_start, size);
+    if (!item) return false;
+    tiff.assign(item, item + size);
+    return true;
+}
+
+bool isJpeg(const uint8_t* magic) {
+    return magic[0] == 0xFF && magic[1] == 0xD8;
+}
+
+bool isIsoMedia(const uint8_t* magic) {
+    return memcmp(magic + 4, "ftyp", 4) == 0;
+}
+
+// Locates the EXIF TIFF block of a JPEG or HEIF file
+bool findExif(ByteWindow& window, uint32_t max_size, vector<uint8_t>& tiff) {
+    const uint8_t* magic = window.fetch(0, 12);
+    if (!magic) return false;
+
+    if (isJpeg(magic)) {
+        return findJpegExif(window, max_size, tiff);
+    }
+    if (isIsoMedia(magic)) {
+        return findHeifExif(window, max_size, tiff);
+    }
+    return false;
+}
+
+// Parses an EXIF "YYYY:MM:DD HH:MM:SS" local time stored at offset
+bool parseExifDate(const TiffReader& tiff, uint32_t offset, uint64_t& timestamp) {
+    const size_t length = 19;
+    if (offset > tiff.size() || tiff.size() - offset < length) return false;
+
+    const char* text = reinterpret_cast<const char*>(tiff.data() + offset);
+    struct tm time = {};
+    int fields = sscanf(string(text, length).c_str(), "%4d:%2d:%2d %2d:%2d:%2d",
+                        &time.tm_year, &time.tm_mon, &time.tm_mday,
+                        &time.tm_hour, &time.tm_min, &time.tm_sec);
+    // Cameras without a clock write zeros or blanks
+    if (fields != 6 || time.tm_year < 1900 || time.tm_mon < 1 || time.tm_mday < 1) {
+        return false;
+    }
+
+    time.tm_year -= 1900;
+    time.tm_mon -= 1;
+    time.tm_isdst = -1;
+    time_t local = mktime(&time);
+    if (local <= 0) return false;
+
+    timestamp = static_cast<uint64_t>(local);
+    return true;
+}
+
+bool exifCaptureDate(const TiffReader& tiff, uint64_t& timestamp) {
+    uint32_t exif_ifd = 0;
+    uint32_t offset = 0;
+    if (!tiff.findTag(tiff.firstIfd(), TIFF_TAG_EXIF_IFD, exif_ifd)) {
+        return false;
+    }
+
+    return (tiff.findTag(exif_ifd, EXIF_TAG_DATE_TIME_ORIGINAL, offset) &&
+            parseExifDate(tiff, offset, timestamp)) ||
+           (tiff.findTag(exif_ifd, EXIF_TAG_DATE_TIME_DIGITIZED, offset) &&
+            parseExifDate(tiff, offset, timestamp));
+}
+
+// Creation time from the mvhd box of a QuickTime/MP4 movie
+bool movieCaptureDate(ByteWindow& window, uint64_t& timestamp) {
+    uint64_t moov_offset = 0;
+    uint64_t moov_size = 0;
+    if (!findTopLevelBox(window, fourcc("moov"), moov_offset, moov_size)) {
+        return false;
+    }
+
+    // mvhd is normally the first child of moov
+    uint64_t pos = moov_offset + 8;
+    uint64_t end = moov_offset + moov_size;
+    while (pos + 8 <= end) {
+        const uint8_t* header = window.fetch(pos, 8);
+        if (!header) return false;
+
+        uint64_t size = be32(header);
+        if (size < 8) return false;
+
+        if (be32(header + 4) == fourcc("mvhd")) {
+            const uint8_t* body = window.fetch(pos + 8, 12);
+            if (!body) return false;
+            // Version 1 widens the times to 64 bits
+            uint64_t created = body[0] == 1 ? be64(body + 4) : be32(body + 4);
+            if (created <= MP4_EPOCH_OFFSET) return false;
+            timestamp = created - MP4_EPOCH_OFFSET;
+            return true;
+        }
+        pos += size;
+    }
+    return false;
+}
+
+} // namespace
+
+bool MediaMetadata::readEmbeddedThumbnail(const RangeReader& read, vector<uint8_t>& thumbnail) {
+    thumbnail.clear();
+
+    ByteWindow window(read, THUMBNAIL_BLOCK_SIZE);
+    vector<uint8_t> exif;
+    TiffReader tiff;
+    if (!findExif(window, MAX_METADATA_SIZE, exif) || !tiff.init(exif)) {
+        return false;
+    }
+
+    // IFD1 describes the thumbnail image
+    uint32_t ifd1 = tiff.nextIfd(tiff.firstIfd());
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    if (!tiff.findTag(ifd1, TIFF_TAG_THUMBNAIL_OFFSET, offset) ||
+        !tiff.findTag(ifd1, TIFF_TAG_THUMBNAIL_LENGTH, length) ||
+        length < 4 || offset > tiff.size() || length > tiff.size() - offset) {
+        return false;
+    }
+
+    const uint8_t* start = tiff.data() + offset;
+    if (start[0] != 0xFF || start[1] != 0xD8) {
+        return false;
+    }
+
+    thumbnail.assign(start, start + length);
+    return true;
+}
+
+bool MediaMetadata::readCaptureDate(const RangeReader& read, uint64_t& timestamp) {
+    timestamp = 0;
+
+    ByteWindow window(read, DATE_BLOCK_SIZE);
+    const uint8_t* magic = window.fetch(0, 12);
+    if (!magic) return false;
+    bool iso_media = isIsoMedia(magic);
+
+    vector<uint8_t> exif;
+    TiffReader tiff;
+    if (findExif(window, DATE_BLOCK_SIZE, exif) && tiff.init(exif) &&
+        exifCaptureDate(tiff, timestamp)) {
+        return true;
+    }
+
+    return iso_media && movieCaptureDate(window, timestamp);
+}
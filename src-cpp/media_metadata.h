@@ -0,0 +1,30 @@
+#ifndef MEDIA_METADATA_H
+#define MEDIA_METADATA_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+/**
+ * Parsers for metadata embedded in media file headers.
+ *
+ * Everything here works through ranged reads, so only the bytes a parser
+ * actually needs cross the USB link instead of the whole file.
+ */
+namespace MediaMetadata {
+    // Reads up to length bytes at offset; data is shorter at end of file
+    using RangeReader = std::function<bool(uint64_t offset, uint32_t length,
+                                           std::vector<uint8_t>& data)>;
+
+    // Extracts the JPEG thumbnail stored in the EXIF block of a JPEG or
+    // HEIF/HEIC file. Returns false when the file carries none.
+    bool readEmbeddedThumbnail(const RangeReader& read, std::vector<uint8_t>& thumbnail);
+    
+    // Capture time as a Unix timestamp, from EXIF DateTimeOriginal (JPEG,
+    // HEIF/HEIC) or the QuickTime/MP4 movie header. Most files need a single
+    // read of a few KB. Returns false when the file carries no date.
+    bool readCaptureDate(const RangeReader& read, uint64_t& timestamp);
+}
+
+#endif // MEDIA_METADATA_H
@@ -0,0 +1,124 @@
+#include "media_types.h"
+#include <array>
+
+namespace MediaTypes {
+
+namespace {
+
+constexpr MediaType TYPES[] = {
+    {"jpg", "image/jpeg", Category::PHOTO},
+    {"jpeg", "image/jpeg", Category::PHOTO},
+    {"png", "image/png", Category::PHOTO},
+    {"gif", "image/gif", Category::PHOTO},
+    {"bmp", "image/bmp", Category::PHOTO},
+    {"webp", "image/webp", Category::PHOTO},
+    {"heic", "image/heic", Category::PHOTO},
+    {"heif", "image/heic", Category::PHOTO},
+    {"dng", "image/x-adobe-dng", Category::PHOTO},
+    {"raw", "image/x-raw", Category::PHOTO},
+    {"cr2", "image/x-canon-cr2", Category::PHOTO},
+    {"nef", "image/x-nikon-nef", Category::PHOTO},
+    {"arw", "image/x-sony-arw", Category::PHOTO},
+    {"mp4", "video/mp4", Category::VIDEO},
+    {"m4v", "video/mp4", Category::VIDEO},
+    {"mov", "video/quicktime", Category::VIDEO},
+    {"avi", "video/x-msvideo", Category::VIDEO},
+    {"mkv", "video/x-matroska", Category::VIDEO},
+    {"3gp", "video/3gpp", Category::VIDEO},
+    {"webm", "video/webm", Category::VIDEO},
+    {"flv", "video/x-flv", Category::VIDEO},
+    {"wmv", "video/x-ms-wmv", Category::VIDEO},
+};
+
+constexpr size_t TYPE_COUNT = sizeof(TYPES) / sizeof(TYPES[0]);
+constexpr size_t MAX_EXTENSION = 4;
+constexpr unsigned HASH_BITS = 6;
+constexpr size_t SLOT_COUNT = size_t(1) << HASH_BITS;
+constexpr uint8_t EMPTY_SLOT = 0xFF;
+
+// Extensions of up to four characters packed into one word
+constexpr uint32_t packExtension(const char* extension) {
+    uint32_t key = 0;
+    for (size_t i = 0; i < MAX_EXTENSION && extension[i] != '\0'; i++) {
+        key |= uint32_t(uint8_t(extension[i])) << (8 * i);
+    }
+    return key;
+}
+
+constexpr size_t slotOf(uint32_t key, uint32_t multiplier) {
+    return (key * multiplier) >> (32 - HASH_BITS);
+}
+
+struct HashTable {
+    uint32_t multiplier = 0;
+    std::array<uint32_t, SLOT_COUNT> keys{};
+    std::array<uint8_t, SLOT_COUNT> types{};
+};
+
+// Tries odd multipliers until every extension lands in its own slot
+constexpr HashTable buildTable() {
+    for (uint32_t multiplier = 0x9E3779B1; multiplier != 0x9E3779B1 + 2 * 4096; multiplier += 2) {
+        HashTable table;
+        table.multiplier = multiplier;
+        for (auto& type : table.types) {
+            type = EMPTY_SLOT;
+        }
+
+        bool collision = false;
+        for (size_t i = 0; i < TYPE_COUNT && !collision; i++) {
+            uint32_t key = packExtension(TYPES[i].extension);
+            size_t slot = slotOf(key, multiplier);
+            collision = table.types[slot] != EMPTY_SLOT;
+            table.keys[slot] = key;
+            table.types[slot] = uint8_t(i);
+        }
+        if (!collision) {
+            return table;
+        }
+    }
+    return HashTable{};
+}
+
+constexpr HashTable TABLE = buildTable();
+static_assert(TABLE.multiplier != 0, "No perfect hash found for the media extensions");
+
+template <typename Char>
+const MediaType* lookup(std::basic_string_view<Char> filename) {
+    size_t dot = filename.rfind(Char('.'));
+    if (dot == std::basic_string_view<Char>::npos) {
+        return nullptr;
+    }
+    size_t length = filename.size() - dot - 1;
+    if (length == 0 || length > MAX_EXTENSION) {
+        return nullptr;
+    }
+
+    uint32_t key = 0;
+    for (size_t i = 0; i < length; i++) {
+        auto c = filename[dot + 1 + i];
+        if (c >= Char('A') && c <= Char('Z')) {
+            c = Char(c - Char('A') + Char('a'));
+        } else if (c <= Char(0) || c > Char(0x7F)) {
+            return nullptr;
+        }
+        key |= uint32_t(c) << (8 * i);
+    }
+
+    size_t slot = slotOf(key, TABLE.multiplier);
+    if (TABLE.types[slot] == EMPTY_SLOT || TABLE.keys[slot] != key) {
+        return nullptr;
+    }
+    return &TYPES[TABLE.types[slot]];
+}
+
+} // namespace
+
+const MediaType* classify(std::string_view filename) {
+    return lookup(filename);
+}
+
+const MediaType* classify(std::wstring_view filename) {
+    return lookup(filename);
+}
+
+} // namespace MediaTypes
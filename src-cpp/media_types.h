@@ -0,0 +1,53 @@
+#ifndef MEDIA_TYPES_H
+#define MEDIA_TYPES_H
+
+#include <string_view>
+#include <cstdint>
+
+/**
+ * Classifies files by extension for every device backend.
+ *
+ * The extensions live in one table hashed at compile time, so a lookup is
+ * a case fold of at most four characters, one multiply and one compare,
+ * with no allocation. Type, MIME type and category come back together.
+ */
+namespace MediaTypes {
+    enum class Category : uint8_t {
+        PHOTO,
+        VIDEO
+    };
+
+    struct MediaType {
+        const char* extension;   // Lowercase, without the dot
+        const char* mime_type;
+        Category category;
+    };
+
+    // Returned for files without a known type
+    constexpr const char* UNKNOWN_MIME_TYPE = "application/octet-stream";
+
+    // Type of a file from its extension; nullptr if it is not photo or video
+    const MediaType* classify(std::string_view filename);
+    const MediaType* classify(std::wstring_view filename);
+
+    inline bool isMediaFile(std::string_view filename) {
+        return classify(filename) != nullptr;
+    }
+
+    inline bool isPhotoFile(std::string_view filename) {
+        const MediaType* type = classify(filename);
+        return type && type->category == Category::PHOTO;
+    }
+
+    inline bool isVideoFile(std::string_view filename) {
+        const MediaType* type = classify(filename);
+        return type && type->category == Category::VIDEO;
+    }
+
+    inline const char* getMimeType(std::string_view filename) {
+        const MediaType* type = classify(filename);
+        return type ? type->mime_type : UNKNOWN_MIME_TYPE;
+    }
+}
+
+#endif // MEDIA_TYPES_H
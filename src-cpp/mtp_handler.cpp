@@ -1,10 +1,16 @@
 #include "mtp_handler.h"
 #include "utils.h"
+#include "media_types.h"
 #include <iostream>
 #include <algorithm>
 #include <cstring>
 #include <sstream>
+#include <fstream>
+#include <chrono>
+#include <thread>
 #include <unistd.h>
+#include <dirent.h>
+#include <climits>
 #include <cstdlib>
 
 using namespace std;
@@ -46,7 +52,209 @@ bool MTPHandler::detectDevices() {
     return true;
 }
 
+// Names a device by its USB location, which stays the same while the phone
+// remains plugged into the same port
+static string rawDeviceName(const LIBMTP_raw_device_t& raw) {
+    return "usb:" + to_string(raw.bus_location) + "," + to_string(raw.devnum);
+}
+
+vector<string> MTPHandler::getDetectedDevices() const {
+    vector<string> names;
+    for (const auto& raw : raw_devices_) {
+        names.push_back(rawDeviceName(raw));
+    }
+    return names;
+}
+
+int MTPHandler::findRawDevice(const string& device_name) const {
+    if (raw_devices_.empty()) {
+        return -1;
+    }
+    if (device_name.empty()) {
+        return 0;
+    }
+    
+    for (size_t i = 0; i < raw_devices_.size(); i++) {
+        if (rawDeviceName(raw_devices_[i]) == device_name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool MTPHandler::hasGvfsMTPMounts() {
+#ifdef __linux__
+    // A mount under the user's GVFS directory
+    string gvfs_dir = "/run/user/" + to_string(getuid()) + "/gvfs";
+    if (DIR* dir = opendir(gvfs_dir.c_str())) {
+        bool found = false;
+        while (dirent* entry = readdir(dir)) {
+            if (strstr(entry->d_name, "mtp") != nullptr) {
+                found = true;
+                break;
+            }
+        }
+        closedir(dir);
+        if (found) {
+            return true;
+        }
+    }
+    
+    // The gvfsd-mtp backend can hold the device without a visible mount
+    DIR* proc = opendir("/proc");
+    if (proc == nullptr) {
+        return true; // Can't tell: let unmountMTPDevices() look
+    }
+    bool found = false;
+    while (dirent* entry = readdir(proc)) {
+        if (!isdigit(static_cast<unsigned char>(entry->d_name[0]))) {
+            continue;
+        }
+        ifstream comm(string("/proc/") + entry->d_name + "/comm");
+        string name;
+        if (getline(comm, name) && name == "gvfsd-mtp") {
+            found = true;
+            break;
+        }
+    }
+    closedir(proc);
+    return found;
+#else
+    return true;
+#endif
+}
+
+#ifdef __linux__
+static const char* USB_SYSFS_DIR = "/sys/bus/usb/devices/";
+
+static long readSysfsNumber(const string& path) {
+    ifstream file(path);
+    long value = -1;
+    file >> value;
+    return file ? value : -1;
+}
+
+// sysfs name of the USB device at a bus address, e.g. "1-4", empty if gone
+static string usbSysfsName(const LIBMTP_raw_device_t& raw) {
+    DIR* dir = opendir(USB_SYSFS_DIR);
+    if (dir == nullptr) {
+        return "";
+    }
+    
+    string found;
+    while (dirent* entry = readdir(dir)) {
+        string name = entry->d_name;
+        // Interfaces ("1-4:1.0") and hubs ("usb1") have no bus address of their own
+        if (name.empty() || !isdigit(static_cast<unsigned char>(name[0])) ||
+            name.find(':') != string::npos) {
+            continue;
+        }
+        string base = USB_SYSFS_DIR + name;
+        if (readSysfsNumber(base + "/busnum") == static_cast<long>(raw.bus_location) &&
+            readSysfsNumber(base + "/devnum") == static_cast<long>(raw.devnum)) {
+            found = name;
+            break;
+        }
+    }
+    closedir(dir);
+    return found;
+}
+#endif
+
+// Whether another program (usually gvfsd-mtp) still has the device open.
+// A userspace claim shows up in sysfs as an interface bound to "usbfs".
+static bool usbInterfaceClaimed(const LIBMTP_raw_device_t& raw) {
+#ifdef __linux__
+    string device = usbSysfsName(raw);
+    if (device.empty()) {
+        return false;
+    }
+    
+    DIR* dir = opendir(USB_SYSFS_DIR);
+    if (dir == nullptr) {
+        return false;
+    }
+    
+    string prefix = device + ":";
+    bool claimed = false;
+    while (dirent* entry = readdir(dir)) {
+        if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) != 0) {
+            continue;
+        }
+        string link = string(USB_SYSFS_DIR) + entry->d_name + "/driver";
+        char target[PATH_MAX];
+        ssize_t length = readlink(link.c_str(), target, sizeof(target) - 1);
+        if (length <= 0) {
+            continue;
+        }
+        target[length] = '\0';
+        const char* driver = strrchr(target, '/');
+        if (strcmp(driver ? driver + 1 : target, "usbfs") == 0) {
+            claimed = true;
+            break;
+        }
+    }
+    closedir(dir);
+    return claimed;
+#else
+    (void)raw;
+    return false;
+#endif
+}
+
+// USB serial string of the device at a bus address, read from sysfs
+// without opening it; empty when it has none or is gone
+static string usbSerial(const LIBMTP_raw_device_t& raw) {
+#ifdef __linux__
+    string device = usbSysfsName(raw);
+    if (device.empty()) {
+        return "";
+    }
+    ifstream file(string(USB_SYSFS_DIR) + device + "/serial");
+    string serial;
+    getline(file, serial);
+    return serial;
+#else
+    (void)raw;
+    return "";
+#endif
+}
+
+// The device among freshly detected ones that was at target before it
+// re-enumerated: same VID/PID and USB serial. Without a serial it must be
+// the only device of its model.
+static int findSameDevice(const vector<LIBMTP_raw_device_t>& devices,
+                          const LIBMTP_raw_device_t& target, const string& serial) {
+    int found = -1;
+    for (size_t i = 0; i < devices.size(); i++) {
+        const LIBMTP_raw_device_t& raw = devices[i];
+        if (raw.device_entry.vendor_id != target.device_entry.vendor_id ||
+            raw.device_entry.product_id != target.device_entry.product_id) {
+            continue;
+        }
+        if (!serial.empty()) {
+            if (usbSerial(raw) == serial) {
+                return static_cast<int>(i);
+            }
+            continue;
+        }
+        if (found >= 0) {
+            return -1; // Two of the same model: cannot tell which
+        }
+        found = static_cast<int>(i);
+    }
+    return found;
+}
+
 bool MTPHandler::unmountMTPDevices() {
+    // Nothing to release: skip spawning gio and friends
+    if (!hasGvfsMTPMounts()) {
+        return false;
+    }
+    return releaseGvfsMounts();
+}
+
+bool MTPHandler::releaseGvfsMounts() {
     bool unmounted_something = false;
     
     cout << "  Attempting to release MTP device from system..." << endl;
@@ -172,15 +380,8 @@ bool MTPHandler::unmountMTPDevices() {
         }
     }
     
-    // Wait for device to be fully released
-    if (unmounted_something) {
-        cout << "  Waiting for device to be released..." << endl;
-        usleep(1500000); // 1.5 seconds
-    } else {
-        usleep(500000); // 0.5 seconds even if nothing unmounted
-    }
-    
-    return true;
+    // Callers wait for the interface itself to be released (see connectToDevice)
+    return unmounted_something;
 }
 
 bool MTPHandler::connectToDevice(const string& device_name, bool auto_unmount) {
@@ -190,70 +391,82 @@ bool MTPHandler::connectToDevice(const string& device_name, bool auto_unmount) {
         }
     }
     
-    // Try to unmount any existing MTP mounts before connecting
-    if (auto_unmount) {
-        cout << "Checking for existing MTP mounts..." << endl;
-        unmountMTPDevices();
-        cout << "Waiting for device to be released..." << endl;
-        usleep(1000000); // Wait 1 second for device to be released
-    }
-
-    // If device_name is specified, try to find matching device
+    // If device_name is specified, connect to the device at that USB location
     // Otherwise, connect to first available device
-    int device_index = 0;
-    
-    if (!device_name.empty()) {
-        // Try to find device by name (we'll need to connect first to get name)
-        // For now, just connect to first device
-        device_index = 0;
+    int device_index = findRawDevice(device_name);
+    if (device_index < 0) {
+        setError("MTP device not found: " + device_name);
+        return false;
     }
 
-    if (device_index >= static_cast<int>(raw_devices_.size())) {
-        setError("Device index out of range");
-        return false;
+    // The bus address changes if the phone re-enumerates, so it is found
+    // again by what it reports about itself, read while the address holds
+    const LIBMTP_raw_device_t target = raw_devices_[device_index];
+    const string usb_serial = usbSerial(target);
+
+    auto started = chrono::steady_clock::now();
+    auto deadline = started + CONNECT_TIMEOUT;
+    
+    // Only go through the release steps when GVFS actually holds a device
+    bool released = false;
+    if (auto_unmount && hasGvfsMTPMounts()) {
+        cout << "Releasing MTP device from GVFS..." << endl;
+        releaseGvfsMounts();
+        released = true;
     }
 
-    // Use uncached version to avoid "cached device" errors when enumerating files
-    // Try multiple times with increasing wait periods
-    const int max_retries = 5;
-    int retry_wait_ms[] = {500, 1000, 2000, 3000, 4000}; // Increasing wait times
+    // Use uncached version to avoid "cached device" errors when enumerating files.
+    // Instead of sleeping a fixed time, poll until the device can be opened:
+    // while another program still claims its interface, watch sysfs for the
+    // release; otherwise retry with a short backoff.
+    auto backoff = RETRY_BACKOFF_MIN;
+    int attempts = 0;
     
-    for (int attempt = 0; attempt < max_retries; attempt++) {
-        if (attempt > 0) {
-            cout << "Retry attempt " << attempt << "/" << (max_retries - 1) << "..." << endl;
-        }
-        
+    while (true) {
+        attempts++;
         device_ = LIBMTP_Open_Raw_Device_Uncached(&raw_devices_[device_index]);
-        
-        if (device_ != nullptr) {
-            break; // Success!
+        if (device_ != nullptr || chrono::steady_clock::now() >= deadline) {
+            break;
         }
         
-        // If connection failed and we have retries left, try unmounting again
-        if (attempt < max_retries - 1) {
-            cout << "Connection failed, device may still be busy. Releasing..." << endl;
-            
-            // Force unmount on retry
-            unmountMTPDevices();
-            
-            // Wait before retry (increasing wait time each attempt)
-            cout << "Waiting " << retry_wait_ms[attempt] << "ms before retry..." << endl;
-            usleep(retry_wait_ms[attempt] * 1000);
-            
-            // Re-detect devices after unmount
-            raw_devices_.clear();
-            if (!detectDevices()) {
-                setError("Failed to detect devices after unmount attempt");
-                return false;
+        if (usbInterfaceClaimed(raw_devices_[device_index])) {
+            if (auto_unmount && !released) {
+                cout << "Device is busy, releasing it from GVFS..." << endl;
+                unmountMTPDevices();
+                released = true;
             }
+            while (usbInterfaceClaimed(raw_devices_[device_index]) &&
+                   chrono::steady_clock::now() < deadline) {
+                this_thread::sleep_for(RELEASE_POLL_INTERVAL);
+            }
+            continue;
+        }
+        
+        // Free but not answering yet, e.g. still re-enumerating after release
+        this_thread::sleep_for(backoff);
+        backoff = min(backoff * 2, RETRY_BACKOFF_MAX);
+        
+        // Detected again in case the phone re-enumerated
+        raw_devices_.clear();
+        if (!detectDevices()) {
+            setError("MTP device disappeared while connecting");
+            return false;
+        }
+        device_index = findSameDevice(raw_devices_, target, usb_serial);
+        if (device_index < 0) {
+            setError("MTP device not found after it re-enumerated: " + device_name);
+            return false;
         }
     }
     
     if (device_ == nullptr) {
-        setError("Failed to open MTP device after " + to_string(max_retries) + 
+        setError("Failed to open MTP device after " + to_string(attempts) + 
                  " attempts. Try manually ejecting the device in your file manager.");
         return false;
     }
+    
+    auto elapsed_ms = chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - started).count();
 
     // Get device information
     char* manufacturer = LIBMTP_Get_Manufacturername(device_);
@@ -261,11 +474,18 @@ bool MTPHandler::connectToDevice(const string& device_name, bool auto_unmount) {
     
     cout << "Connected to device: " 
          << (manufacturer ? manufacturer : "Unknown") << " "
-         << (model ? model : "Unknown") << endl;
+         << (model ? model : "Unknown")
+         << " (" << elapsed_ms << " ms, " << attempts << " attempt"
+         << (attempts == 1 ? "" : "s") << ")" << endl;
 
     if (manufacturer) free(manufacturer);
     if (model) free(model);
 
+    // Serial number identifies this phone across sessions
+    char* serial = LIBMTP_Get_Serialnumber(device_);
+    serial_number_ = serial ? string(serial) : "";
+    if (serial) free(serial);
+
     return true;
 }
 
@@ -273,6 +493,9 @@ void MTPHandler::disconnect(bool auto_unmount) {
     if (device_ != nullptr) {
         LIBMTP_Release_Device(device_);
         device_ = nullptr;
+        serial_number_.clear();
+        invalidateObjectCache();
+        clearSeededListings();
         
         // Optionally unmount after disconnecting
         if (auto_unmount) {
@@ -384,91 +607,50 @@ vector<DeviceStorageInfo> MTPHandler::getStorageInfo() const {
     return storages;
 }
 
-bool MTPHandler::isPhotoFile(const string& filename) const {
-    string lower = filename;
-    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    
-    auto endsWith = [](const string& str, const string& suffix) {
-        return str.length() >= suffix.length() &&
-               str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
-    };
-    
-    return endsWith(lower, ".jpg") || endsWith(lower, ".jpeg") || 
-           endsWith(lower, ".png") || endsWith(lower, ".gif") ||
-           endsWith(lower, ".bmp") || endsWith(lower, ".webp") ||
-           endsWith(lower, ".heic") || endsWith(lower, ".heif");
-}
-
-bool MTPHandler::isVideoFile(const string& filename) const {
-    string lower = filename;
-    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    
-    auto endsWith = [](const string& str, const string& suffix) {
-        return str.length() >= suffix.length() &&
-               str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
-    };
-    
-    return endsWith(lower, ".mp4") || endsWith(lower, ".mov") ||
-           endsWith(lower, ".avi") || endsWith(lower, ".mkv") ||
-           endsWith(lower, ".m4v") || endsWith(lower, ".3gp") ||
-           endsWith(lower, ".webm") || endsWith(lower, ".flv");
+// Seeded listings are keyed by storage and device path, since handles are
+// only trusted after they have been checked against the device
+static string seedKey(uint32_t storage_id, const string& path) {
+    return to_string(storage_id) + ":" + path;
 }
 
-bool MTPHandler::isMediaFile(const string& filename) const {
-    return isPhotoFile(filename) || isVideoFile(filename);
+static void splitParent(const string& path, string& parent, string& name) {
+    size_t slash = path.rfind('/');
+    parent = (slash == string::npos) ? "" : path.substr(0, slash);
+    name = (slash == string::npos) ? path : path.substr(slash + 1);
 }
 
-string MTPHandler::getMimeType(const string& filename) const {
-    string lower = filename;
-    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    
-    auto endsWith = [](const string& str, const string& suffix) {
-        return str.length() >= suffix.length() &&
-               str.compare(str.length() - suffix.length(), suffix.length(), suffix) == 0;
-    };
-    
-    // Image MIME types
-    if (endsWith(lower, ".jpg") || endsWith(lower, ".jpeg")) return "image/jpeg";
-    if (endsWith(lower, ".png")) return "image/png";
-    if (endsWith(lower, ".gif")) return "image/gif";
-    if (endsWith(lower, ".bmp")) return "image/bmp";
-    if (endsWith(lower, ".webp")) return "image/webp";
-    if (endsWith(lower, ".heic") || endsWith(lower, ".heif")) return "image/heic";
+const MTPHandler::FolderListing& MTPHandler::listFolder(uint32_t storage_id,
+                                                        uint32_t folder_id,
+                                                        const string& base_path,
+                                                        uint64_t modification_date) {
+    uint64_t key = (static_cast<uint64_t>(storage_id) << 32) | folder_id;
+    auto cached = folder_listings_.find(key);
+    if (cached != folder_listings_.end()) {
+        return cached->second;
+    }
     
-    // Video MIME types
-    if (endsWith(lower, ".mp4") || endsWith(lower, ".m4v")) return "video/mp4";
-    if (endsWith(lower, ".mov")) return "video/quicktime";
-    if (endsWith(lower, ".avi")) return "video/x-msvideo";
-    if (endsWith(lower, ".mkv")) return "video/x-matroska";
-    if (endsWith(lower, ".3gp")) return "video/3gpp";
-    if (endsWith(lower, ".webm")) return "video/webm";
-    if (endsWith(lower, ".flv")) return "video/x-flv";
+    FolderListing& listing = folder_listings_[key];
+    listing.path = base_path;
+    listing.modification_date = modification_date;
     
-    return "application/octet-stream"; // default
-}
-
-vector<MediaInfo> MTPHandler::enumerateDirectory(uint32_t storage_id, 
-                                                  uint32_t parent_id,
-                                                  const string& base_path) {
-    vector<MediaInfo> photos;
+    if (!device_) return listing;
     
-    if (!device_) return photos;
+    if (restoreSeededListing(storage_id, folder_id, listing)) {
+        return listing;
+    }
 
     // Use LIBMTP_Get_Files_And_Folders which is available in all libmtp versions
-    LIBMTP_file_t* files = LIBMTP_Get_Files_And_Folders(device_, storage_id, parent_id);
+    LIBMTP_file_t* files = LIBMTP_Get_Files_And_Folders(device_, storage_id, folder_id);
     
     if (files != nullptr) {
         LIBMTP_file_t* file = files;
         
         while (file != nullptr) {
+            string filename = file->filename ? string(file->filename) : "";
             if (file->filetype == LIBMTP_FILETYPE_FOLDER) {
-                string sub_path = base_path.empty() ? 
-                    (file->filename ? string(file->filename) : "") :
-                    base_path + "/" + (file->filename ? string(file->filename) : "");
-                auto sub_photos = enumerateDirectory(storage_id, file->item_id, sub_path);
-                photos.insert(photos.end(), sub_photos.begin(), sub_photos.end());
+                listing.folders.push_back({file->item_id, filename,
+                                           static_cast<uint64_t>(file->modificationdate)});
             } else {
-                string filename = file->filename ? string(file->filename) : "";
                 // Check for photos, videos, or unknown file types that might be media
                 if (file->filetype == LIBMTP_FILETYPE_JPEG || 
                     file->filetype == LIBMTP_FILETYPE_PNG ||
@@ -477,15 +659,17 @@ vector<MediaInfo> MTPHandler::enumerateDirectory(uint32_t storage_id,
                     file->filetype == LIBMTP_FILETYPE_MP4 ||
                     file->filetype == LIBMTP_FILETYPE_AVI ||
                     file->filetype == LIBMTP_FILETYPE_UNDEF_VIDEO ||
-                    isMediaFile(filename)) {
+                    MediaTypes::isMediaFile(filename)) {
                     MediaInfo info;
                     info.object_id = file->item_id;
                     info.filename = filename;
                     info.path = base_path.empty() ? filename : base_path + "/" + filename;
                     info.file_size = file->filesize;
                     info.modification_date = file->modificationdate;
-                    info.mime_type = getMimeType(filename);
-                    photos.push_back(info);
+                    info.mime_type = MediaTypes::getMimeType(filename);
+                    info.storage_id = storage_id;
+                    object_cache_[file->item_id] = {info, folder_id};
+                    listing.files.push_back(info);
                 }
             }
             file = file->next;
@@ -494,6 +678,279 @@ vector<MediaInfo> MTPHandler::enumerateDirectory(uint32_t storage_id,
         LIBMTP_destroy_file_t(files);
     }
 
+    return listing;
+}
+
+bool MTPHandler::restoreSeededListing(uint32_t storage_id, uint32_t folder_id,
+                                      FolderListing& listing) {
+    // The root is always listed; it is one small listing and the only way
+    // to notice new top-level folders
+    if (listing.path.empty()) {
+        return false;
+    }
+    
+    string key = seedKey(storage_id, listing.path);
+    auto seeded = seeded_folders_.find(key);
+    if (seeded == seeded_folders_.end()) {
+        return false;
+    }
+    
+    // Ask the device for the folder's current date; this also tells us
+    // whether the handle still names the same folder
+    LIBMTP_file_t* folder = LIBMTP_Get_Filemetadata(device_, folder_id);
+    if (folder == nullptr) {
+        return false;
+    }
+    string current_name = folder->filename ? string(folder->filename) : "";
+    listing.modification_date = folder->modificationdate;
+    LIBMTP_destroy_file_t(folder);
+    
+    string parent, name;
+    splitParent(listing.path, parent, name);
+    const FolderStamp& stamp = seeded->second;
+    
+    // Devices that report no folder dates can't be trusted to be unchanged
+    if (!stamp.listed || stamp.folder_id != folder_id || current_name != name ||
+        listing.modification_date == 0 || listing.modification_date != stamp.modification_date) {
+        return false;
+    }
+    
+    auto folders = seeded_subfolders_.find(key);
+    if (folders != seeded_subfolders_.end()) {
+        listing.folders = folders->second;
+    }
+    auto files = seeded_files_.find(key);
+    if (files != seeded_files_.end()) {
+        listing.files = files->second;
+    }
+    for (const auto& info : listing.files) {
+        object_cache_[static_cast<uint32_t>(info.object_id)] = {info, folder_id};
+    }
+    
+    return true;
+}
+
+bool MTPHandler::seededHandlesValid() {
+    // Some devices hand out new object handles every session. Spot-check a
+    // few cached files; if their handles moved, none of the cache is usable.
+    int checked = 0;
+    for (const auto& folder : seeded_files_) {
+        if (folder.second.empty()) continue;
+        
+        const MediaInfo& info = folder.second.front();
+        LIBMTP_file_t* file = LIBMTP_Get_Filemetadata(device_, static_cast<uint32_t>(info.object_id));
+        bool same = file != nullptr && file->filename != nullptr &&
+                    info.filename == file->filename && info.file_size == file->filesize;
+        if (file != nullptr) {
+            LIBMTP_destroy_file_t(file);
+        }
+        
+        if (!same) {
+            return false;
+        }
+        if (++checked == 3) {
+            break;
+        }
+    }
+    
+    return true;
+}
+
+void MTPHandler::clearSeededListings() {
+    seeded_folders_.clear();
+    seeded_subfolders_.clear();
+    seeded_files_.clear();
+}
+
+void MTPHandler::setEnumerationSnapshot(const EnumerationSnapshot& snapshot) {
+    clearSeededListings();
+    
+    string parent, name;
+    for (const auto& folder : snapshot.folders) {
+        seeded_folders_[seedKey(folder.storage_id, folder.path)] = folder;
+        if (!folder.path.empty()) {
+            splitParent(folder.path, parent, name);
+            seeded_subfolders_[seedKey(folder.storage_id, parent)].push_back(
+                {folder.folder_id, name, folder.modification_date});
+        }
+    }
+    
+    for (const auto& info : snapshot.media) {
+        splitParent(info.path, parent, name);
+        seeded_files_[seedKey(info.storage_id, parent)].push_back(info);
+    }
+}
+
+void MTPHandler::reseedFromListings() {
+    if (folder_listings_.empty()) {
+        return;
+    }
+    
+    // This connection's listings become seeds, so each folder is reused
+    // only while the device still reports the date it was listed with
+    EnumerationSnapshot snapshot = getEnumerationSnapshot();
+    unordered_map<string, size_t> live;
+    for (size_t i = 0; i < snapshot.folders.size(); i++) {
+        live[seedKey(snapshot.folders[i].storage_id, snapshot.folders[i].path)] = i;
+    }
+    
+    // Seeds this connection has not listed yet stay usable
+    for (const auto& seeded : seeded_folders_) {
+        auto found = live.find(seeded.first);
+        if (found != live.end()) {
+            FolderStamp& stamp = snapshot.folders[found->second];
+            if (stamp.listed || !seeded.second.listed) continue;
+            stamp = seeded.second;
+        } else {
+            snapshot.folders.push_back(seeded.second);
+        }
+        auto files = seeded_files_.find(seeded.first);
+        if (files != seeded_files_.end()) {
+            snapshot.media.insert(snapshot.media.end(), files->second.begin(), files->second.end());
+        }
+    }
+    
+    invalidateObjectCache();
+    setEnumerationSnapshot(snapshot);
+}
+
+EnumerationSnapshot MTPHandler::getEnumerationSnapshot() const {
+    EnumerationSnapshot snapshot;
+    
+    for (const auto& entry : folder_listings_) {
+        uint32_t storage_id = static_cast<uint32_t>(entry.first >> 32);
+        uint32_t folder_id = static_cast<uint32_t>(entry.first);
+        const FolderListing& listing = entry.second;
+        
+        // Root candidates that were probed but not chosen are not in the tree
+        if (listing.path.empty()) {
+            auto root = storage_roots_.find(storage_id);
+            if (root == storage_roots_.end() || root->second != folder_id) {
+                continue;
+            }
+        }
+        
+        snapshot.folders.push_back({storage_id, listing.path, folder_id,
+                                    listing.modification_date, 0, true});
+        
+        // Subfolders that were never listed are still recorded so a cached
+        // parent listing knows about them
+        for (const auto& folder : listing.folders) {
+            uint64_t sub_key = (static_cast<uint64_t>(storage_id) << 32) | folder.id;
+            if (folder_listings_.count(sub_key) != 0) continue;
+            
+            string sub_path = listing.path.empty() ? folder.name : listing.path + "/" + folder.name;
+            snapshot.folders.push_back({storage_id, sub_path, folder.id,
+                                        folder.modification_date, 0, false});
+        }
+        
+        snapshot.media.insert(snapshot.media.end(), listing.files.begin(), listing.files.end());
+    }
+    
+    return snapshot;
+}
+
+bool MTPHandler::resolveStorageRoot(uint32_t storage_id, uint32_t& root_id) {
+    auto known = storage_roots_.find(storage_id);
+    if (known != storage_roots_.end()) {
+        root_id = known->second;
+        return true;
+    }
+    
+    // Android devices may use different root IDs; one listing per candidate
+    // is enough to tell which one this storage answers to
+    const uint32_t root_ids_to_try[] = {
+        0,              // Standard root
+        0xFFFFFFFF,     // Common alternative root (uint32_t max)
+        0x00000001      // Some devices use this
+    };
+    
+    for (uint32_t candidate : root_ids_to_try) {
+        const FolderListing& listing = listFolder(storage_id, candidate, "");
+        if (!listing.folders.empty() || !listing.files.empty()) {
+            storage_roots_[storage_id] = candidate;
+            root_id = candidate;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+bool MTPHandler::resolveFolder(const string& path, uint32_t& storage_id, uint32_t& folder_id) {
+    vector<string> components;
+    stringstream ss(path);
+    string component;
+    while (getline(ss, component, '/')) {
+        if (!component.empty()) {
+            components.push_back(component);
+        }
+    }
+    
+    for (const auto& storage : getStorageInfo()) {
+        uint32_t current = 0;
+        if (!resolveStorageRoot(storage.storage_id, current)) {
+            continue;
+        }
+        
+        string current_path;
+        uint64_t current_date = 0;
+        bool found = true;
+        for (const auto& name : components) {
+            const FolderListing& listing = listFolder(storage.storage_id, current, current_path,
+                                                      current_date);
+            auto child = find_if(listing.folders.begin(), listing.folders.end(),
+                                 [&name](const FolderEntry& folder) {
+                                     return folder.name == name;
+                                 });
+            if (child == listing.folders.end()) {
+                found = false;
+                break;
+            }
+            current = child->id;
+            current_date = child->modification_date;
+            current_path = current_path.empty() ? name : current_path + "/" + name;
+        }
+        
+        if (found) {
+            // List the target under its normalised path and real date
+            listFolder(storage.storage_id, current, current_path, current_date);
+            storage_id = storage.storage_id;
+            folder_id = current;
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+vector<MediaInfo> MTPHandler::enumerateDirectory(uint32_t storage_id, 
+                                                  uint32_t parent_id,
+                                                  const string& base_path,
+                                                  uint64_t modification_date,
+                                                  const PathFilter& filter) {
+    vector<MediaInfo> photos;
+    
+    if (!device_) return photos;
+
+    const FolderListing& listing = listFolder(storage_id, parent_id, base_path, modification_date);
+    for (const auto& file : listing.files) {
+        if (filter.shouldInclude(file.path)) {
+            photos.push_back(file);
+        }
+    }
+    
+    for (const auto& folder : listing.folders) {
+        string sub_path = base_path.empty() ? folder.name : base_path + "/" + folder.name;
+        // Excluded subtrees are never listed
+        if (!filter.shouldDescend(sub_path)) {
+            continue;
+        }
+        auto sub_photos = enumerateDirectory(storage_id, folder.id, sub_path,
+                                             folder.modification_date, filter);
+        photos.insert(photos.end(), sub_photos.begin(), sub_photos.end());
+    }
+
     return photos;
 }
 
@@ -513,9 +970,8 @@ vector<MediaInfo> MTPHandler::enumerateMedia(const string& directory_path) {
         cerr << "Warning: No storage info found, trying common storage IDs..." << endl;
         uint32_t common_storage_ids[] = {0x00010001, 0x00010002, 0x00010003, 0x00000001, 0x00000002};
         for (uint32_t storage_id : common_storage_ids) {
-            auto found_photos = enumerateDirectory(storage_id, 0, "");
-            if (!found_photos.empty()) {
-                // Found photos, add this storage ID
+            uint32_t root_id = 0;
+            if (resolveStorageRoot(storage_id, root_id)) {
                 DeviceStorageInfo info;
                 info.storage_id = storage_id;
                 info.description = "Storage " + to_string(storage_id);
@@ -523,100 +979,49 @@ vector<MediaInfo> MTPHandler::enumerateMedia(const string& directory_path) {
                 info.free_space = 0;
                 info.storage_type = 0;
                 storages.push_back(info);
-                photos.insert(photos.end(), found_photos.begin(), found_photos.end());
                 break; // Use first working storage
             }
         }
         
-        if (photos.empty()) {
+        if (storages.empty()) {
             setError("No storage found on device and common storage IDs failed");
             return photos;
         }
     }
 
-    // Default paths to search if none specified
-    // Search broadly to find all camera roll content
-    vector<string> search_paths;
-    if (directory_path.empty()) {
-        // Don't filter by path - enumerate all and filter by file type
-        // This will capture everything in camera roll and other locations
-        search_paths.clear(); // Empty means search everything
-    } else {
-        search_paths.push_back(directory_path);
+    // A requested directory becomes an include rule so the walk never
+    // leaves it; configured excludes prune the rest
+    PathFilter filter = path_filter_;
+    if (!directory_path.empty()) {
+        filter.addInclude(directory_path);
     }
 
-    // Try to find photos in each storage
-    // Enumerate once per storage to avoid duplicates
+    // Objects may have come and gone since the last walk; listings from
+    // this or the last connection only stand in for folders whose date has
+    // not changed, provided this session's handles still match them
+    reseedFromListings();
+    handles_renumbered_ = !seeded_folders_.empty() && !seededHandlesValid();
+    if (handles_renumbered_) {
+        cout << "  Cached listing does not match this session's object handles, re-walking" << endl;
+        clearSeededListings();
+    }
+
+    // Walk each storage once; folder listings are memoized until the next
+    // enumeration, so path lookups after the walk are free
     for (const auto& storage : storages) {
         cout << "  Enumerating storage ID " << storage.storage_id << "..." << endl;
         
-        // Try different parent IDs - Android devices may use different root IDs
-        vector<uint32_t> root_ids_to_try;
-        
-        // Add device default folders if available (these are usually the best starting points)
-        if (device_->default_picture_folder != 0) {
-            root_ids_to_try.push_back(device_->default_picture_folder);
-        }
-        if (device_->default_music_folder != 0) {
-            root_ids_to_try.push_back(device_->default_music_folder);
-        }
-        
-        // Add common root IDs as fallback
-        root_ids_to_try.insert(root_ids_to_try.end(), {
-            0,              // Standard root
-            0xFFFFFFFF,     // Common alternative root (uint32_t max)
-            0x00000001      // Some devices use this
-        });
-        
         vector<MediaInfo> found_photos;
-        
-        // Try each root ID until we find photos
-        for (uint32_t root_id : root_ids_to_try) {
-            auto photos_from_root = enumerateDirectory(storage.storage_id, root_id, "");
-            if (!photos_from_root.empty()) {
-                found_photos.insert(found_photos.end(), 
-                                   photos_from_root.begin(), 
-                                   photos_from_root.end());
-                break; // Found photos, use this root
-            }
-        }
-        
-        // If still nothing, try to search for DCIM folder by name using all root IDs
-        if (found_photos.empty()) {
-            for (uint32_t root_id : root_ids_to_try) {
-                LIBMTP_file_t* files = LIBMTP_Get_Files_And_Folders(device_, storage.storage_id, root_id);
-                if (files != nullptr) {
-                    LIBMTP_file_t* file = files;
-                    while (file != nullptr) {
-                        if (file->filetype == LIBMTP_FILETYPE_FOLDER) {
-                            string folder_name = file->filename ? string(file->filename) : "";
-                            string lower_name = folder_name;
-                            transform(lower_name.begin(), lower_name.end(), lower_name.begin(), ::tolower);
-                            
-                            // Enumerate all folders to get everything (not just DCIM)
-                            // This ensures we capture camera roll content from all locations
-                            auto folder_photos = enumerateDirectory(storage.storage_id, file->item_id, folder_name);
-                            found_photos.insert(found_photos.end(), 
-                                               folder_photos.begin(), 
-                                               folder_photos.end());
-                        }
-                        file = file->next;
-                    }
-                    LIBMTP_destroy_file_t(files);
-                    if (!found_photos.empty()) break;
-                }
-            }
+        uint32_t root_id = 0;
+        if (resolveStorageRoot(storage.storage_id, root_id)) {
+            found_photos = enumerateDirectory(storage.storage_id, root_id, "", 0, filter);
         }
         
         cout << "  Found " << found_photos.size() << " total files during enumeration" << endl;
         
-        // Filter by path if specified
+        // The walk already restricted results to the requested directory
         if (!directory_path.empty()) {
-            for (auto& photo : found_photos) {
-                if (photo.path.find(directory_path) != string::npos) {
-                    photos.push_back(photo);
-                }
-            }
+            photos.insert(photos.end(), found_photos.begin(), found_photos.end());
         } else {
             // Filter to only include photos from common directories
             // But if no photos match, include all photos as fallback
@@ -646,10 +1051,11 @@ vector<MediaInfo> MTPHandler::enumerateMedia(const string& directory_path) {
     return photos;
 }
 
-// Callback structure for file reading
+// Callback structure for streaming file reads
 struct FileReadData {
-    vector<uint8_t>* buffer;
-    size_t offset;
+    const ChunkSink* sink;
+    const CancellationToken* cancel;
+    uint64_t offset;
 };
 
 static uint16_t file_read_callback(void* params, void* priv, uint32_t sendlen, 
@@ -657,45 +1063,73 @@ static uint16_t file_read_callback(void* params, void* priv, uint32_t sendlen,
     (void)params; // Unused
     FileReadData* read_data = static_cast<FileReadData*>(priv);
     
-    if (read_data->offset + sendlen > read_data->buffer->size()) {
+    // Returning an error makes libmtp abandon the transfer rather than
+    // wait out the rest of the object
+    if (isCancelled(read_data->cancel) || !(*read_data->sink)(data, sendlen)) {
         *putlen = 0;
         return LIBMTP_HANDLER_RETURN_ERROR;
     }
     
-    memcpy(read_data->buffer->data() + read_data->offset, data, sendlen);
     read_data->offset += sendlen;
     *putlen = sendlen;
     return LIBMTP_HANDLER_RETURN_OK;
 }
 
-bool MTPHandler::readFile(uint32_t object_id, vector<uint8_t>& data) {
+// MTP object handles are 32-bit; a wider id did not come from this device
+static bool toHandle(ObjectId object_id, uint32_t& handle) {
+    if (object_id > UINT32_MAX) {
+        return false;
+    }
+    handle = static_cast<uint32_t>(object_id);
+    return true;
+}
+
+bool MTPHandler::readFile(ObjectId object_id, vector<uint8_t>& data) {
+    data.clear();
+    return readFileChunked(object_id, [&data](const uint8_t* chunk, size_t size) {
+        data.insert(data.end(), chunk, chunk + size);
+        return true;
+    });
+}
+
+bool MTPHandler::readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                                 const CancellationToken* cancel) {
     if (!device_) {
         setError("Device not connected");
         return false;
     }
 
-    LIBMTP_file_t* file = LIBMTP_Get_Filemetadata(device_, object_id);
-    if (file == nullptr) {
-        setError("Failed to get file metadata");
+    uint32_t handle = 0;
+    if (!toHandle(object_id, handle)) {
+        setError("Invalid object ID");
         return false;
     }
 
-    uint64_t expected_size = file->filesize;
-    data.resize(expected_size);
+    uint64_t expected_size = 0;
+    if (!getObjectSize(handle, expected_size)) {
+        setError("Failed to get file metadata");
+        return false;
+    }
     
     FileReadData read_data;
-    read_data.buffer = &data;
+    read_data.sink = &sink;
+    read_data.cancel = cancel;
     read_data.offset = 0;
     
-    int ret = LIBMTP_Get_File_To_Handler(device_, object_id, 
+    int ret = LIBMTP_Get_File_To_Handler(device_, handle, 
                                          file_read_callback,
                                          &read_data,
                                          nullptr,  // No progress callback
                                          nullptr); // No progress data
 
-    LIBMTP_destroy_file_t(file);
+    if (isCancelled(cancel)) {
+        setError(string("Read ") + cancel->reason());
+        return false;
+    }
 
     if (ret != 0 || read_data.offset != expected_size) {
+        // The object may have changed since enumeration
+        invalidateObject(handle);
         setError("Failed to read file data");
         return false;
     }
@@ -703,6 +1137,97 @@ bool MTPHandler::readFile(uint32_t object_id, vector<uint8_t>& data) {
     return true;
 }
 
+bool MTPHandler::getObjectSize(uint32_t object_id, uint64_t& size) {
+    auto cached = object_cache_.find(object_id);
+    if (cached != object_cache_.end()) {
+        size = cached->second.info.file_size;
+        return true;
+    }
+    
+    LIBMTP_file_t* file = LIBMTP_Get_Filemetadata(device_, object_id);
+    if (file == nullptr) {
+        return false;
+    }
+    
+    size = file->filesize;
+    LIBMTP_destroy_file_t(file);
+    return true;
+}
+
+void MTPHandler::invalidateObjectCache() {
+    object_cache_.clear();
+    folder_listings_.clear();
+    storage_roots_.clear();
+}
+
+void MTPHandler::invalidateObject(uint32_t object_id) {
+    auto cached = object_cache_.find(object_id);
+    if (cached == object_cache_.end()) {
+        return;
+    }
+    
+    // Drop the containing folder's listing so the next walk re-lists it
+    uint64_t key = (static_cast<uint64_t>(cached->second.info.storage_id) << 32) |
+                   cached->second.parent_id;
+    dropListing(key);
+    object_cache_.erase(cached);
+}
+
+void MTPHandler::dropListing(uint64_t key) {
+    auto listing = folder_listings_.find(key);
+    if (listing == folder_listings_.end()) {
+        return;
+    }
+    
+    // The persisted copy is just as stale
+    seeded_folders_.erase(seedKey(static_cast<uint32_t>(key >> 32), listing->second.path));
+    folder_listings_.erase(listing);
+}
+
+bool MTPHandler::readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                           vector<uint8_t>& data, const CancellationToken* cancel) {
+    data.clear();
+    
+    if (!device_) {
+        setError("Device not connected");
+        return false;
+    }
+
+    // GetPartialObject has no callback to stop it, so check before asking
+    if (isCancelled(cancel)) {
+        setError(string("Read ") + cancel->reason());
+        return false;
+    }
+
+    uint32_t handle = 0;
+    if (!toHandle(object_id, handle)) {
+        setError("Invalid object ID");
+        return false;
+    }
+
+    // GetPartialObject transfers only the requested window of the object
+    unsigned char* buffer = nullptr;
+    unsigned int size = 0;
+    int ret = LIBMTP_GetPartialObject(device_, handle, offset, length, &buffer, &size);
+    
+    if (ret != 0) {
+        if (buffer) free(buffer);
+        setError("Failed to read partial object (device may not support ranged reads)");
+        return false;
+    }
+    
+    if (buffer) {
+        data.assign(buffer, buffer + size);
+        free(buffer);
+    }
+    
+    return true;
+}
+
+bool MTPHandler::supportsRangedReads() const {
+    return device_ && LIBMTP_Check_Capability(device_, LIBMTP_DEVICECAP_GetPartialObject) != 0;
+}
+
 bool MTPHandler::deleteFile(uint32_t object_id) {
     if (!device_) {
         setError("Device not connected");
@@ -714,14 +1239,20 @@ bool MTPHandler::deleteFile(uint32_t object_id) {
         setError("Failed to delete file");
         return false;
     }
+    invalidateObject(object_id);
 
     return true;
 }
 
-bool MTPHandler::fileExists(uint32_t object_id) {
-    if (!device_) return false;
+bool MTPHandler::fileExists(ObjectId object_id) {
+    uint32_t handle = 0;
+    if (!device_ || !toHandle(object_id, handle)) return false;
     
-    LIBMTP_file_t* file = LIBMTP_Get_Filemetadata(device_, object_id);
+    if (object_cache_.count(handle) > 0) {
+        return true;
+    }
+    
+    LIBMTP_file_t* file = LIBMTP_Get_Filemetadata(device_, handle);
     bool exists = (file != nullptr);
     
     if (file) {
@@ -731,16 +1262,58 @@ bool MTPHandler::fileExists(uint32_t object_id) {
     return exists;
 }
 
-uint32_t MTPHandler::findObjectByPath(const string& path) {
-    // This is a simplified implementation
-    // In a full implementation, we'd traverse the directory tree
-    // For now, we'll use enumerateMedia and search
+bool MTPHandler::readThumbnail(ObjectId object_id, vector<uint8_t>& data) {
+    data.clear();
+    
+    if (!device_) {
+        setError("Device not connected");
+        return false;
+    }
+
+    uint32_t handle = 0;
+    if (!toHandle(object_id, handle)) {
+        setError("Invalid object ID");
+        return false;
+    }
+
+    // Most devices keep a representative sample for images and videos
+    unsigned char* buffer = nullptr;
+    unsigned int size = 0;
+    int ret = LIBMTP_Get_Thumbnail(device_, handle, &buffer, &size);
+    
+    if (ret == 0 && buffer && size > 0) {
+        data.assign(buffer, buffer + size);
+        free(buffer);
+        return true;
+    }
+    if (buffer) free(buffer);
+    
+    // Otherwise look for an EXIF thumbnail through partial reads
+    return DeviceHandler::readThumbnail(object_id, data);
+}
+
+ObjectId MTPHandler::findObjectByPath(const string& path) {
+    if (!device_) return 0;
+    
+    // Resolve folder by folder through the memoized tree
+    string folder_path = Utils::getDirectory(path);
+    string name = path.substr(folder_path.empty() ? 0 : folder_path.length() + 1);
+    
+    uint32_t storage_id = 0;
+    uint32_t folder_id = 0;
+    if (resolveFolder(folder_path, storage_id, folder_id)) {
+        const FolderListing& listing = listFolder(storage_id, folder_id, folder_path);
+        for (const auto& file : listing.files) {
+            if (file.filename == name) {
+                return file.object_id;
+            }
+        }
+    }
+    
+    // Fall back to a suffix match; enumeration is served from the same tree
     auto photos = enumerateMedia();
     
     for (const auto& photo : photos) {
-        if (photo.path == path) {
-            return photo.object_id;
-        }
         // Check if path ends with the search path
         if (photo.path.length() >= path.length() &&
             photo.path.compare(photo.path.length() - path.length(), path.length(), path) == 0) {
@@ -752,9 +1325,29 @@ uint32_t MTPHandler::findObjectByPath(const string& path) {
 }
 
 vector<string> MTPHandler::listDirectories(const string& path) {
-    (void)path;  // Unused for now
     vector<string> directories;
-    // Implementation would traverse directory structure
-    // For Phase 1, this is a placeholder
+    
+    if (!device_) return directories;
+    
+    if (path.empty() || path == "/") {
+        // Top-level folders of every storage
+        for (const auto& storage : getStorageInfo()) {
+            uint32_t root_id = 0;
+            if (!resolveStorageRoot(storage.storage_id, root_id)) continue;
+            for (const auto& folder : listFolder(storage.storage_id, root_id, "").folders) {
+                directories.push_back(folder.name);
+            }
+        }
+        return directories;
+    }
+    
+    uint32_t storage_id = 0;
+    uint32_t folder_id = 0;
+    if (resolveFolder(path, storage_id, folder_id)) {
+        for (const auto& folder : listFolder(storage_id, folder_id, path).folders) {
+            directories.push_back(folder.name);
+        }
+    }
+    
     return directories;
 }
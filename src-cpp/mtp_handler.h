@@ -6,6 +6,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <unordered_map>
+#include <chrono>
 
 // Type aliases for backward compatibility
 using PhotoInfo = MediaInfo;
@@ -24,28 +26,59 @@ public:
     bool detectDevices() override;
     bool connectToDevice(const std::string& device_name = "", bool auto_unmount = true) override;
     void disconnect(bool auto_unmount = true) override;
+    std::vector<std::string> getDetectedDevices() const override;
     bool isConnected() const override { return device_ != nullptr; }
     
     // Device information
     std::string getDeviceName() const override;
     std::string getDeviceManufacturer() const override;
     std::string getDeviceModel() const override;
+    std::string getSerialNumber() const override { return serial_number_; }
     DeviceType getDeviceType() const override { return DeviceType::ANDROID; }
     std::vector<DeviceStorageInfo> getStorageInfo() const override;
 
     // File operations
     std::vector<MediaInfo> enumerateMedia(const std::string& directory_path = "") override;
-    bool readFile(uint32_t object_id, std::vector<uint8_t>& data) override;
-    bool fileExists(uint32_t object_id) override;
+    bool readFile(ObjectId object_id, std::vector<uint8_t>& data) override;
+    bool readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                         const CancellationToken* cancel = nullptr) override;
+    bool readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                   std::vector<uint8_t>& data,
+                   const CancellationToken* cancel = nullptr) override;
+    bool fileExists(ObjectId object_id) override;
+    bool readThumbnail(ObjectId object_id, std::vector<uint8_t>& data) override;
+
+    // Enumeration cache
+    void setEnumerationSnapshot(const EnumerationSnapshot& snapshot) override;
+    EnumerationSnapshot getEnumerationSnapshot() const override;
+
+    // Responders hand out object handles from a counter. Some renumber
+    // every session, possibly downwards, which would hide files added with
+    // an old date; a renumbering spotted against the cached listing is
+    // reported so the caller drops its object-id watermarks.
+    bool hasIncreasingObjectIds() const override { return true; }
+    bool objectIdsRenumbered() const override { return handles_renumbered_; }
+
+    // Ranged reads need the optional GetPartialObject operation
+    bool supportsRangedReads() const override;
 
     // Error handling
     std::string getLastError() const override { return last_error_; }
 
     // MTP-specific methods (not part of DeviceHandler interface)
+    // Whether GVFS has an MTP mount or a running gvfsd-mtp; spawns no processes
+    static bool hasGvfsMTPMounts();
+    // Releases MTP devices held by GVFS; returns whether anything was released
     static bool unmountMTPDevices();
+    // unmountMTPDevices() for callers that just found hasGvfsMTPMounts() true
+    static bool releaseGvfsMounts();
     bool deleteFile(uint32_t object_id);
     std::vector<std::string> listDirectories(const std::string& path);
-    uint32_t findObjectByPath(const std::string& path);
+    ObjectId findObjectByPath(const std::string& path);
+    
+    // Folder tree and metadata cache invalidation
+    void invalidateObjectCache();
+    void invalidateObject(uint32_t object_id);
 
     // Legacy method alias for backward compatibility
     std::vector<PhotoInfo> enumeratePhotos(const std::string& directory_path = "") {
@@ -53,19 +86,69 @@ public:
     }
 
 private:
+    // Connect polls for the device to become free instead of sleeping blindly
+    static constexpr std::chrono::milliseconds CONNECT_TIMEOUT{15000};
+    static constexpr std::chrono::milliseconds RELEASE_POLL_INTERVAL{20};
+    static constexpr std::chrono::milliseconds RETRY_BACKOFF_MIN{50};
+    static constexpr std::chrono::milliseconds RETRY_BACKOFF_MAX{1000};
+
     LIBMTP_mtpdevice_t* device_;
     std::vector<LIBMTP_raw_device_t> raw_devices_;
     std::string last_error_;
+    std::string serial_number_;
+    bool handles_renumbered_ = false;
+    
+    // Index into raw_devices_ of the named device, the first one if unnamed
+    int findRawDevice(const std::string& device_name) const;
+    
+    // One memoized listing per folder; each enumeration turns them back into
+    // seeds, so an unchanged folder is not listed twice per connection
+    struct FolderEntry {
+        uint32_t id;
+        std::string name;
+        uint64_t modification_date;
+    };
+    struct FolderListing {
+        std::string path;
+        uint64_t modification_date = 0;
+        std::vector<FolderEntry> folders;
+        std::vector<MediaInfo> files;
+    };
+    std::unordered_map<uint64_t, FolderListing> folder_listings_; // (storage << 32 | folder)
+    std::unordered_map<uint32_t, uint32_t> storage_roots_;        // storage -> root handle
+    
+    // Persisted listings from a previous connection, keyed by (storage, path);
+    // a folder is served from here when its handle, name and date still match
+    std::unordered_map<std::string, FolderStamp> seeded_folders_;
+    std::unordered_map<std::string, std::vector<FolderEntry>> seeded_subfolders_;
+    std::unordered_map<std::string, std::vector<MediaInfo>> seeded_files_;
+    
+    // Metadata captured during enumeration, keyed by object id, so reads
+    // and existence checks skip a LIBMTP_Get_Filemetadata round trip
+    struct CachedObject {
+        MediaInfo info;
+        uint32_t parent_id;
+    };
+    std::unordered_map<uint32_t, CachedObject> object_cache_;
 
     // Helper functions
     void setError(const std::string& error);
+    bool getObjectSize(uint32_t object_id, uint64_t& size);
     bool findStorageForPath(const std::string& path, uint32_t& storage_id);
+    const FolderListing& listFolder(uint32_t storage_id, uint32_t folder_id,
+                                    const std::string& base_path,
+                                    uint64_t modification_date = 0);
+    bool restoreSeededListing(uint32_t storage_id, uint32_t folder_id, FolderListing& listing);
+    bool seededHandlesValid();
+    void clearSeededListings();
+    void reseedFromListings();
+    void dropListing(uint64_t key);
+    bool resolveStorageRoot(uint32_t storage_id, uint32_t& root_id);
+    bool resolveFolder(const std::string& path, uint32_t& storage_id, uint32_t& folder_id);
     std::vector<MediaInfo> enumerateDirectory(uint32_t storage_id, uint32_t parent_id, 
-                                         const std::string& base_path);
-    bool isPhotoFile(const std::string& filename) const;
-    bool isVideoFile(const std::string& filename) const;
-    bool isMediaFile(const std::string& filename) const;
-    std::string getMimeType(const std::string& filename) const;
+                                         const std::string& base_path,
+                                         uint64_t modification_date,
+                                         const PathFilter& filter);
 };
 
 #endif // MTP_HANDLER_H
@@ -0,0 +1,135 @@
+#include "path_filter.h"
+#include <algorithm>
+#include <cctype>
+
+using namespace std;
+
+PathFilter PathFilter::defaults() {
+    PathFilter filter;
+    filter.addExclude("Android/data");
+    filter.addExclude("Android/obb");
+    filter.addExclude(".thumbnails");
+    filter.addExclude(".Statuses");
+    filter.addExclude(".Trash*");
+    return filter;
+}
+
+void PathFilter::addInclude(const string& rule) {
+    Rule parsed = parseRule(rule);
+    if (!parsed.components.empty()) {
+        includes_.push_back(parsed);
+    }
+}
+
+void PathFilter::addExclude(const string& rule) {
+    Rule parsed = parseRule(rule);
+    if (!parsed.components.empty()) {
+        excludes_.push_back(parsed);
+    }
+}
+
+void PathFilter::clear() {
+    includes_.clear();
+    excludes_.clear();
+}
+
+PathFilter::Rule PathFilter::parseRule(const string& rule) {
+    Rule parsed;
+    parsed.components = splitPath(rule);
+    parsed.anchored = parsed.components.size() > 1 ||
+                      (!rule.empty() && rule[0] == '/');
+    return parsed;
+}
+
+vector<string> PathFilter::splitPath(const string& path) {
+    vector<string> components;
+    string current;
+    
+    for (char c : path) {
+        if (c == '/' || c == '\\') {
+            if (!current.empty()) {
+                components.push_back(current);
+                current.clear();
+            }
+        } else {
+            current += static_cast<char>(::tolower(static_cast<unsigned char>(c)));
+        }
+    }
+    
+    if (!current.empty()) {
+        components.push_back(current);
+    }
+    
+    return components;
+}
+
+bool PathFilter::componentMatches(const string& pattern, const string& component) {
+    if (!pattern.empty() && pattern.back() == '*') {
+        return component.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0;
+    }
+    return pattern == component;
+}
+
+bool PathFilter::matchesAny(const vector<Rule>& rules, const vector<string>& components) {
+    for (const auto& rule : rules) {
+        if (rule.anchored) {
+            if (components.size() < rule.components.size()) continue;
+            bool match = true;
+            for (size_t i = 0; i < rule.components.size() && match; i++) {
+                match = componentMatches(rule.components[i], components[i]);
+            }
+            if (match) return true;
+        } else {
+            for (const auto& component : components) {
+                if (componentMatches(rule.components[0], component)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool PathFilter::shouldDescend(const string& folder_path) const {
+    vector<string> components = splitPath(folder_path);
+    
+    if (matchesAny(excludes_, components)) {
+        return false;
+    }
+    
+    if (includes_.empty()) {
+        return true;
+    }
+    
+    // Descend into anything on the way to, or inside, an included tree
+    for (const auto& rule : includes_) {
+        if (!rule.anchored) {
+            return true; // Could appear at any depth
+        }
+        size_t common = min(rule.components.size(), components.size());
+        bool match = true;
+        for (size_t i = 0; i < common && match; i++) {
+            match = componentMatches(rule.components[i], components[i]);
+        }
+        if (match) return true;
+    }
+    
+    return false;
+}
+
+bool PathFilter::shouldInclude(const string& file_path) const {
+    vector<string> components = splitPath(file_path);
+    
+    if (matchesAny(excludes_, components)) {
+        return false;
+    }
+    
+    if (includes_.empty()) {
+        return true;
+    }
+    
+    // Only the containing folders count towards an include rule
+    if (!components.empty()) {
+        components.pop_back();
+    }
+    
+    return matchesAny(includes_, components);
+}
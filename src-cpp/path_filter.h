@@ -0,0 +1,49 @@
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Include/exclude rules applied while walking a device, so excluded
+ * subtrees are never listed.
+ *
+ * Paths are relative to the storage root, '/'-separated and compared
+ * case-insensitively. A rule containing '/' is anchored at the root
+ * ("Android/data"); a single-component rule matches a folder of that name
+ * at any depth (".thumbnails"). A trailing '*' matches any suffix of the
+ * last component (".Trash*").
+ */
+class PathFilter {
+public:
+    PathFilter() = default;
+    
+    // Skips app-private data and thumbnail/cache trees found on most phones
+    static PathFilter defaults();
+    
+    void addInclude(const std::string& rule);
+    void addExclude(const std::string& rule);
+    void clear();
+    bool empty() const { return includes_.empty() && excludes_.empty(); }
+    
+    // Whether the walker should list this folder at all
+    bool shouldDescend(const std::string& folder_path) const;
+    // Whether a file found during the walk belongs in the result
+    bool shouldInclude(const std::string& file_path) const;
+    
+private:
+    struct Rule {
+        std::vector<std::string> components;
+        bool anchored;
+    };
+    
+    std::vector<Rule> includes_;
+    std::vector<Rule> excludes_;
+    
+    static Rule parseRule(const std::string& rule);
+    static std::vector<std::string> splitPath(const std::string& path);
+    static bool componentMatches(const std::string& pattern, const std::string& component);
+    static bool matchesAny(const std::vector<Rule>& rules, const std::vector<std::string>& components);
+};
+
+#endif // PATH_FILTER_H
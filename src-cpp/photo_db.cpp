@@ -20,6 +20,7 @@ void PhotoDB::setError(const string& error) {
 }
 
 bool PhotoDB::open(const string& db_path) {
+    lock_guard<recursive_mutex> lock(mutex_);
     close();
     db_path_ = db_path;
     
@@ -41,6 +42,7 @@ bool PhotoDB::open(const string& db_path) {
 }
 
 void PhotoDB::close() {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (db_) {
         sqlite3_close(db_);
         db_ = nullptr;
@@ -48,6 +50,7 @@ void PhotoDB::close() {
 }
 
 bool PhotoDB::createSchema() {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) {
         setError("Database not open");
         return false;
@@ -67,14 +70,58 @@ bool PhotoDB::createSchema() {
         CREATE INDEX IF NOT EXISTS idx_hash ON photos(hash);
         CREATE INDEX IF NOT EXISTS idx_transfer_date ON photos(transfer_date);
         CREATE INDEX IF NOT EXISTS idx_modification_date ON photos(modification_date);
+        CREATE INDEX IF NOT EXISTS idx_file_size ON photos(file_size);
+
+        CREATE TABLE IF NOT EXISTS photo_quick_hashes (
+            hash TEXT PRIMARY KEY,
+            quick_hash TEXT NOT NULL
+        );
+
+        CREATE TABLE IF NOT EXISTS device_fingerprints (
+            device_serial TEXT NOT NULL,
+            storage_id INTEGER NOT NULL,
+            phone_path TEXT NOT NULL,
+            file_size INTEGER NOT NULL,
+            modification_date INTEGER NOT NULL,
+            hash TEXT NOT NULL,
+            PRIMARY KEY (device_serial, storage_id, phone_path)
+        );
+
+        CREATE TABLE IF NOT EXISTS enumeration_folders (
+            device_serial TEXT NOT NULL,
+            storage_id INTEGER NOT NULL,
+            folder_path TEXT NOT NULL,
+            folder_id INTEGER NOT NULL,
+            modification_date INTEGER NOT NULL,
+            entry_count INTEGER NOT NULL,
+            listed INTEGER NOT NULL,
+            PRIMARY KEY (device_serial, storage_id, folder_path)
+        );
+
+        CREATE TABLE IF NOT EXISTS enumeration_media (
+            device_serial TEXT NOT NULL,
+            storage_id INTEGER NOT NULL,
+            phone_path TEXT NOT NULL,
+            object_id INTEGER NOT NULL,
+            filename TEXT NOT NULL,
+            file_size INTEGER NOT NULL,
+            modification_date INTEGER NOT NULL,
+            mime_type TEXT NOT NULL,
+            PRIMARY KEY (device_serial, storage_id, phone_path)
+        );
 
         CREATE TABLE IF NOT EXISTS sync_metadata (
             key TEXT PRIMARY KEY,
             value TEXT NOT NULL
         );
 
-        INSERT OR IGNORE INTO sync_metadata (key, value) 
-        VALUES ('last_sync_time', '0');
+        CREATE TABLE IF NOT EXISTS sync_watermarks (
+            device_serial TEXT NOT NULL,
+            storage_id INTEGER NOT NULL,
+            modification_date INTEGER NOT NULL,
+            object_id INTEGER NOT NULL,
+            PRIMARY KEY (device_serial, storage_id)
+        );
     )";
 
     char* err_msg = nullptr;
@@ -90,6 +137,7 @@ bool PhotoDB::createSchema() {
 }
 
 bool PhotoDB::initialize() {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) {
         setError("Database not open");
         return false;
@@ -99,6 +147,7 @@ bool PhotoDB::initialize() {
 }
 
 bool PhotoDB::photoExists(const string& hash) {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) return false;
 
     string sql = "SELECT COUNT(*) FROM photos WHERE hash = ?";
@@ -126,6 +175,7 @@ bool PhotoDB::addPhoto(const string& hash,
                        const string& local_path,
                        uint64_t file_size,
                        uint64_t modification_date) {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) {
         setError("Database not open");
         return false;
@@ -164,7 +214,390 @@ bool PhotoDB::addPhoto(const string& hash,
     return true;
 }
 
+bool PhotoDB::addPhotos(const vector<PhotoRecord>& records) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    if (!db_) {
+        setError("Database not open");
+        return false;
+    }
+
+    if (records.empty()) {
+        return true;
+    }
+
+    // A commit per file would make the journal sync the bottleneck
+    sqlite3_exec(db_, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+
+    sqlite3_stmt* replace_photo = nullptr;
+    sqlite3_stmt* keep_photo = nullptr;
+    sqlite3_stmt* insert_fingerprint = nullptr;
+    sqlite3_stmt* insert_quick_hash = nullptr;
+    const char* photo_columns = R"(
+        INTO photos
+        (hash, phone_path, local_path, transfer_date, file_size, modification_date)
+        VALUES (?, ?, ?, ?, ?, ?)
+    )";
+    bool ok =
+        sqlite3_prepare_v2(db_, (string("INSERT OR REPLACE") + photo_columns).c_str(),
+                           -1, &replace_photo, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, (string("INSERT OR IGNORE") + photo_columns).c_str(),
+                           -1, &keep_photo, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, R"(
+            INSERT OR REPLACE INTO device_fingerprints
+            (device_serial, storage_id, phone_path, file_size, modification_date, hash)
+            VALUES (?, ?, ?, ?, ?, ?)
+        )", -1, &insert_fingerprint, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, R"(
+            INSERT OR REPLACE INTO photo_quick_hashes (hash, quick_hash) VALUES (?, ?)
+        )", -1, &insert_quick_hash, nullptr) == SQLITE_OK;
+
+    uint64_t transfer_date = time(nullptr);
+    for (size_t i = 0; ok && i < records.size(); i++) {
+        const PhotoRecord& record = records[i];
+
+        if (!record.local_path.empty()) {
+            sqlite3_stmt* stmt = record.replace ? replace_photo : keep_photo;
+            sqlite3_reset(stmt);
+            sqlite3_bind_text(stmt, 1, record.hash.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, record.phone_path.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, record.local_path.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 4, transfer_date);
+            sqlite3_bind_int64(stmt, 5, record.file_size);
+            sqlite3_bind_int64(stmt, 6, record.modification_date);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+        }
+
+        if (ok && !record.local_path.empty() && !record.quick_hash.empty()) {
+            sqlite3_reset(insert_quick_hash);
+            sqlite3_bind_text(insert_quick_hash, 1, record.hash.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(insert_quick_hash, 2, record.quick_hash.c_str(), -1, SQLITE_STATIC);
+            ok = sqlite3_step(insert_quick_hash) == SQLITE_DONE;
+        }
+
+        if (ok && !record.device_serial.empty()) {
+            sqlite3_reset(insert_fingerprint);
+            sqlite3_bind_text(insert_fingerprint, 1, record.device_serial.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(insert_fingerprint, 2, record.storage_id);
+            sqlite3_bind_text(insert_fingerprint, 3, record.phone_path.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(insert_fingerprint, 4, record.file_size);
+            sqlite3_bind_int64(insert_fingerprint, 5, record.modification_date);
+            sqlite3_bind_text(insert_fingerprint, 6, record.hash.c_str(), -1, SQLITE_STATIC);
+            ok = sqlite3_step(insert_fingerprint) == SQLITE_DONE;
+        }
+    }
+
+    if (!ok) {
+        setError("Failed to record photos: " + string(sqlite3_errmsg(db_)));
+    }
+
+    sqlite3_finalize(replace_photo);
+    sqlite3_finalize(keep_photo);
+    sqlite3_finalize(insert_fingerprint);
+    sqlite3_finalize(insert_quick_hash);
+
+    sqlite3_exec(db_, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+    return ok;
+}
+
+vector<PhotoDB::SizeMatch> PhotoDB::findPhotosBySize(uint64_t file_size) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    vector<SizeMatch> matches;
+    if (!db_) return matches;
+
+    string sql = R"(
+        SELECT photos.hash, photos.local_path, photo_quick_hashes.quick_hash
+        FROM photos LEFT JOIN photo_quick_hashes ON photo_quick_hashes.hash = photos.hash
+        WHERE photos.file_size = ?
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    if (ret != SQLITE_OK) {
+        setError("Failed to prepare statement: " + string(sqlite3_errmsg(db_)));
+        return matches;
+    }
+
+    sqlite3_bind_int64(stmt, 1, file_size);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* hash = (const char*)sqlite3_column_text(stmt, 0);
+        const char* local_path = (const char*)sqlite3_column_text(stmt, 1);
+        const char* quick_hash = (const char*)sqlite3_column_text(stmt, 2);
+        SizeMatch match;
+        match.hash = hash ? hash : "";
+        match.local_path = local_path ? local_path : "";
+        match.quick_hash = quick_hash ? quick_hash : "";
+        matches.push_back(match);
+    }
+
+    sqlite3_finalize(stmt);
+    return matches;
+}
+
+bool PhotoDB::setQuickHash(const string& hash, const string& quick_hash) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    if (!db_) {
+        setError("Database not open");
+        return false;
+    }
+
+    string sql = "INSERT OR REPLACE INTO photo_quick_hashes (hash, quick_hash) VALUES (?, ?)";
+
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    if (ret != SQLITE_OK) {
+        setError("Failed to prepare statement");
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, hash.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, quick_hash.c_str(), -1, SQLITE_STATIC);
+
+    ret = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+
+    return (ret == SQLITE_DONE);
+}
+
+bool PhotoDB::findFingerprint(const string& device_serial,
+                              uint32_t storage_id,
+                              const string& phone_path,
+                              uint64_t file_size,
+                              uint64_t modification_date,
+                              string& hash,
+                              string& local_path) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    if (!db_) return false;
+
+    // Primary key lookup; the join resolves the local copy in the same query
+    string sql = R"(
+        SELECT f.hash, p.local_path
+        FROM device_fingerprints f
+        LEFT JOIN photos p ON p.hash = f.hash
+        WHERE f.device_serial = ? AND f.storage_id = ? AND f.phone_path = ?
+          AND f.file_size = ? AND f.modification_date = ?
+        LIMIT 1
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    if (ret != SQLITE_OK) {
+        setError("Failed to prepare statement: " + string(sqlite3_errmsg(db_)));
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, storage_id);
+    sqlite3_bind_text(stmt, 3, phone_path.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, file_size);
+    sqlite3_bind_int64(stmt, 5, modification_date);
+
+    bool found = false;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* hash_text = (const char*)sqlite3_column_text(stmt, 0);
+        const char* path_text = (const char*)sqlite3_column_text(stmt, 1);
+        hash = hash_text ? hash_text : "";
+        local_path = path_text ? path_text : "";
+        found = !hash.empty();
+    }
+
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+bool PhotoDB::addFingerprint(const string& device_serial,
+                             uint32_t storage_id,
+                             const string& phone_path,
+                             uint64_t file_size,
+                             uint64_t modification_date,
+                             const string& hash) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    if (!db_) {
+        setError("Database not open");
+        return false;
+    }
+
+    string sql = R"(
+        INSERT OR REPLACE INTO device_fingerprints
+        (device_serial, storage_id, phone_path, file_size, modification_date, hash)
+        VALUES (?, ?, ?, ?, ?, ?)
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    if (ret != SQLITE_OK) {
+        setError("Failed to prepare statement: " + string(sqlite3_errmsg(db_)));
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, storage_id);
+    sqlite3_bind_text(stmt, 3, phone_path.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 4, file_size);
+    sqlite3_bind_int64(stmt, 5, modification_date);
+    sqlite3_bind_text(stmt, 6, hash.c_str(), -1, SQLITE_STATIC);
+
+    ret = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+
+    if (ret != SQLITE_DONE) {
+        setError("Failed to insert fingerprint: " + string(sqlite3_errmsg(db_)));
+        return false;
+    }
+
+    return true;
+}
+
+bool PhotoDB::loadEnumerationSnapshot(const string& device_serial,
+                                      EnumerationSnapshot& snapshot) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    snapshot = EnumerationSnapshot();
+    if (!db_) return false;
+
+    string folder_sql = R"(
+        SELECT storage_id, folder_path, folder_id, modification_date, entry_count, listed
+        FROM enumeration_folders WHERE device_serial = ?
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(db_, folder_sql.c_str(), -1, &stmt, nullptr);
+    if (ret != SQLITE_OK) {
+        setError("Failed to prepare statement: " + string(sqlite3_errmsg(db_)));
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        FolderStamp folder;
+        const char* path = (const char*)sqlite3_column_text(stmt, 1);
+        folder.storage_id = sqlite3_column_int64(stmt, 0);
+        folder.path = path ? path : "";
+        folder.folder_id = sqlite3_column_int64(stmt, 2);
+        folder.modification_date = sqlite3_column_int64(stmt, 3);
+        folder.entry_count = sqlite3_column_int64(stmt, 4);
+        folder.listed = sqlite3_column_int(stmt, 5) != 0;
+        snapshot.folders.push_back(folder);
+    }
+    sqlite3_finalize(stmt);
+
+    string media_sql = R"(
+        SELECT storage_id, phone_path, object_id, filename, file_size, modification_date, mime_type
+        FROM enumeration_media WHERE device_serial = ?
+    )";
+
+    ret = sqlite3_prepare_v2(db_, media_sql.c_str(), -1, &stmt, nullptr);
+    if (ret != SQLITE_OK) {
+        setError("Failed to prepare statement: " + string(sqlite3_errmsg(db_)));
+        snapshot = EnumerationSnapshot();
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        MediaInfo info;
+        const char* path = (const char*)sqlite3_column_text(stmt, 1);
+        const char* filename = (const char*)sqlite3_column_text(stmt, 3);
+        const char* mime_type = (const char*)sqlite3_column_text(stmt, 6);
+        info.storage_id = sqlite3_column_int64(stmt, 0);
+        info.path = path ? path : "";
+        info.object_id = static_cast<ObjectId>(sqlite3_column_int64(stmt, 2));
+        info.filename = filename ? filename : "";
+        info.file_size = sqlite3_column_int64(stmt, 4);
+        info.modification_date = sqlite3_column_int64(stmt, 5);
+        info.mime_type = mime_type ? mime_type : "";
+        snapshot.media.push_back(info);
+    }
+    sqlite3_finalize(stmt);
+
+    return !snapshot.folders.empty();
+}
+
+bool PhotoDB::saveEnumerationSnapshot(const string& device_serial,
+                                      const EnumerationSnapshot& snapshot) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    if (!db_) {
+        setError("Database not open");
+        return false;
+    }
+
+    // An empty snapshot means the walk failed or the backend keeps no
+    // cache; keep whatever was stored before
+    if (snapshot.folders.empty()) {
+        return true;
+    }
+
+    // One transaction for the whole device so tens of thousands of rows
+    // are a single write, and a failed save leaves the old snapshot intact
+    sqlite3_exec(db_, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+
+    sqlite3_stmt* clear_folders = nullptr;
+    sqlite3_stmt* clear_media = nullptr;
+    sqlite3_stmt* insert_folder = nullptr;
+    sqlite3_stmt* insert_media = nullptr;
+    bool ok =
+        sqlite3_prepare_v2(db_, "DELETE FROM enumeration_folders WHERE device_serial = ?",
+                           -1, &clear_folders, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, "DELETE FROM enumeration_media WHERE device_serial = ?",
+                           -1, &clear_media, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, R"(
+            INSERT OR REPLACE INTO enumeration_folders
+            (device_serial, storage_id, folder_path, folder_id, modification_date, entry_count, listed)
+            VALUES (?, ?, ?, ?, ?, ?, ?)
+        )", -1, &insert_folder, nullptr) == SQLITE_OK &&
+        sqlite3_prepare_v2(db_, R"(
+            INSERT OR REPLACE INTO enumeration_media
+            (device_serial, storage_id, phone_path, object_id, filename, file_size, modification_date, mime_type)
+            VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+        )", -1, &insert_media, nullptr) == SQLITE_OK;
+
+    if (ok) {
+        sqlite3_bind_text(clear_folders, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(clear_media, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+        ok = sqlite3_step(clear_folders) == SQLITE_DONE &&
+             sqlite3_step(clear_media) == SQLITE_DONE;
+    }
+
+    for (size_t i = 0; ok && i < snapshot.folders.size(); i++) {
+        const FolderStamp& folder = snapshot.folders[i];
+        sqlite3_reset(insert_folder);
+        sqlite3_bind_text(insert_folder, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(insert_folder, 2, folder.storage_id);
+        sqlite3_bind_text(insert_folder, 3, folder.path.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(insert_folder, 4, folder.folder_id);
+        sqlite3_bind_int64(insert_folder, 5, folder.modification_date);
+        sqlite3_bind_int64(insert_folder, 6, folder.entry_count);
+        sqlite3_bind_int(insert_folder, 7, folder.listed ? 1 : 0);
+        ok = sqlite3_step(insert_folder) == SQLITE_DONE;
+    }
+
+    for (size_t i = 0; ok && i < snapshot.media.size(); i++) {
+        const MediaInfo& info = snapshot.media[i];
+        sqlite3_reset(insert_media);
+        sqlite3_bind_text(insert_media, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(insert_media, 2, info.storage_id);
+        sqlite3_bind_text(insert_media, 3, info.path.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(insert_media, 4, static_cast<sqlite3_int64>(info.object_id));
+        sqlite3_bind_text(insert_media, 5, info.filename.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(insert_media, 6, info.file_size);
+        sqlite3_bind_int64(insert_media, 7, info.modification_date);
+        sqlite3_bind_text(insert_media, 8, info.mime_type.c_str(), -1, SQLITE_STATIC);
+        ok = sqlite3_step(insert_media) == SQLITE_DONE;
+    }
+
+    if (!ok) {
+        setError("Failed to save enumeration snapshot: " + string(sqlite3_errmsg(db_)));
+    }
+
+    sqlite3_finalize(clear_folders);
+    sqlite3_finalize(clear_media);
+    sqlite3_finalize(insert_folder);
+    sqlite3_finalize(insert_media);
+
+    sqlite3_exec(db_, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+    return ok;
+}
+
 string PhotoDB::getLocalPath(const string& hash) {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) return "";
 
     string sql = "SELECT local_path FROM photos WHERE hash = ? LIMIT 1";
@@ -188,31 +621,106 @@ string PhotoDB::getLocalPath(const string& hash) {
     return result;
 }
 
-uint64_t PhotoDB::getLastSyncTime() {
+vector<PhotoDB::SyncWatermark> PhotoDB::getSyncWatermarks(const string& device_serial) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    vector<SyncWatermark> watermarks;
+    if (!db_) return watermarks;
+
+    string sql = R"(
+        SELECT storage_id, modification_date, object_id
+        FROM sync_watermarks WHERE device_serial = ?
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
+    if (ret != SQLITE_OK) {
+        setError("Failed to prepare statement: " + string(sqlite3_errmsg(db_)));
+        return watermarks;
+    }
+
+    sqlite3_bind_text(stmt, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        SyncWatermark watermark;
+        watermark.storage_id = sqlite3_column_int64(stmt, 0);
+        watermark.modification_date = sqlite3_column_int64(stmt, 1);
+        watermark.object_id = static_cast<ObjectId>(sqlite3_column_int64(stmt, 2));
+        watermarks.push_back(watermark);
+    }
+
+    sqlite3_finalize(stmt);
+    return watermarks;
+}
+
+bool PhotoDB::saveSyncWatermarks(const string& device_serial,
+                                 const vector<SyncWatermark>& watermarks) {
+    lock_guard<recursive_mutex> lock(mutex_);
+    if (!db_) {
+        setError("Database not open");
+        return false;
+    }
+
+    if (watermarks.empty()) {
+        return true;
+    }
+
+    sqlite3_exec(db_, "BEGIN TRANSACTION;", nullptr, nullptr, nullptr);
+
+    string sql = R"(
+        INSERT OR REPLACE INTO sync_watermarks
+        (device_serial, storage_id, modification_date, object_id)
+        VALUES (?, ?, ?, ?)
+    )";
+
+    sqlite3_stmt* stmt = nullptr;
+    bool ok = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK;
+    for (size_t i = 0; ok && i < watermarks.size(); i++) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, device_serial.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 2, watermarks[i].storage_id);
+        sqlite3_bind_int64(stmt, 3, watermarks[i].modification_date);
+        sqlite3_bind_int64(stmt, 4, static_cast<sqlite3_int64>(watermarks[i].object_id));
+        ok = sqlite3_step(stmt) == SQLITE_DONE;
+    }
+    if (!ok) {
+        setError("Failed to save sync watermarks: " + string(sqlite3_errmsg(db_)));
+    }
+
+    sqlite3_finalize(stmt);
+
+    sqlite3_exec(db_, ok ? "COMMIT;" : "ROLLBACK;", nullptr, nullptr, nullptr);
+    return ok;
+}
+
+double PhotoDB::getLinkRate(const string& device_serial) {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) return 0;
 
-    string sql = "SELECT value FROM sync_metadata WHERE key = 'last_sync_time'";
+    string sql = "SELECT value FROM sync_metadata WHERE key = ?";
     sqlite3_stmt* stmt = nullptr;
-    
+
     int ret = sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
     if (ret != SQLITE_OK) {
         sqlite3_finalize(stmt);
         return 0;
     }
-    
-    uint64_t result = 0;
+
+    string key = "link_rate:" + device_serial;
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+
+    double result = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         const char* value = (const char*)sqlite3_column_text(stmt, 0);
         if (value) {
-            result = strtoull(value, nullptr, 10);
+            result = strtod(value, nullptr);
         }
     }
-    
+
     sqlite3_finalize(stmt);
     return result;
 }
 
-bool PhotoDB::setLastSyncTime(uint64_t timestamp) {
+bool PhotoDB::setLinkRate(const string& device_serial, double bytes_per_second) {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) {
         setError("Database not open");
         return false;
@@ -220,7 +728,7 @@ bool PhotoDB::setLastSyncTime(uint64_t timestamp) {
 
     string sql = R"(
         INSERT OR REPLACE INTO sync_metadata (key, value)
-        VALUES ('last_sync_time', ?)
+        VALUES (?, ?)
     )";
 
     sqlite3_stmt* stmt = nullptr;
@@ -230,8 +738,10 @@ bool PhotoDB::setLastSyncTime(uint64_t timestamp) {
         return false;
     }
 
-    string timestamp_str = to_string(timestamp);
-    sqlite3_bind_text(stmt, 1, timestamp_str.c_str(), -1, SQLITE_STATIC);
+    string key = "link_rate:" + device_serial;
+    string rate_str = to_string(bytes_per_second);
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, rate_str.c_str(), -1, SQLITE_STATIC);
 
     ret = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
@@ -240,6 +750,7 @@ bool PhotoDB::setLastSyncTime(uint64_t timestamp) {
 }
 
 int PhotoDB::getPhotoCount() {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) return 0;
 
     string sql = "SELECT COUNT(*) FROM photos";
@@ -261,6 +772,7 @@ int PhotoDB::getPhotoCount() {
 }
 
 uint64_t PhotoDB::getTotalSizeTransferred() {
+    lock_guard<recursive_mutex> lock(mutex_);
     if (!db_) return 0;
 
     string sql = "SELECT SUM(file_size) FROM photos";
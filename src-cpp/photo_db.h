@@ -1,13 +1,17 @@
 #ifndef PHOTO_DB_H
 #define PHOTO_DB_H
 
+#include "device_handler.h"
 #include <sqlite3.h>
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <mutex>
 
 /**
  * Database handler for tracking transferred photos
+ * All operations are serialized, so one instance can be shared by the
+ * transfer threads of several devices.
  */
 class PhotoDB {
 public:
@@ -32,22 +36,87 @@ public:
                   uint64_t modification_date);
     bool updatePhotoPath(const std::string& hash, const std::string& new_local_path);
     
+    // A file settled by a sync: its library row and its device fingerprint
+    struct PhotoRecord {
+        std::string hash;
+        std::string phone_path;
+        std::string local_path;      // Empty to record only the fingerprint
+        uint64_t file_size = 0;
+        uint64_t modification_date = 0;
+        bool replace = true;         // False keeps an existing row for the hash
+        std::string device_serial;   // Empty to skip the fingerprint
+        uint32_t storage_id = 0;
+        std::string quick_hash;      // Utils::calculateQuickHash(); empty if not known
+    };
+    // Writes a batch of records in one transaction
+    bool addPhotos(const std::vector<PhotoRecord>& records);
+    
+    // Library files of one size, for matching a device file by quick hash
+    // before reading it in full. quick_hash is empty where not yet computed.
+    struct SizeMatch {
+        std::string hash;
+        std::string local_path;
+        std::string quick_hash;
+    };
+    std::vector<SizeMatch> findPhotosBySize(uint64_t file_size);
+    bool setQuickHash(const std::string& hash, const std::string& quick_hash);
+    
+    // Device fingerprint index: (serial, storage, path, size, mtime) -> hash
+    // Lets unchanged device files be recognised without reading them
+    bool findFingerprint(const std::string& device_serial,
+                         uint32_t storage_id,
+                         const std::string& phone_path,
+                         uint64_t file_size,
+                         uint64_t modification_date,
+                         std::string& hash,
+                         std::string& local_path);
+    bool addFingerprint(const std::string& device_serial,
+                        uint32_t storage_id,
+                        const std::string& phone_path,
+                        uint64_t file_size,
+                        uint64_t modification_date,
+                        const std::string& hash);
+    
+    // Per-device enumeration cache, replaced wholesale after each walk
+    bool loadEnumerationSnapshot(const std::string& device_serial,
+                                 EnumerationSnapshot& snapshot);
+    bool saveEnumerationSnapshot(const std::string& device_serial,
+                                 const EnumerationSnapshot& snapshot);
+    
+    // How far incremental syncs of one device storage have got, in the
+    // device's own terms: the newest modification date and the highest
+    // object id among the files synced from it
+    struct SyncWatermark {
+        uint32_t storage_id = 0;
+        uint64_t modification_date = 0;
+        ObjectId object_id = 0;
+    };
+    std::vector<SyncWatermark> getSyncWatermarks(const std::string& device_serial);
+    // Writes the given storages' watermarks in one transaction
+    bool saveSyncWatermarks(const std::string& device_serial,
+                            const std::vector<SyncWatermark>& watermarks);
+    
     // Query operations
     std::string getLocalPath(const std::string& hash);
-    uint64_t getLastSyncTime();
-    bool setLastSyncTime(uint64_t timestamp);
+    // Device read rate in bytes per second measured by earlier syncs; 0 if never measured
+    double getLinkRate(const std::string& device_serial);
+    bool setLinkRate(const std::string& device_serial, double bytes_per_second);
     
     // Statistics
     int getPhotoCount();
     uint64_t getTotalSizeTransferred();
 
     // Error handling
-    std::string getLastError() const { return last_error_; }
+    std::string getLastError() const {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        return last_error_;
+    }
 
 private:
     sqlite3* db_;
     std::string last_error_;
     std::string db_path_;
+    mutable std::recursive_mutex mutex_;
 
     void setError(const std::string& error);
     bool executeSQL(const std::string& sql);
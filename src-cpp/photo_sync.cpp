@@ -1,16 +1,8 @@
 #include "photo_sync.h"
 #include <iostream>
 #include <algorithm>
-#include <ctime>
 #include <cstdint>
-#include <cstdio>
-
-#ifdef _WIN32
-#include <io.h>
-#define unlink _unlink
-#else
-#include <unistd.h>
-#endif
+#include <set>
 
 using namespace std;
 
@@ -19,100 +11,194 @@ PhotoSync::PhotoSync(DeviceHandler* device, PhotoDB* db, const string& destinati
       new_photos_(0), skipped_photos_(0), failed_photos_(0) {
 }
 
-PhotoSync::SyncResult PhotoSync::syncPhotos(bool only_new) {
-    SyncResult result = {0, 0, 0, 0, 0, 0};
+namespace {
+
+string formatDuration(double seconds) {
+    uint64_t total = static_cast<uint64_t>(seconds + 0.5);
+    if (total < 60) {
+        return to_string(total) + "s";
+    }
+    if (total < 3600) {
+        return to_string(total / 60) + "m " + to_string(total % 60) + "s";
+    }
+    return to_string(total / 3600) + "h " + to_string(total % 3600 / 60) + "m";
+}
+
+void printPlan(const SyncPlan& plan, SyncPlanner::Order order) {
+    cout << "\nPlan (" << SyncPlanner::getOrderName(order) << " order): "
+         << plan.copy_count << " to copy, " << plan.resume_count << " to resume, "
+         << plan.verify_count << " to verify, " << plan.skip_count << " to skip" << endl;
+    cout << "To read: " << (plan.total_bytes / (1024.0 * 1024.0)) << " MB, about "
+         << formatDuration(plan.estimated_seconds) << " at "
+         << (plan.link_rate / (1024.0 * 1024.0)) << " MB/s"
+         << (plan.link_rate_measured ? " (measured)" : " (assumed)") << endl;
+}
+
+} // namespace
+
+SyncPlan PhotoSync::planSync(bool only_new, SyncPlanner::Order order) {
+    return makePlan(only_new, order, nullptr, 0);
+}
+
+SyncPlan PhotoSync::readInto(SyncEngine& engine, size_t device, bool only_new,
+                             SyncPlanner::Order order) {
+    return makePlan(only_new, order, &engine, device);
+}
+
+SyncPlan PhotoSync::makePlan(bool only_new, SyncPlanner::Order order, SyncEngine* engine,
+                             size_t device) {
+    SyncPlan plan;
     
     if (!device_handler_ || !device_handler_->isConnected()) {
         cerr << "Error: Device not connected" << endl;
-        return result;
-    }
-    
-    if (!db_ || !db_->isOpen()) {
-        cerr << "Error: Database not open" << endl;
-        return result;
+        return plan;
     }
     
     // Expand destination folder path
     string dest = Utils::expandPath(destination_folder_);
-    if (!Utils::createDirectory(dest)) {
-        cerr << "Error: Failed to create destination directory: " << dest << endl;
-        return result;
-    }
+    bool have_db = db_ && db_->isOpen();
     
-    cout << "\n=== Starting Photo Sync ===" << endl;
+    cout << "\n=== Planning Photo Sync ===" << endl;
     cout << "Device Type: " << DeviceHandler::getDeviceTypeName(device_handler_->getDeviceType()) << endl;
     cout << "Destination: " << dest << endl;
     cout << "Mode: " << (only_new ? "New photos/videos only" : "All photos/videos") << endl;
     
-    // Get last sync time
-    uint64_t last_sync = 0;
+    // Where earlier syncs of this device's storages got to
+    string serial = device_handler_->getSerialNumber();
+    vector<PhotoDB::SyncWatermark> watermarks;
+    if (have_db && !serial.empty()) {
+        watermarks = db_->getSyncWatermarks(serial);
+    }
+    watermarks_ = make_unique<WatermarkTracker>(watermarks,
+                                                device_handler_->hasIncreasingObjectIds());
     if (only_new) {
-        last_sync = db_->getLastSyncTime();
-        if (last_sync > 0) {
-            cout << "Last sync: " << Utils::formatDate(last_sync) << endl;
-        } else {
-            cout << "First sync - will transfer all photos" << endl;
+        if (watermarks.empty()) {
+            cout << "First sync of this device - will transfer all photos" << endl;
+        }
+        for (const auto& watermark : watermarks) {
+            cout << "Storage " << watermark.storage_id << " synced up to "
+                 << Utils::formatDate(watermark.modification_date) << endl;
         }
     }
     
     // Enumerate photos and videos from device
     cout << "\nEnumerating photos and videos from device..." << endl;
     vector<MediaInfo> photos = device_handler_->enumerateMedia();
-    result.total_photos = photos.size();
+    if (device_handler_->objectIdsRenumbered()) {
+        watermarks_->resetObjectIds();
+    }
+    size_t device_files = photos.size();
     
     cout << "Found " << photos.size() << " photos/videos on device" << endl;
     
-    if (photos.empty()) {
-        cout << "No photos to sync" << endl;
-        return result;
-    }
-    
     // Filter photos if only_new
-    if (only_new && last_sync > 0) {
+    if (only_new && !watermarks.empty()) {
         vector<MediaInfo> new_photos;
         for (const auto& photo : photos) {
-            if (photo.modification_date > last_sync) {
+            if (watermarks_->isNew(photo)) {
                 new_photos.push_back(photo);
             }
         }
         photos = new_photos;
-        cout << "Filtered to " << photos.size() << " new photos (modified after last sync)" << endl;
+        cout << "Filtered to " << photos.size() << " new photos (past the sync watermarks)" << endl;
     }
     
-    // Transfer photos and videos
-    cout << "\nTransferring photos and videos..." << endl;
-    int transferred = 0;
-    int skipped = 0;
-    int failed = 0;
-    uint64_t total_size = 0;
-    uint64_t transferred_size = 0;
-    
-    for (size_t i = 0; i < photos.size(); i++) {
-        const auto& photo = photos[i];
-        total_size += photo.file_size;
-        
-        // Progress indicator
-        if ((i + 1) % 10 == 0 || i == photos.size() - 1) {
-            cout << "  Progress: " << (i + 1) << "/" << photos.size() 
-                 << " (" << ((i + 1) * 100 / photos.size()) << "%)" << endl;
-        }
-        
-        if (transferPhoto(photo)) {
-            transferred++;
-            transferred_size += photo.file_size;
-        } else {
-            // Check if it was skipped or failed
-            if (shouldTransferPhoto(photo, only_new)) {
-                failed++;
-            } else {
-                skipped++;
-            }
+    // One scan of the destination answers every existence check of the sync
+    if (!shared_index_) {
+        index_.build(dest);
+        cout << "Indexed " << index_.getFileCount() << " files in destination" << endl;
+    }
+    
+    // Destination folders come from capture dates, probed ahead of the planner
+    SyncPlanner planner(db_, serial,
+        [this](const MediaInfo& photo) { return generateLocalPath(photo); },
+        destinationIndex());
+    if (have_db && !serial.empty()) {
+        planner.setLinkRate(db_->getLinkRate(serial));
+    }
+    planner.setCaptureDates([this](const MediaInfo& photo) {
+        return capture_probe_->captureDate(photo);
+    });
+    
+    capture_probe_ = make_unique<CaptureDateProbe>(device_handler_, photos);
+    if (engine && order == SyncPlanner::Order::DEVICE) {
+        // Each file is read as soon as it is planned, so the probe dates the
+        // files after it while it transfers instead of before the first one
+        cout << "\nTransferring photos and videos..." << endl;
+        engine->expect(photos.size());
+        planner.planEach(photos, plan, [&](const PlannedFile& file) {
+            plan.files.push_back(file);
+            engine->read(device, file);
+        });
+        plan.device_files = device_files;
+        printPlan(plan, order);
+    } else {
+        // Other orders need every file planned before the first is read
+        plan = planner.plan(photos, order);
+        plan.device_files = device_files;
+        printPlan(plan, order);
+        if (engine) {
+            cout << "\nTransferring photos and videos..." << endl;
+            engine->read(device, plan.files);
         }
     }
+    capture_probe_.reset();
     
-    // Update last sync time
-    uint64_t current_time = time(nullptr);
-    db_->setLastSyncTime(current_time);
+    return plan;
+}
+
+PhotoSync::SyncResult PhotoSync::syncPhotos(bool only_new, SyncPlanner::Order order) {
+    SyncResult result = {0, 0, 0, 0, 0, 0};
+    
+    if (!device_handler_ || !device_handler_->isConnected()) {
+        cerr << "Error: Device not connected" << endl;
+        return result;
+    }
+    
+    if (!db_ || !db_->isOpen()) {
+        cerr << "Error: Database not open" << endl;
+        return result;
+    }
+    
+    string dest = Utils::expandPath(destination_folder_);
+    if (!Utils::createDirectory(dest)) {
+        cerr << "Error: Failed to create destination directory: " << dest << endl;
+        return result;
+    }
+    
+    SyncEngine* engine = nullptr;
+    {
+        lock_guard<mutex> lock(engine_mutex_);
+        engine_ = make_unique<SyncEngine>(device_handler_, db_, destinationIndex(),
+                                          engine_options_);
+        engine = engine_.get();
+    }
+    
+    // Transfers start while the rest of the plan is still being made
+    engine->start();
+    SyncPlan plan = readInto(*engine, 0, only_new, order);
+    SyncEngine::Result engine_result = engine->finish()[0];
+    result.total_photos = plan.device_files;
+    
+    if (plan.files.empty()) {
+        cout << "No photos to sync" << endl;
+        return result;
+    }
+    
+    uint64_t total_size = 0;
+    for (const auto& file : plan.files) {
+        total_size += file.media.file_size;
+    }
+    
+    int transferred = engine_result.transferred;
+    int skipped = engine_result.skipped;
+    int failed = engine_result.failed;
+    uint64_t transferred_size = engine_result.transferred_size;
+    new_photos_ += transferred;
+    skipped_photos_ += skipped;
+    failed_photos_ += failed;
+    
+    recordSync(plan, engine_result);
     
     result.new_photos = transferred;
     result.skipped_photos = skipped;
@@ -128,108 +214,71 @@ PhotoSync::SyncResult PhotoSync::syncPhotos(bool only_new) {
     cout << "Total size: " << (result.total_size / (1024.0 * 1024.0)) << " MB" << endl;
     cout << "Transferred: " << (result.transferred_size / (1024.0 * 1024.0)) << " MB" << endl;
     
+    cout << "\nPipeline stages (workers, utilisation, average/peak queue):" << endl;
+    for (const auto& stage : engine->getStageStats()) {
+        cout << "  " << stage.name << ": " << stage.workers << ", "
+             << static_cast<int>(stage.utilisation * 100 + 0.5) << "%, "
+             << stage.average_queue_depth << "/" << stage.max_queue_depth << endl;
+    }
+    
     return result;
 }
 
-bool PhotoSync::transferPhoto(const MediaInfo& photo) {
-    // Check if we should transfer this photo
-    if (!shouldTransferPhoto(photo, true)) {
-        return false; // Already exists, skip
-    }
-    
-    // Read photo from device
-    vector<uint8_t> data;
-    if (!device_handler_->readFile(photo.object_id, data)) {
-        cerr << "  Failed to read photo: " << photo.filename << endl;
-        return false;
+void PhotoSync::recordSync(const SyncPlan& plan, const SyncEngine::Result& engine_result) {
+    if (!db_ || !db_->isOpen()) {
+        return;
     }
-    
-    // Calculate hash
-    string hash = Utils::calculateSHA256(data);
-    
-    // Double-check database (in case it was added between check and transfer)
-    if (db_->photoExists(hash)) {
-        string existing_path = db_->getLocalPath(hash);
-        if (Utils::fileExists(existing_path)) {
-            skipped_photos_++;
-            return false; // Already transferred
-        }
+    recordLinkRate(engine_result);
+    recordWatermarks(plan, engine_result);
+}
+
+void PhotoSync::recordWatermarks(const SyncPlan& plan, const SyncEngine::Result& engine_result) {
+    string serial = device_handler_->getSerialNumber();
+    if (serial.empty() || !watermarks_) {
+        return; // No stable identity for this device
     }
     
-    // Generate local path
-    string local_path = generateLocalPath(photo);
-    
-    // Write file
-    if (!Utils::writeFile(local_path, data)) {
-        cerr << "  Failed to write file: " << local_path << endl;
-        failed_photos_++;
-        return false;
+    set<pair<uint32_t, ObjectId>> failed;
+    for (const auto& photo : engine_result.failed_files) {
+        failed.insert({photo.storage_id, photo.object_id});
     }
-    
-    // Verify transfer
-    if (!verifyTransfer(local_path, data, hash)) {
-        cerr << "  Transfer verification failed: " << local_path << endl;
-        failed_photos_++;
-        // Clean up failed file
-        unlink(local_path.c_str());
-        return false;
+    for (const auto& file : plan.files) {
+        watermarks_->record(file.media,
+                            failed.count({file.media.storage_id, file.media.object_id}) == 0);
     }
     
-    // Update database
-    if (!db_->addPhoto(hash, photo.path, local_path, 
-                       photo.file_size, photo.modification_date)) {
-        cerr << "  Warning: Failed to update database for: " << photo.filename << endl;
-        // File was transferred successfully, so continue
+    if (!db_->saveSyncWatermarks(serial, watermarks_->advanced())) {
+        cerr << "Warning: Failed to save sync watermarks: " << db_->getLastError() << endl;
     }
-    
-    new_photos_++;
-    cout << "  ✓ Transferred: " << photo.filename << " (" 
-         << (photo.file_size / 1024.0) << " KB)" << endl;
-    
-    return true;
 }
 
-bool PhotoSync::shouldTransferPhoto(const MediaInfo& photo, bool only_new) {
-    (void)only_new; // May be used in future for filtering
-    // Read photo to calculate hash
-    vector<uint8_t> data;
-    if (!device_handler_->readFile(photo.object_id, data)) {
-        return false; // Can't read, skip
-    }
-    
-    string hash = Utils::calculateSHA256(data);
-    
-    // Check database
-    if (db_->photoExists(hash)) {
-        string local_path = db_->getLocalPath(hash);
-        // Verify file actually exists
-        if (Utils::fileExists(local_path)) {
-            return false; // Already transferred
-        }
-    }
+void PhotoSync::recordLinkRate(const SyncEngine::Result& engine_result) {
+    string serial = device_handler_->getSerialNumber();
     
-    // Check file system (by hash or by path)
-    string expected_path = generateLocalPath(photo);
-    if (Utils::fileExists(expected_path)) {
-        // File exists, verify it's the same by checking size
-        if (Utils::getFileSize(expected_path) == photo.file_size) {
-            // Might be the same file, add to database if not there
-            if (!db_->photoExists(hash)) {
-                db_->addPhoto(hash, photo.path, expected_path,
-                             photo.file_size, photo.modification_date);
-            }
-            return false; // Already exists
-        }
+    // Too little traffic is dominated by per-file latency, not the link
+    if (serial.empty() || engine_result.bytes_read < MIN_RATE_SAMPLE_BYTES ||
+        engine_result.read_seconds < MIN_RATE_SAMPLE_SECONDS) {
+        return;
     }
     
-    return true; // Should transfer
+    // Blend with earlier runs so one slow sync does not swing the estimate
+    double measured = engine_result.bytes_read / engine_result.read_seconds;
+    double previous = db_->getLinkRate(serial);
+    double rate = previous > 0 ? (previous + measured) / 2 : measured;
+    db_->setLinkRate(serial, rate);
+}
+
+vector<SyncStageStats> PhotoSync::getStageStats() const {
+    lock_guard<mutex> lock(engine_mutex_);
+    return engine_ ? engine_->getStageStats() : vector<SyncStageStats>();
 }
 
 string PhotoSync::generateLocalPath(const MediaInfo& photo) {
     string dest = Utils::expandPath(destination_folder_);
     
-    // Organize by date: YYYY/MM/filename
-    string date_folder = Utils::getDateFolder(photo.modification_date);
+    // Organize by capture date where the file header has one: YYYY/MM/filename
+    uint64_t date = photo.capture_date != 0 ? photo.capture_date : photo.modification_date;
+    string date_folder = Utils::getDateFolder(date);
     string folder = Utils::joinPath(dest, date_folder);
     
     // Use original filename
@@ -243,25 +292,3 @@ string PhotoSync::generateLocalPath(const MediaInfo& photo) {
     
     return Utils::joinPath(folder, filename);
 }
-
-bool PhotoSync::verifyTransfer(const string& local_path, 
-                               const vector<uint8_t>& original_data,
-                               const string& expected_hash) {
-    // Verify file exists
-    if (!Utils::fileExists(local_path)) {
-        return false;
-    }
-    
-    // Verify file size
-    if (Utils::getFileSize(local_path) != original_data.size()) {
-        return false;
-    }
-    
-    // Verify hash (optional but recommended)
-    string file_hash = Utils::calculateFileHash(local_path);
-    if (file_hash != expected_hash) {
-        return false;
-    }
-    
-    return true;
-}
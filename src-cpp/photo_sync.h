@@ -4,11 +4,21 @@
 #include "device_handler.h"
 #include "photo_db.h"
 #include "utils.h"
+#include "capture_date_probe.h"
+#include "sync_engine.h"
+#include "sync_planner.h"
+#include "sync_watermark.h"
+#include "destination_index.h"
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
 
 /**
  * Photo/video synchronization handler
- * Works with any DeviceHandler implementation (Android MTP or iOS)
+ * Works with any DeviceHandler implementation (Android MTP or iOS).
+ * syncPhotos() plans the run with a SyncPlanner and moves the files through
+ * a SyncEngine pipeline.
  */
 class PhotoSync {
 public:
@@ -24,16 +34,41 @@ public:
         uint64_t transferred_size;
     };
     
-    SyncResult syncPhotos(bool only_new = true);
-    bool transferPhoto(const MediaInfo& photo);
+    // Classification of a single photo after its one pass over the device
+    enum class TransferOutcome {
+        TRANSFERRED,
+        SKIPPED,
+        FAILED
+    };
+    
+    // Works out what syncPhotos() would do, reading nothing but the listing
+    // and capture date headers. The database may be closed.
+    SyncPlan planSync(bool only_new = true,
+                      SyncPlanner::Order order = SyncPlanner::Order::DEVICE);
+    SyncResult syncPhotos(bool only_new = true,
+                          SyncPlanner::Order order = SyncPlanner::Order::DEVICE);
+    // Plans the sync and has a started engine read the files as the given
+    // device. In device order each file is read as soon as it is planned.
+    SyncPlan readInto(SyncEngine& engine, size_t device, bool only_new = true,
+                      SyncPlanner::Order order = SyncPlanner::Order::DEVICE);
+    // Saves the watermarks and link rate of a plan carried out by an engine
+    // the caller ran, as syncPhotos() does for its own
+    void recordSync(const SyncPlan& plan, const SyncEngine::Result& engine_result);
     
     // Configuration
     void setDestinationFolder(const std::string& folder) { destination_folder_ = folder; }
     std::string getDestinationFolder() const { return destination_folder_; }
+    void setEngineOptions(const SyncEngine::Options& options) { engine_options_ = options; }
+    // Plans against an index the caller built and shares with other
+    // devices' syncs, instead of scanning the destination again
+    void shareDestinationIndex(DestinationIndex* index) { shared_index_ = index; }
     
     // Statistics
     int getNewPhotoCount() const { return new_photos_; }
     int getSkippedPhotoCount() const { return skipped_photos_; }
+    // Load on each pipeline stage of the running or last sync; callable
+    // from another thread while syncPhotos() runs
+    std::vector<SyncStageStats> getStageStats() const;
     
 private:
     DeviceHandler* device_handler_;
@@ -44,10 +79,31 @@ private:
     int skipped_photos_;
     int failed_photos_;
     
+    // Reads capture dates ahead of the planner, and so, in device order,
+    // alongside the engine's reads
+    std::unique_ptr<CaptureDateProbe> capture_probe_;
+    
+    // This device's watermarks, from planSync() until the sync records them
+    std::unique_ptr<WatermarkTracker> watermarks_;
+    
+    // The destination folder as planSync() found it, kept current by the sync
+    DestinationIndex index_;
+    DestinationIndex* shared_index_ = nullptr;
+    
+    SyncEngine::Options engine_options_;
+    std::unique_ptr<SyncEngine> engine_;
+    mutable std::mutex engine_mutex_;
+    
+    // Smallest read that says something about the link speed
+    static constexpr uint64_t MIN_RATE_SAMPLE_BYTES = 16 * 1024 * 1024;
+    static constexpr double MIN_RATE_SAMPLE_SECONDS = 1.0;
+    
     // Helper functions
+    SyncPlan makePlan(bool only_new, SyncPlanner::Order order, SyncEngine* engine, size_t device);
+    DestinationIndex& destinationIndex() { return shared_index_ ? *shared_index_ : index_; }
     std::string generateLocalPath(const MediaInfo& photo);
-    bool shouldTransferPhoto(const MediaInfo& photo, bool only_new);
-    bool verifyTransfer(const std::string& local_path, const std::vector<uint8_t>& data, const std::string& expected_hash);
+    void recordLinkRate(const SyncEngine::Result& engine_result);
+    void recordWatermarks(const SyncPlan& plan, const SyncEngine::Result& engine_result);
 };
 
 #endif // PHOTO_SYNC_H
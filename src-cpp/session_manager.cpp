@@ -0,0 +1,198 @@
+#include "session_manager.h"
+#include "utils.h"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+
+#ifdef ENABLE_ANDROID
+    #ifndef USE_WPD
+        #include "mtp_handler.h"
+    #endif
+#endif
+
+#ifdef ENABLE_IOS
+#include "ios_handler.h"
+#endif
+
+using namespace std;
+
+SessionManager::SessionManager(PhotoDB* db, const string& destination_folder)
+    : db_(db), destination_folder_(destination_folder),
+      writer_threads_(max(2u, thread::hardware_concurrency())) {
+}
+
+SessionManager::~SessionManager() {
+    disconnectAll(false);
+}
+
+size_t SessionManager::connectAll(bool auto_unmount) {
+    disconnectAll(false);
+
+#if defined(ENABLE_ANDROID) && !defined(USE_WPD)
+    {
+        MTPHandler detector;
+        if (detector.detectDevices()) {
+            // Release every phone from the desktop's MTP mounts in one go;
+            // each connect then waits for its own device to be let go
+            if (auto_unmount && MTPHandler::hasGvfsMTPMounts()) {
+                cout << "Releasing MTP devices from GVFS..." << endl;
+                MTPHandler::releaseGvfsMounts();
+            }
+
+            for (const auto& name : detector.getDetectedDevices()) {
+                auto handler = make_unique<MTPHandler>();
+                handler->setPathFilter(path_filter_);
+                if (handler->connectToDevice(name, false)) {
+                    addSession(move(handler));
+                } else {
+                    cerr << "Failed to open MTP device " << name << ": "
+                         << handler->getLastError() << endl;
+                }
+            }
+        }
+    }
+#else
+    (void)auto_unmount;
+#endif
+
+#ifdef ENABLE_IOS
+    {
+        iOSHandler detector;
+        if (detector.detectDevices()) {
+            for (const auto& udid : detector.getDetectedDevices()) {
+                auto handler = make_unique<iOSHandler>();
+                handler->setPathFilter(path_filter_);
+                handler->setConnectionPoolSize(afc_connections_);
+                if (handler->connectToDevice(udid)) {
+                    addSession(move(handler));
+                } else {
+                    cerr << "Failed to open iOS device " << udid << ": "
+                         << handler->getLastError() << endl;
+                }
+            }
+        }
+    }
+#endif
+
+    return sessions_.size();
+}
+
+void SessionManager::addSession(unique_ptr<DeviceHandler> handler) {
+    auto session = make_unique<Session>();
+    session->result.device_name = handler->getDeviceName();
+    session->result.serial = handler->getSerialNumber();
+    session->handler = move(handler);
+    sessions_.push_back(move(session));
+}
+
+void SessionManager::disconnectAll(bool auto_unmount) {
+    bool had_mtp = false;
+    for (auto& session : sessions_) {
+        had_mtp = had_mtp || session->handler->getDeviceType() == DeviceType::ANDROID;
+        session->handler->disconnect(false);
+    }
+    sessions_.clear();
+
+#if defined(ENABLE_ANDROID) && !defined(USE_WPD)
+    if (auto_unmount && had_mtp) {
+        MTPHandler::unmountMTPDevices();
+    }
+#else
+    (void)auto_unmount;
+    (void)had_mtp;
+#endif
+}
+
+vector<string> SessionManager::getSerialNumbers() const {
+    vector<string> serials;
+    for (const auto& session : sessions_) {
+        serials.push_back(session->handler->getSerialNumber());
+    }
+    return serials;
+}
+
+vector<SessionManager::DeviceResult> SessionManager::syncAll(bool only_new) {
+    vector<DeviceResult> results;
+
+    if (sessions_.empty()) {
+        cerr << "Error: No devices connected" << endl;
+        return results;
+    }
+
+    if (!db_ || !db_->isOpen()) {
+        cerr << "Error: Database not open" << endl;
+        return results;
+    }
+
+    string dest = Utils::expandPath(destination_folder_);
+    if (!Utils::createDirectory(dest)) {
+        cerr << "Error: Failed to create destination directory: " << dest << endl;
+        return results;
+    }
+
+    cout << "\n=== Syncing " << sessions_.size() << " devices ===" << endl;
+    cout << "Destination: " << dest << endl;
+    cout << "Writer threads: " << writer_threads_ << endl;
+
+    // Shared by every device's planner and the engine
+    index_.build(dest);
+    cout << "Indexed " << index_.getFileCount() << " files in destination" << endl;
+
+    SyncEngine::Options options;
+    options.hasher_threads = writer_threads_;
+    options.writer_threads = writer_threads_;
+    SyncEngine engine(db_, index_, options);
+
+    for (auto& session : sessions_) {
+        DeviceResult fresh;
+        fresh.device_name = session->result.device_name;
+        fresh.serial = session->result.serial;
+        session->result = fresh;
+        session->plan = SyncPlan();
+        session->sync = make_unique<PhotoSync>(session->handler.get(), db_, destination_folder_);
+        session->sync->shareDestinationIndex(&index_);
+        session->engine_device = engine.addDevice(session->handler.get(),
+                                                  session->result.device_name);
+    }
+
+    engine.start();
+    vector<thread> readers;
+    for (auto& session : sessions_) {
+        readers.emplace_back(&SessionManager::readDevice, this, ref(*session), ref(engine),
+                             only_new);
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    vector<SyncEngine::Result> engine_results = engine.finish();
+
+    for (const auto& session : sessions_) {
+        const SyncEngine::Result& engine_result = engine_results[session->engine_device];
+        session->sync->recordSync(session->plan, engine_result);
+        session->sync.reset();
+
+        session->result.new_photos = engine_result.transferred;
+        session->result.skipped_photos = engine_result.skipped;
+        session->result.failed_photos = engine_result.failed;
+        session->result.transferred_size = engine_result.transferred_size;
+        results.push_back(session->result);
+    }
+    index_.clear();
+    return results;
+}
+
+void SessionManager::readDevice(Session& session, SyncEngine& engine, bool only_new) {
+    DeviceHandler* handler = session.handler.get();
+    const string& serial = session.result.serial;
+
+    // Refresh from this device's last walk where there is one
+    EnumerationSnapshot snapshot;
+    if (!serial.empty() && db_->loadEnumerationSnapshot(serial, snapshot)) {
+        handler->setEnumerationSnapshot(snapshot);
+    }
+    session.plan = session.sync->readInto(engine, session.engine_device, only_new);
+    if (!serial.empty()) {
+        db_->saveEnumerationSnapshot(serial, handler->getEnumerationSnapshot());
+    }
+    session.result.total_photos = static_cast<int>(session.plan.device_files);
+}
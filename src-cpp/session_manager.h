@@ -0,0 +1,79 @@
+#ifndef SESSION_MANAGER_H
+#define SESSION_MANAGER_H
+
+#include "device_handler.h"
+#include "photo_db.h"
+#include "photo_sync.h"
+#include "sync_engine.h"
+#include "destination_index.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+/**
+ * Syncs every connected MTP and iOS device at once.
+ *
+ * Each device is enumerated, planned and read by its own thread, so USB
+ * transfers from different phones overlap instead of queuing behind one
+ * another. All devices feed one SyncEngine, whose hasher, writer and commit
+ * stages are shared, so content is identified and deduplicated across
+ * every device by the same code as a single-device sync.
+ */
+class SessionManager {
+public:
+    // Outcome of one device's sync
+    struct DeviceResult {
+        std::string device_name;
+        std::string serial;
+        int total_photos = 0;
+        int new_photos = 0;
+        int skipped_photos = 0;
+        int failed_photos = 0;
+        uint64_t transferred_size = 0;
+    };
+
+    SessionManager(PhotoDB* db, const std::string& destination_folder);
+    ~SessionManager();
+
+    // Opens every detected MTP and iOS device; returns how many were opened
+    size_t connectAll(bool auto_unmount = true);
+    void disconnectAll(bool auto_unmount = true);
+    size_t getSessionCount() const { return sessions_.size(); }
+    std::vector<std::string> getSerialNumbers() const;
+
+    // Configuration, applied to devices opened afterwards
+    void setPathFilter(const PathFilter& filter) { path_filter_ = filter; }
+    void setAfcConnections(size_t count) { afc_connections_ = count; }
+    void setWriterThreads(size_t count) { writer_threads_ = count < 1 ? 1 : count; }
+
+    // Reads all devices concurrently through the shared pipeline stages
+    std::vector<DeviceResult> syncAll(bool only_new = true);
+
+private:
+    struct Session {
+        std::unique_ptr<DeviceHandler> handler;
+        DeviceResult result;
+        // Set for the length of a sync
+        std::unique_ptr<PhotoSync> sync;
+        SyncPlan plan;
+        size_t engine_device = 0;
+    };
+
+    PhotoDB* db_;
+    std::string destination_folder_;
+    PathFilter path_filter_ = PathFilter::defaults();
+    size_t afc_connections_ = 4;
+    size_t writer_threads_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+
+    // The destination folder, scanned once at the start of syncAll()
+    DestinationIndex index_;
+
+    void addSession(std::unique_ptr<DeviceHandler> handler);
+
+    // Plans one device, feeding each file to the engine as it is planned
+    void readDevice(Session& session, SyncEngine& engine, bool only_new);
+};
+
+#endif // SESSION_MANAGER_H
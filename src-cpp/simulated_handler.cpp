@@ -0,0 +1,530 @@
+#include "simulated_handler.h"
+#include "utils.h"
+#include "media_types.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+// Synthetic files are dated one minute apart from 2024-01-01 00:00 UTC
+static const uint64_t SYNTHETIC_START_TIME = 1704067200;
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static bool parseSize(const string& value, uint64_t& size) {
+    size_t consumed = 0;
+    double number = stod(value, &consumed);
+    string suffix = value.substr(consumed);
+    uint64_t unit = 1;
+    if (suffix == "K" || suffix == "k") unit = 1024;
+    else if (suffix == "M" || suffix == "m") unit = 1024 * 1024;
+    else if (suffix == "G" || suffix == "g") unit = 1024ULL * 1024 * 1024;
+    else if (!suffix.empty()) return false;
+    if (number < 0) return false;
+    size = static_cast<uint64_t>(number * unit);
+    return true;
+}
+
+bool SimulatedHandler::Options::parse(const string& spec, Options& options, string& error) {
+    if (!isSpec(spec)) {
+        error = "Not a simulated device: " + spec;
+        return false;
+    }
+
+    stringstream tokens(spec.size() > 4 ? spec.substr(4) : "");
+    string token;
+    while (getline(tokens, token, ',')) {
+        if (token.empty()) {
+            continue;
+        }
+        size_t equals = token.find('=');
+        if (equals == string::npos) {
+            options.root = token;
+            continue;
+        }
+
+        string key = token.substr(0, equals);
+        string value = token.substr(equals + 1);
+        bool valid = true;
+        try {
+            if (key == "files") {
+                options.file_count = stoull(value);
+            } else if (key == "size") {
+                valid = parseSize(value, options.file_size);
+            } else if (key == "dup") {
+                options.duplicate_rate = stod(value);
+                valid = options.duplicate_rate >= 0 && options.duplicate_rate <= 1;
+            } else if (key == "latency") {
+                options.latency_ms = stod(value);
+                valid = options.latency_ms >= 0;
+            } else if (key == "bandwidth") {
+                options.bandwidth_mbps = stod(value);
+                valid = options.bandwidth_mbps >= 0;
+            } else if (key == "fail") {
+                options.failure_rate = stod(value);
+                valid = options.failure_rate >= 0 && options.failure_rate <= 1;
+            } else if (key == "stall") {
+                options.stall_rate = stod(value);
+                valid = options.stall_rate >= 0 && options.stall_rate <= 1;
+            } else if (key == "seed") {
+                options.seed = static_cast<uint32_t>(stoul(value));
+            } else {
+                error = "Unknown simulated device option: " + key;
+                return false;
+            }
+        } catch (const exception&) {
+            valid = false;
+        }
+        if (!valid) {
+            error = "Invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+SimulatedHandler::SimulatedHandler(const Options& options)
+    : options_(options), failure_rng_(options.seed),
+      link_free_at_(chrono::steady_clock::now()) {
+}
+
+bool SimulatedHandler::isSpec(const string& device_type) {
+    return device_type == "sim" || device_type.compare(0, 4, "sim:") == 0;
+}
+
+void SimulatedHandler::setError(const string& error) {
+    lock_guard<mutex> lock(mutex_);
+    last_error_ = error;
+    cerr << "Simulated device error: " << error << endl;
+}
+
+string SimulatedHandler::getLastError() const {
+    lock_guard<mutex> lock(mutex_);
+    return last_error_;
+}
+
+uint64_t SimulatedHandler::getOperationCount() const {
+    lock_guard<mutex> lock(mutex_);
+    return operations_;
+}
+
+uint64_t SimulatedHandler::getBytesRead() const {
+    lock_guard<mutex> lock(mutex_);
+    return bytes_read_;
+}
+
+bool SimulatedHandler::detectDevices() {
+    operation();
+    if (!options_.root.empty() && !Utils::fileExists(options_.root)) {
+        setError("Simulated device folder not found: " + options_.root);
+        detected_ = false;
+        return false;
+    }
+    detected_ = true;
+    return true;
+}
+
+vector<string> SimulatedHandler::getDetectedDevices() const {
+    if (!detected_) {
+        return {};
+    }
+    return {"sim"};
+}
+
+bool SimulatedHandler::connectToDevice(const string& device_name, bool auto_unmount) {
+    (void)device_name;
+    (void)auto_unmount;
+
+    if (!detected_ && !detectDevices()) {
+        return false;
+    }
+    operation();
+
+    entries_.clear();
+    index_.clear();
+    if (options_.root.empty()) {
+        buildSyntheticTree();
+        serial_number_ = "SIM-" + to_string(options_.seed) + "-" + to_string(options_.file_count);
+    } else {
+        buildFolderTree();
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : options_.root) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+        }
+        char serial[32];
+        snprintf(serial, sizeof(serial), "SIM-%016llx", static_cast<unsigned long long>(hash));
+        serial_number_ = serial;
+    }
+
+    connected_ = true;
+    cout << "Connected to device: " << getDeviceName()
+         << " (" << entries_.size() << " files)" << endl;
+    return true;
+}
+
+void SimulatedHandler::disconnect(bool auto_unmount) {
+    (void)auto_unmount;
+    entries_.clear();
+    index_.clear();
+    serial_number_.clear();
+    connected_ = false;
+}
+
+string SimulatedHandler::getDeviceName() const {
+    return "Simulated " + getDeviceModel();
+}
+
+string SimulatedHandler::getDeviceModel() const {
+    if (options_.root.empty()) {
+        return "synthetic device";
+    }
+    string root = options_.root;
+    while (root.size() > 1 && (root.back() == '/' || root.back() == '\\')) {
+        root.pop_back();
+    }
+    size_t slash = root.find_last_of("/\\");
+    return slash == string::npos ? root : root.substr(slash + 1);
+}
+
+vector<DeviceStorageInfo> SimulatedHandler::getStorageInfo() const {
+    vector<DeviceStorageInfo> storages;
+    if (!connected_) {
+        return storages;
+    }
+
+    uint64_t used = 0;
+    for (const auto& entry : entries_) {
+        used += entry.info.file_size;
+    }
+
+    DeviceStorageInfo info;
+    info.storage_id = STORAGE_ID;
+    info.description = "Simulated storage";
+    info.max_capacity = used * 2;
+    info.free_space = used;
+    info.storage_type = 0x0003; // Fixed RAM
+    storages.push_back(info);
+    return storages;
+}
+
+void SimulatedHandler::buildSyntheticTree() {
+    mt19937_64 rng(options_.seed);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    uint64_t average = max<uint64_t>(options_.file_size, 1);
+
+    for (size_t i = 0; i < options_.file_count; i++) {
+        // Mostly camera photos, every tenth a video, some screenshots
+        bool video = i % 10 == 9;
+        bool screenshot = !video && i % 7 == 3;
+        char name[48];
+        snprintf(name, sizeof(name), video ? "VID_%06zu.mp4" : screenshot ? "Screenshot_%06zu.png" : "IMG_%06zu.jpg", i);
+
+        // A duplicate repeats the size and content of an earlier file
+        size_t source = i;
+        if (i > 0 && options_.duplicate_rate > 0 && unit(rng) < options_.duplicate_rate) {
+            source = rng() % i;
+        }
+
+        Entry entry;
+        entry.content_seed = splitmix64((static_cast<uint64_t>(options_.seed) << 32) ^ source);
+        entry.info.filename = name;
+        entry.info.path = string(screenshot ? "/Pictures/Screenshots/" : "/DCIM/Camera/") + name;
+        entry.info.file_size = average / 2 + entry.content_seed % average;
+        entry.info.modification_date = SYNTHETIC_START_TIME + i * 60;
+        entry.info.mime_type = MediaTypes::getMimeType(name);
+        entry.info.storage_id = STORAGE_ID;
+        addEntry(move(entry));
+    }
+}
+
+void SimulatedHandler::buildFolderTree() {
+    namespace fs = std::filesystem;
+
+    error_code ec;
+    fs::path root(options_.root);
+    for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+
+        string filename = it->path().filename().string();
+        const MediaTypes::MediaType* type = MediaTypes::classify(filename);
+        if (type == nullptr) {
+            continue;
+        }
+
+        Entry entry;
+        entry.local_path = it->path().string();
+        entry.info.filename = filename;
+        entry.info.path = "/" + it->path().lexically_relative(root).generic_string();
+        entry.info.file_size = it->file_size(ec);
+        entry.info.modification_date = Utils::getFileModificationTime(entry.local_path);
+        entry.info.mime_type = type->mime_type;
+        entry.info.storage_id = STORAGE_ID;
+        addEntry(move(entry));
+    }
+
+    // Walk order is filesystem dependent; phones list in a stable order
+    sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+        return a.info.path < b.info.path;
+    });
+    index_.clear();
+    for (size_t i = 0; i < entries_.size(); i++) {
+        index_[entries_[i].info.object_id] = i;
+    }
+}
+
+void SimulatedHandler::addEntry(Entry entry) {
+    // FNV-1a over the path, size and mtime, as the iOS backend does
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    mix(entry.info.path.data(), entry.info.path.size());
+    mix(&entry.info.file_size, sizeof(entry.info.file_size));
+    mix(&entry.info.modification_date, sizeof(entry.info.modification_date));
+
+    ObjectId object_id = hash;
+    while (index_.count(object_id)) {
+        object_id++;
+    }
+
+    entry.info.object_id = object_id;
+    index_[object_id] = entries_.size();
+    entries_.push_back(move(entry));
+}
+
+const SimulatedHandler::Entry* SimulatedHandler::findEntry(ObjectId object_id) {
+    auto found = index_.find(object_id);
+    if (found == index_.end()) {
+        setError("Object not found: " + to_string(object_id));
+        return nullptr;
+    }
+    return &entries_[found->second];
+}
+
+vector<MediaInfo> SimulatedHandler::enumerateMedia(const string& directory_path) {
+    vector<MediaInfo> media;
+    if (!connected_) {
+        setError("Not connected to device");
+        return media;
+    }
+
+    string prefix = directory_path;
+    if (!prefix.empty() && prefix[0] != '/') {
+        prefix = "/" + prefix;
+    }
+
+    // One operation per folder listed and per file, like a stat per entry
+    unordered_map<string, bool> folders;
+    for (const auto& entry : entries_) {
+        const string& path = entry.info.path;
+        if (!prefix.empty() && path.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+
+        size_t slash = path.find_last_of('/');
+        string folder = slash > 0 ? path.substr(1, slash - 1) : "";
+        auto listed = folders.find(folder);
+        if (listed == folders.end()) {
+            bool descend = folder.empty() || path_filter_.shouldDescend(folder);
+            if (descend) {
+                operation();
+            }
+            listed = folders.emplace(folder, descend).first;
+        }
+        if (!listed->second) {
+            continue;
+        }
+
+        operation();
+        if (path_filter_.shouldInclude(path.substr(1))) {
+            media.push_back(entry.info);
+        }
+    }
+    return media;
+}
+
+bool SimulatedHandler::readFile(ObjectId object_id, vector<uint8_t>& data) {
+    data.clear();
+    return readFileChunked(object_id, [&data](const uint8_t* chunk, size_t size) {
+        data.insert(data.end(), chunk, chunk + size);
+        return true;
+    });
+}
+
+bool SimulatedHandler::readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                                       const CancellationToken* cancel) {
+    const Entry* entry = findEntry(object_id);
+    if (entry == nullptr) {
+        return false;
+    }
+
+    operation();
+    uint64_t size = entry->info.file_size;
+    // An injected failure or stall strikes at the chunk holding the middle
+    // of the file, so larger files fail after some data has arrived
+    bool fail = inject(options_.failure_rate);
+    bool stalls = inject(options_.stall_rate);
+
+    vector<uint8_t> chunk;
+    uint64_t offset = 0;
+    do {
+        size_t length = static_cast<size_t>(min<uint64_t>(CHUNK_SIZE, size - offset));
+        if (fail && offset + length >= size / 2) {
+            setError("Simulated read failure: " + entry->info.path);
+            return false;
+        }
+        if (stalls && offset + length >= size / 2) {
+            return stall(*entry, cancel);
+        }
+        if (isCancelled(cancel)) {
+            setError(string("Read ") + cancel->reason() + ": " + entry->info.path);
+            return false;
+        }
+        if (length == 0) {
+            break;
+        }
+
+        operation();
+        transfer(length);
+        if (!readContent(*entry, offset, length, chunk)) {
+            return false;
+        }
+        if (!sink(chunk.data(), chunk.size())) {
+            setError("Read aborted by receiver: " + entry->info.path);
+            return false;
+        }
+        offset += length;
+    } while (offset < size);
+
+    return true;
+}
+
+bool SimulatedHandler::readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                                 vector<uint8_t>& data, const CancellationToken* cancel) {
+    const Entry* entry = findEntry(object_id);
+    if (entry == nullptr) {
+        return false;
+    }
+
+    operation();
+    if (inject(options_.failure_rate)) {
+        setError("Simulated read failure: " + entry->info.path);
+        return false;
+    }
+    if (inject(options_.stall_rate)) {
+        return stall(*entry, cancel);
+    }
+    if (isCancelled(cancel)) {
+        setError(string("Read ") + cancel->reason() + ": " + entry->info.path);
+        return false;
+    }
+
+    if (offset >= entry->info.file_size) {
+        data.clear();
+        return true;
+    }
+    size_t available = static_cast<size_t>(min<uint64_t>(length, entry->info.file_size - offset));
+    transfer(available);
+    return readContent(*entry, offset, available, data);
+}
+
+bool SimulatedHandler::fileExists(ObjectId object_id) {
+    operation();
+    auto found = index_.find(object_id);
+    if (found == index_.end()) {
+        return false;
+    }
+    const Entry& entry = entries_[found->second];
+    return entry.local_path.empty() || Utils::fileExists(entry.local_path);
+}
+
+void SimulatedHandler::operation() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        operations_++;
+    }
+    if (options_.latency_ms > 0) {
+        this_thread::sleep_for(chrono::duration<double, milli>(options_.latency_ms));
+    }
+}
+
+void SimulatedHandler::transfer(size_t bytes) {
+    chrono::steady_clock::time_point done;
+    {
+        lock_guard<mutex> lock(mutex_);
+        bytes_read_ += bytes;
+        if (options_.bandwidth_mbps <= 0) {
+            return;
+        }
+
+        // Reads queue on one link: each starts when the previous one ends
+        auto seconds = chrono::duration<double>(bytes / (options_.bandwidth_mbps * 1024 * 1024));
+        link_free_at_ = max(link_free_at_, chrono::steady_clock::now()) +
+                        chrono::duration_cast<chrono::steady_clock::duration>(seconds);
+        done = link_free_at_;
+    }
+    this_thread::sleep_until(done);
+}
+
+bool SimulatedHandler::inject(double rate) {
+    if (rate <= 0) {
+        return false;
+    }
+    lock_guard<mutex> lock(mutex_);
+    return uniform_real_distribution<double>(0.0, 1.0)(failure_rng_) < rate;
+}
+
+// A stalled read never delivers another byte; like a real phone, only the
+// caller giving up ends it, and without a token it hangs for good
+bool SimulatedHandler::stall(const Entry& entry, const CancellationToken* cancel) {
+    while (!isCancelled(cancel)) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    setError(string("Read ") + cancel->reason() + ": " + entry.info.path);
+    return false;
+}
+
+bool SimulatedHandler::readContent(const Entry& entry, uint64_t offset, size_t length,
+                                   vector<uint8_t>& data) {
+    data.resize(length);
+    if (entry.local_path.empty()) {
+        fillSynthetic(entry.content_seed, offset, data.data(), length);
+        return true;
+    }
+
+    ifstream file(entry.local_path, ios::binary);
+    if (!file || !file.seekg(static_cast<streamoff>(offset)) ||
+        !file.read(reinterpret_cast<char*>(data.data()), static_cast<streamsize>(length))) {
+        setError("Failed to read " + entry.local_path);
+        return false;
+    }
+    return true;
+}
+
+void SimulatedHandler::fillSynthetic(uint64_t content_seed, uint64_t offset, uint8_t* data, size_t length) {
+    // Byte n of a file is byte n % 8 of splitmix64(seed + n / 8), so any
+    // range can be produced without generating what precedes it
+    for (size_t i = 0; i < length;) {
+        uint64_t position = offset + i;
+        uint64_t word = splitmix64(content_seed + position / 8);
+        for (size_t shift = position % 8; shift < 8 && i < length; shift++, i++) {
+            data[i] = static_cast<uint8_t>(word >> (shift * 8));
+        }
+    }
+}
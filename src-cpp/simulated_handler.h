@@ -0,0 +1,124 @@
+#ifndef SIMULATED_HANDLER_H
+#define SIMULATED_HANDLER_H
+
+#include "device_handler.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Device backend that serves a local folder, or a generated tree of
+ * synthetic media, as if it were a phone.
+ *
+ * Every device operation can be slowed by a fixed latency and reads share
+ * a bandwidth cap, so enumeration, transfer and dedup behave like a USB
+ * link but are reproducible on any machine. Reads can be made to fail, or
+ * to stall like a phone whose screen locked mid-transfer, at a given rate
+ * to exercise error handling. Used by the benchmarks and for
+ * running the CLI and GUI without a phone.
+ */
+class SimulatedHandler : public DeviceHandler {
+public:
+    struct Options {
+        std::string root;                       // Folder to serve; empty for a synthetic tree
+        size_t file_count = 1000;               // Synthetic files
+        uint64_t file_size = 2 * 1024 * 1024;   // Average synthetic file size
+        double duplicate_rate = 0;              // Synthetic files repeating an earlier one
+        double latency_ms = 0;                  // Added to every device operation
+        double bandwidth_mbps = 0;              // Read cap in MB/s shared by all reads; 0 = none
+        double failure_rate = 0;                // Fraction of reads that fail
+        double stall_rate = 0;                  // Fraction of reads that stop sending until cancelled
+        uint32_t seed = 1;
+
+        // Parses "sim[:DIR][,key=value...]" with keys files, size, dup,
+        // latency, bandwidth, fail, stall and seed; size accepts K/M/G suffixes
+        static bool parse(const std::string& spec, Options& options, std::string& error);
+    };
+
+    explicit SimulatedHandler(const Options& options);
+    ~SimulatedHandler() override = default;
+
+    // Whether a -t device type names the simulated backend
+    static bool isSpec(const std::string& device_type);
+
+    // DeviceHandler interface implementation
+    bool detectDevices() override;
+    bool connectToDevice(const std::string& device_name = "", bool auto_unmount = true) override;
+    void disconnect(bool auto_unmount = true) override;
+    std::vector<std::string> getDetectedDevices() const override;
+    bool isConnected() const override { return connected_; }
+
+    // Device information
+    std::string getDeviceName() const override;
+    std::string getDeviceManufacturer() const override { return "Simulated"; }
+    std::string getDeviceModel() const override;
+    std::string getSerialNumber() const override { return serial_number_; }
+    DeviceType getDeviceType() const override { return DeviceType::SIMULATED; }
+    std::vector<DeviceStorageInfo> getStorageInfo() const override;
+
+    // File operations
+    std::vector<MediaInfo> enumerateMedia(const std::string& directory_path = "") override;
+    bool readFile(ObjectId object_id, std::vector<uint8_t>& data) override;
+    bool readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                         const CancellationToken* cancel = nullptr) override;
+    bool readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                   std::vector<uint8_t>& data,
+                   const CancellationToken* cancel = nullptr) override;
+    bool fileExists(ObjectId object_id) override;
+
+    bool supportsConcurrentReads() const override { return true; }
+
+    // Error handling
+    std::string getLastError() const override;
+
+    // Operation counters, for benchmarks
+    uint64_t getOperationCount() const;
+    uint64_t getBytesRead() const;
+
+private:
+    // Size of one simulated USB transfer
+    static constexpr size_t CHUNK_SIZE = 256 * 1024;
+    static constexpr uint32_t STORAGE_ID = 0x00010001;
+
+    struct Entry {
+        MediaInfo info;
+        std::string local_path;     // Source file, empty when synthetic
+        uint64_t content_seed = 0;  // Synthetic content generator
+    };
+
+    Options options_;
+    bool detected_ = false;
+    bool connected_ = false;
+    std::string serial_number_;
+
+    std::vector<Entry> entries_;
+    std::unordered_map<ObjectId, size_t> index_;
+
+    mutable std::mutex mutex_;
+    std::string last_error_;
+    std::mt19937 failure_rng_;
+    std::chrono::steady_clock::time_point link_free_at_;
+    uint64_t operations_ = 0;
+    uint64_t bytes_read_ = 0;
+
+    void setError(const std::string& error);
+    void buildSyntheticTree();
+    void buildFolderTree();
+    void addEntry(Entry entry);
+    const Entry* findEntry(ObjectId object_id);
+
+    // Cost model: one latency per operation, bytes queued on the shared link
+    void operation();
+    void transfer(size_t bytes);
+    bool inject(double rate);
+    bool stall(const Entry& entry, const CancellationToken* cancel);
+
+    bool readContent(const Entry& entry, uint64_t offset, size_t length, std::vector<uint8_t>& data);
+    static void fillSynthetic(uint64_t content_seed, uint64_t offset, uint8_t* data, size_t length);
+};
+
+#endif // SIMULATED_HANDLER_H
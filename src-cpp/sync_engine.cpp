@@ -0,0 +1,780 @@
+#include "sync_engine.h"
+#include "utils.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <cstdio>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#define unlink _unlink
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+SyncEngine::JobQueue::JobQueue(size_t max_files, uint64_t max_bytes)
+    : max_files_(max<size_t>(max_files, 1)), max_bytes_(max_bytes),
+      last_change_(chrono::steady_clock::now()) {
+}
+
+void SyncEngine::JobQueue::recordDepth(chrono::steady_clock::time_point now) {
+    depth_seconds_ += jobs_.size() * chrono::duration<double>(now - last_change_).count();
+    last_change_ = now;
+}
+
+void SyncEngine::JobQueue::push(Job&& job) {
+    unique_lock<mutex> lock(mutex_);
+
+    // A job larger than the whole budget still goes through on its own
+    uint64_t size = job.data.size();
+    changed_.wait(lock, [this, size]() {
+        return jobs_.empty() || (jobs_.size() < max_files_ && bytes_ + size <= max_bytes_);
+    });
+
+    recordDepth(chrono::steady_clock::now());
+    bytes_ += size;
+    jobs_.push_back(move(job));
+    max_depth_ = max(max_depth_, jobs_.size());
+    lock.unlock();
+    changed_.notify_all();
+}
+
+SyncEngine::Job SyncEngine::JobQueue::take() {
+    recordDepth(chrono::steady_clock::now());
+    Job job = move(jobs_.front());
+    jobs_.pop_front();
+    bytes_ -= job.data.size();
+    return job;
+}
+
+bool SyncEngine::JobQueue::pop(Job& job) {
+    unique_lock<mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return !jobs_.empty() || closed_; });
+    if (jobs_.empty()) {
+        return false; // Closed and drained
+    }
+
+    job = take();
+    lock.unlock();
+    changed_.notify_all();
+    return true;
+}
+
+bool SyncEngine::JobQueue::tryPop(Job& job) {
+    unique_lock<mutex> lock(mutex_);
+    if (jobs_.empty()) {
+        return false;
+    }
+
+    job = take();
+    lock.unlock();
+    changed_.notify_all();
+    return true;
+}
+
+void SyncEngine::JobQueue::close() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        closed_ = true;
+    }
+    changed_.notify_all();
+}
+
+void SyncEngine::JobQueue::fillStats(SyncStageStats& stats, chrono::steady_clock::time_point now,
+                                     double elapsed) const {
+    lock_guard<mutex> lock(mutex_);
+    double pending = jobs_.size() * max(0.0, chrono::duration<double>(now - last_change_).count());
+    stats.queue_depth = jobs_.size();
+    stats.max_queue_depth = max_depth_;
+    stats.average_queue_depth = elapsed > 0 ? (depth_seconds_ + pending) / elapsed : 0;
+}
+
+SyncEngine::SyncEngine(PhotoDB* db, DestinationIndex& index, const Options& options)
+    : db_(db), index_(index), options_(options),
+      hash_queue_(options.max_queued_files, options.max_queued_bytes),
+      write_queue_(options.max_queued_files, options.max_queued_bytes),
+      commit_queue_(options.max_queued_files, options.max_queued_bytes),
+      started_(chrono::steady_clock::now()), finished_(started_) {
+    options_.hasher_threads = max<size_t>(options_.hasher_threads, 1);
+    options_.writer_threads = max<size_t>(options_.writer_threads, 1);
+    options_.commit_batch = max<size_t>(options_.commit_batch, 1);
+
+    hasher_.workers = options_.hasher_threads;
+    writer_.workers = options_.writer_threads;
+    committer_.workers = 1;
+}
+
+SyncEngine::SyncEngine(DeviceHandler* device, PhotoDB* db, DestinationIndex& index,
+                       const Options& options)
+    : SyncEngine(db, index, options) {
+    addDevice(device, "");
+}
+
+SyncEngine::~SyncEngine() {
+    if (running_) {
+        finish();
+    }
+}
+
+SyncEngine::Result SyncEngine::run(const vector<PlannedFile>& files) {
+    start();
+    read(0, files);
+    return finish()[0];
+}
+
+size_t SyncEngine::addDevice(DeviceHandler* device, const string& label) {
+    Source source;
+    source.device = device;
+    source.serial = device->getSerialNumber();
+    source.label = label;
+    sources_.push_back(source);
+    return sources_.size() - 1;
+}
+
+void SyncEngine::start() {
+    results_.assign(sources_.size(), Result());
+    total_files_ = 0;
+    files_done_ = 0;
+    claimed_paths_.clear();
+    reader_.workers = sources_.size();
+    {
+        lock_guard<mutex> lock(timing_mutex_);
+        started_ = chrono::steady_clock::now();
+        running_ = true;
+    }
+
+    for (size_t i = 0; i < options_.hasher_threads; i++) {
+        hasher_threads_.emplace_back(&SyncEngine::hashFiles, this);
+    }
+    for (size_t i = 0; i < options_.writer_threads; i++) {
+        writer_threads_.emplace_back(&SyncEngine::writeFiles, this);
+    }
+    commit_thread_ = thread(&SyncEngine::commitFiles, this);
+}
+
+void SyncEngine::read(size_t device, const vector<PlannedFile>& files) {
+    // Claimed up front, so a file moved beside another never takes the
+    // path the plan gives a later one
+    vector<PlannedFile> plan = files;
+    {
+        lock_guard<mutex> lock(claims_mutex_);
+        for (auto& file : plan) {
+            claimPlannedPath(file);
+        }
+    }
+
+    expect(plan.size());
+    for (const auto& file : plan) {
+        readPlanned(device, file);
+    }
+}
+
+void SyncEngine::read(size_t device, const PlannedFile& file) {
+    PlannedFile planned = file;
+    {
+        lock_guard<mutex> lock(claims_mutex_);
+        claimPlannedPath(planned);
+    }
+    readPlanned(device, planned);
+}
+
+void SyncEngine::claimPlannedPath(PlannedFile& file) {
+    // Called with claims_mutex_ held. Each plan has unique paths, but plans
+    // for different devices were made against the same destination and may
+    // have picked the same one.
+    if (file.local_path.empty()) {
+        return;
+    }
+    bool writes = file.action == PlannedFile::Action::COPY ||
+                  file.action == PlannedFile::Action::RESUME;
+    if (writes && claimed_paths_.count(file.local_path) > 0) {
+        file.local_path = nextFreePath(file.base_path.empty() ? file.local_path : file.base_path);
+        file.action = PlannedFile::Action::COPY;
+        file.resume_offset = 0;
+    }
+    claimed_paths_.insert(file.local_path);
+}
+
+vector<SyncEngine::Result> SyncEngine::finish() {
+    // Each stage drains before the next one is told no more work is coming
+    hash_queue_.close();
+    for (auto& hasher : hasher_threads_) {
+        hasher.join();
+    }
+    write_queue_.close();
+    for (auto& writer : writer_threads_) {
+        writer.join();
+    }
+    commit_queue_.close();
+    commit_thread_.join();
+    hasher_threads_.clear();
+    writer_threads_.clear();
+
+    {
+        lock_guard<mutex> lock(timing_mutex_);
+        finished_ = chrono::steady_clock::now();
+        running_ = false;
+    }
+    return results_;
+}
+
+vector<SyncStageStats> SyncEngine::getStageStats() const {
+    chrono::steady_clock::time_point now;
+    double elapsed = 0;
+    {
+        lock_guard<mutex> lock(timing_mutex_);
+        now = running_ ? chrono::steady_clock::now() : finished_;
+        elapsed = chrono::duration<double>(now - started_).count();
+    }
+
+    vector<SyncStageStats> stats;
+    const pair<const Stage*, const JobQueue*> stages[] = {
+        {&reader_, nullptr},
+        {&hasher_, &hash_queue_},
+        {&writer_, &write_queue_},
+        {&committer_, &commit_queue_},
+    };
+    for (const auto& stage : stages) {
+        SyncStageStats entry;
+        entry.name = stage.first->name;
+        entry.workers = stage.first->workers;
+        entry.items = stage.first->items;
+        entry.busy_seconds = stage.first->busy_ns / 1e9;
+        if (elapsed > 0) {
+            entry.utilisation = entry.busy_seconds / (entry.workers * elapsed);
+        }
+        if (stage.second) {
+            stage.second->fillStats(entry, now, elapsed);
+        }
+        stats.push_back(entry);
+    }
+    return stats;
+}
+
+void SyncEngine::addBusyTime(Stage& stage, chrono::steady_clock::time_point start) {
+    auto busy = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+    stage.busy_ns += busy.count();
+    stage.items++;
+}
+
+void SyncEngine::readPlanned(size_t source, const PlannedFile& file) {
+    Result& result = results_[source];
+    auto start = chrono::steady_clock::now();
+
+    Job job;
+    job.source = source;
+    job.photo = file.media;
+    if (file.action == PlannedFile::Action::SKIP) {
+        job.outcome = Outcome::SKIPPED;
+        addBusyTime(reader_, start);
+        commit_queue_.push(move(job));
+        return;
+    }
+
+    job.local_path = file.local_path;
+    job.base_path = file.base_path;
+    job.action = file.action;
+    job.resume_offset = file.resume_offset;
+
+    bool settled = matchLibrary(job);
+    bool read_ok = settled || readFile(job);
+    result.bytes_read += job.bytes_read;
+    result.read_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (settled) {
+        addBusyTime(reader_, start);
+        commit_queue_.push(move(job));
+        return;
+    }
+
+    if (!read_ok) {
+        cerr << "  " << logPrefix(source) << "Failed to read photo: " << job.photo.filename
+             << endl;
+        job.data.clear();
+        job.outcome = Outcome::FAILED;
+        addBusyTime(reader_, start);
+        commit_queue_.push(move(job));
+        return;
+    }
+
+    addBusyTime(reader_, start);
+    hash_queue_.push(move(job));
+}
+
+bool SyncEngine::matchLibrary(Job& job) {
+    DeviceHandler* device = sources_[job.source].device;
+    const MediaInfo& photo = job.photo;
+    bool verify = job.action == PlannedFile::Action::VERIFY;
+    if (job.action == PlannedFile::Action::RESUME ||
+        photo.file_size <= 3 * uint64_t(Utils::QUICK_HASH_SAMPLE)) {
+        return false; // Reading it is no dearer than sampling it
+    }
+
+    // Content of a size the library does not hold has to be copied
+    vector<PhotoDB::SizeMatch> candidates = db_->findPhotosBySize(photo.file_size);
+    if (candidates.empty() && !verify) {
+        return false;
+    }
+
+    // Library files stored before quick hashes existed get one from disk
+    for (auto& candidate : candidates) {
+        if (candidate.quick_hash.empty() && index_.fileExists(candidate.local_path)) {
+            candidate.quick_hash = Utils::calculateFileQuickHash(candidate.local_path);
+            if (!candidate.quick_hash.empty()) {
+                db_->setQuickHash(candidate.hash, candidate.quick_hash);
+            }
+        }
+    }
+
+    CancellationToken deadline(nullptr, CancellationToken::readTimeout(3 * Utils::QUICK_HASH_SAMPLE));
+    job.quick_hash = Utils::calculateQuickHash(photo.file_size,
+        [device, &photo, &deadline](uint64_t offset, uint32_t length, vector<uint8_t>& data) {
+            return device->readRange(photo.object_id, offset, length, data, &deadline);
+        });
+    if (job.quick_hash.empty()) {
+        return false; // Ranged reads unsupported or failed
+    }
+    job.bytes_read += 3 * uint64_t(Utils::QUICK_HASH_SAMPLE);
+
+    // The same-size file at the destination is identified from disk; when
+    // its samples differ it is another file, and this one is stored beside
+    // it unless the library already holds it
+    if (verify && Utils::calculateFileQuickHash(job.local_path) != job.quick_hash) {
+        copyBeside(job);
+        verify = false;
+    }
+
+    if (verify) {
+        for (const auto& candidate : candidates) {
+            if (candidate.local_path == job.local_path && candidate.quick_hash == job.quick_hash) {
+                job.hash = candidate.hash;
+            }
+        }
+        if (job.hash.empty()) {
+            job.hash = Utils::calculateFileHash(job.local_path);
+        }
+        if (job.hash.empty()) {
+            return false;
+        }
+        claimHash(job.hash); // Stored: later copies of it are duplicates
+        setRecord(job, job.local_path, false);
+        job.outcome = Outcome::SKIPPED;
+        return true;
+    }
+
+    // One stored content with this quick hash settles the file. Several
+    // distinct ones collide, and only the full hash can tell them apart.
+    string match;
+    for (const auto& candidate : candidates) {
+        if (candidate.quick_hash != job.quick_hash || !index_.fileExists(candidate.local_path)) {
+            continue;
+        }
+        if (!match.empty() && match != candidate.hash) {
+            return false;
+        }
+        match = candidate.hash;
+    }
+    if (match.empty()) {
+        return false;
+    }
+
+    job.hash = match;
+    setRecord(job, "", false);
+    job.outcome = Outcome::SKIPPED;
+    return true;
+}
+
+bool SyncEngine::readFile(Job& job) {
+    DeviceHandler* device = sources_[job.source].device;
+    const MediaInfo& photo = job.photo;
+    bool resume = job.action == PlannedFile::Action::RESUME;
+
+    // A stalled device fails this file at its deadline and the sync moves on
+    CancellationToken deadline(nullptr,
+                               CancellationToken::readTimeout(photo.file_size - job.resume_offset));
+
+    if (photo.file_size <= options_.in_memory_limit && !resume) {
+        job.data.reserve(static_cast<size_t>(photo.file_size));
+        bool read_ok = device->readFileChunked(photo.object_id,
+            [&job](const uint8_t* chunk, size_t size) {
+                job.data.insert(job.data.end(), chunk, chunk + size);
+                return true;
+            }, &deadline);
+        job.bytes_read = job.data.size();
+        return read_ok;
+    }
+
+    // Too large to queue in memory: hash here, writing to disk as it arrives
+    if (!index_.createDirectory(Utils::getDirectory(job.local_path))) {
+        return false;
+    }
+    job.temp_path = job.local_path + ".part";
+    Utils::SHA256Hasher hasher;
+
+    // Identifying the copy already at the destination. The stream is kept
+    // beside it, so a file that turns out to differ needs no second read.
+    if (job.action == PlannedFile::Action::VERIFY) {
+        ofstream out(job.temp_path, ios::binary | ios::trunc);
+        if (!out) {
+            return false;
+        }
+        bool read_ok = device->readFileChunked(photo.object_id,
+            [&](const uint8_t* chunk, size_t size) {
+                out.write(reinterpret_cast<const char*>(chunk), size);
+                hasher.update(chunk, size);
+                job.bytes_read += size;
+                return out.good();
+            }, &deadline);
+        out.close();
+
+        job.hash = hasher.finalize();
+        if (!read_ok || !out || holdsContent(job)) {
+            unlink(job.temp_path.c_str());
+            job.temp_path.clear();
+            return read_ok && out;
+        }
+
+        // The writer moves the stream to the numbered path
+        copyBeside(job);
+        return true;
+    }
+
+    if (resume) {
+        bool appended = false;
+        if (resumeFile(job, hasher, deadline, appended)) {
+            job.hash = hasher.finalize();
+            return true;
+        }
+        if (appended || deadline.isCancelled()) {
+            return false; // The longer .part is kept for the next sync
+        }
+
+        // Ranged reads unsupported, or the .part is not from this file
+        hasher = Utils::SHA256Hasher();
+    }
+
+    ofstream out(job.temp_path, ios::binary | ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    uint64_t bytes_written = 0;
+    bool read_ok = device->readFileChunked(photo.object_id,
+        [&](const uint8_t* chunk, size_t size) {
+            out.write(reinterpret_cast<const char*>(chunk), size);
+            hasher.update(chunk, size);
+            bytes_written += size;
+            return out.good();
+        }, &deadline);
+    out.close();
+    job.bytes_read += bytes_written;
+
+    if (!read_ok || !out || bytes_written != photo.file_size) {
+        // An intact prefix stays on disk for the next plan to resume
+        if (!out || bytes_written == 0 || bytes_written >= photo.file_size) {
+            unlink(job.temp_path.c_str());
+        }
+        return false;
+    }
+
+    job.hash = hasher.finalize();
+    return true;
+}
+
+bool SyncEngine::resumeFile(Job& job, Utils::SHA256Hasher& hasher,
+                            const CancellationToken& deadline, bool& appended) {
+    DeviceHandler* device = sources_[job.source].device;
+    const MediaInfo& photo = job.photo;
+    appended = false;
+
+    uint64_t offset = job.resume_offset;
+    if (offset == 0 || offset >= photo.file_size || index_.getFileSize(job.temp_path) != offset) {
+        return false;
+    }
+
+    // The .part must end with what the device holds there; otherwise it was
+    // left by another file that had the same name
+    uint32_t check_size = static_cast<uint32_t>(min<uint64_t>(RESUME_CHECK_SIZE, offset));
+    vector<uint8_t> device_tail;
+    if (!device->readRange(photo.object_id, offset - check_size, check_size, device_tail,
+                            &deadline) ||
+        device_tail.size() != check_size) {
+        return false;
+    }
+    job.bytes_read += device_tail.size();
+
+    ifstream part(job.temp_path, ios::binary);
+    if (!part) {
+        return false;
+    }
+
+    Utils::SHA256Hasher prefix_hasher;
+    vector<char> buffer(1024 * 1024);
+    vector<uint8_t> part_tail;
+    uint64_t hashed = 0;
+    while (part && hashed < offset) {
+        part.read(buffer.data(), buffer.size());
+        streamsize got = part.gcount();
+        if (got <= 0) break;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer.data());
+        prefix_hasher.update(bytes, static_cast<size_t>(got));
+        hashed += static_cast<uint64_t>(got);
+
+        // Keep the last check_size bytes seen
+        part_tail.insert(part_tail.end(), bytes, bytes + got);
+        if (part_tail.size() > check_size) {
+            part_tail.erase(part_tail.begin(), part_tail.end() - check_size);
+        }
+    }
+    part.close();
+
+    if (hashed != offset || part_tail != device_tail) {
+        return false;
+    }
+
+    ofstream out(job.temp_path, ios::binary | ios::app);
+    if (!out) {
+        return false;
+    }
+
+    vector<uint8_t> chunk;
+    while (offset < photo.file_size && !deadline.isCancelled()) {
+        uint32_t length = static_cast<uint32_t>(min<uint64_t>(RESUME_CHUNK_SIZE,
+                                                              photo.file_size - offset));
+        if (!device->readRange(photo.object_id, offset, length, chunk, &deadline) ||
+            chunk.empty()) {
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+        if (!out) {
+            return false;
+        }
+
+        prefix_hasher.update(chunk.data(), chunk.size());
+        offset += chunk.size();
+        job.bytes_read += chunk.size();
+        appended = true;
+    }
+
+    out.close();
+    if (!out.good() || offset != photo.file_size) {
+        return false;
+    }
+
+    hasher = prefix_hasher;
+    return true;
+}
+
+void SyncEngine::hashFiles() {
+    Job job;
+    while (hash_queue_.pop(job)) {
+        auto start = chrono::steady_clock::now();
+        if (job.hash.empty()) {
+            Utils::SHA256Hasher hasher;
+            hasher.update(job.data.data(), job.data.size());
+            job.hash = hasher.finalize();
+        }
+        if (job.quick_hash.empty() && !job.data.empty()) {
+            job.quick_hash = Utils::calculateQuickHash(job.data);
+        } else if (job.quick_hash.empty() && !job.temp_path.empty()) {
+            job.quick_hash = Utils::calculateFileQuickHash(job.temp_path);
+        }
+        addBusyTime(hasher_, start);
+        write_queue_.push(move(job));
+    }
+}
+
+void SyncEngine::writeFiles() {
+    Job job;
+    while (write_queue_.pop(job)) {
+        auto start = chrono::steady_clock::now();
+        writeFile(job);
+        vector<uint8_t>().swap(job.data);
+        addBusyTime(writer_, start);
+        commit_queue_.push(move(job));
+    }
+}
+
+void SyncEngine::writeFile(Job& job) {
+    const MediaInfo& photo = job.photo;
+
+    // Streamed files were compared by the reader
+    if (job.action == PlannedFile::Action::VERIFY && !job.data.empty() && !holdsContent(job)) {
+        copyBeside(job);
+    }
+
+    if (job.action == PlannedFile::Action::VERIFY) {
+        // The destination already holds this content, so later copies of it
+        // are duplicates even before the record is committed
+        claimHash(job.hash);
+        setRecord(job, job.local_path, false);
+        job.outcome = Outcome::SKIPPED;
+        return;
+    }
+
+    // Content already in the library, or being stored from another file
+    bool claimed = claimHash(job.hash);
+    bool in_library = claimed && db_->photoExists(job.hash) &&
+                      index_.fileExists(db_->getLocalPath(job.hash));
+    if (!claimed || in_library) {
+        if (!job.temp_path.empty()) {
+            unlink(job.temp_path.c_str());
+            index_.removeFile(job.temp_path);
+        }
+        setRecord(job, "", false);
+        job.outcome = Outcome::SKIPPED;
+        return;
+    }
+
+    // Files read into memory are written here; larger ones already streamed
+    bool written = false;
+    if (job.temp_path.empty()) {
+        job.temp_path = job.local_path + ".part";
+        written = job.data.size() == photo.file_size &&
+                  index_.createDirectory(Utils::getDirectory(job.local_path)) &&
+                  Utils::writeFile(job.temp_path, job.data);
+    } else {
+        written = true;
+    }
+    // Checked on disk: the index only knows what the run expects to be there
+    written = written && Utils::getFileSize(job.temp_path) == photo.file_size;
+
+    if (!written || rename(job.temp_path.c_str(), job.local_path.c_str()) != 0) {
+        cerr << "  " << logPrefix(job.source) << "Failed to write file: " << job.local_path << endl;
+        unlink(job.temp_path.c_str());
+        index_.removeFile(job.temp_path);
+        releaseHash(job.hash);
+        job.outcome = Outcome::FAILED;
+        return;
+    }
+    index_.removeFile(job.temp_path);
+    index_.addFile(job.local_path, photo.file_size);
+
+    // The hash stays claimed: later copies of this content are duplicates
+    setRecord(job, job.local_path, true);
+    job.outcome = Outcome::TRANSFERRED;
+}
+
+void SyncEngine::commitFiles() {
+    vector<Job> batch;
+    Job job;
+    while (commit_queue_.pop(job)) {
+        // Whatever queued up while the last batch was written goes in the next
+        batch.push_back(move(job));
+        while (batch.size() < options_.commit_batch && commit_queue_.tryPop(job)) {
+            batch.push_back(move(job));
+        }
+
+        auto start = chrono::steady_clock::now();
+        commitBatch(batch);
+        auto busy = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+        committer_.busy_ns += busy.count();
+        committer_.items += batch.size();
+        batch.clear();
+    }
+}
+
+void SyncEngine::commitBatch(vector<Job>& batch) {
+    vector<PhotoDB::PhotoRecord> records;
+    for (const auto& job : batch) {
+        if (job.has_record) {
+            records.push_back(job.record);
+        }
+    }
+    if (!db_->addPhotos(records)) {
+        // The files themselves are in place; the next sync identifies them again
+        cerr << "  Warning: Failed to update database: " << db_->getLastError() << endl;
+    }
+
+    for (const auto& job : batch) {
+        const MediaInfo& photo = job.photo;
+        Result& result = results_[job.source];
+        switch (job.outcome) {
+            case Outcome::TRANSFERRED:
+                result.transferred++;
+                result.transferred_size += photo.file_size;
+                cout << "  ✓ " << logPrefix(job.source) << "Transferred: " << photo.filename
+                     << " (" << (photo.file_size / 1024.0) << " KB)" << endl;
+                break;
+            case Outcome::SKIPPED:
+                result.skipped++;
+                break;
+            default:
+                result.failed++;
+                result.failed_files.push_back(photo);
+                break;
+        }
+
+        // Devices still planning add to the total as they start reading
+        size_t done = ++files_done_;
+        size_t total = max<size_t>(total_files_, done);
+        if (done % 10 == 0 || done == total) {
+            cout << "  Progress: " << done << "/" << total
+                 << " (" << (done * 100 / total) << "%)" << endl;
+        }
+    }
+}
+
+void SyncEngine::setRecord(Job& job, const string& local_path, bool replace) {
+    job.record.hash = job.hash;
+    job.record.phone_path = job.photo.path;
+    job.record.local_path = local_path;
+    job.record.file_size = job.photo.file_size;
+    job.record.modification_date = job.photo.modification_date;
+    job.record.replace = replace;
+    job.record.device_serial = sources_[job.source].serial;
+    job.record.storage_id = job.photo.storage_id;
+    job.record.quick_hash = job.quick_hash;
+    job.has_record = !local_path.empty() || !job.record.device_serial.empty();
+}
+
+bool SyncEngine::claimHash(const string& hash) {
+    lock_guard<mutex> lock(claims_mutex_);
+    return claimed_hashes_.insert(hash).second;
+}
+
+void SyncEngine::releaseHash(const string& hash) {
+    lock_guard<mutex> lock(claims_mutex_);
+    claimed_hashes_.erase(hash);
+}
+
+bool SyncEngine::holdsContent(const Job& job) {
+    // The library row saves hashing the file when it was stored from here
+    if (db_->photoExists(job.hash) && db_->getLocalPath(job.hash) == job.local_path) {
+        return true;
+    }
+    return Utils::calculateFileHash(job.local_path) == job.hash;
+}
+
+void SyncEngine::copyBeside(Job& job) {
+    // A different file with the same name and size is at local_path: it is
+    // kept, and this one copied to the next free numbered path
+    string base = job.base_path.empty() ? job.local_path : job.base_path;
+    {
+        lock_guard<mutex> lock(claims_mutex_);
+        job.local_path = nextFreePath(base);
+        claimed_paths_.insert(job.local_path);
+    }
+
+    job.action = PlannedFile::Action::COPY;
+}
+
+string SyncEngine::nextFreePath(const string& base) {
+    // Called with claims_mutex_ held
+    string candidate = base;
+    for (int n = 1; claimed_paths_.count(candidate) > 0 || index_.fileExists(candidate); n++) {
+        candidate = SyncPlanner::getNumberedPath(base, n);
+    }
+    return candidate;
+}
+
+string SyncEngine::logPrefix(size_t source) const {
+    if (sources_.size() < 2 || sources_[source].label.empty()) {
+        return "";
+    }
+    return "[" + sources_[source].label + "] ";
+}
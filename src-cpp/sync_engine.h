@@ -0,0 +1,241 @@
+#ifndef SYNC_ENGINE_H
+#define SYNC_ENGINE_H
+
+#include "device_handler.h"
+#include "photo_db.h"
+#include "sync_planner.h"
+#include "destination_index.h"
+#include "utils.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_set>
+#include <cstdint>
+
+/**
+ * Load on one stage of the sync pipeline. The stage whose utilisation is
+ * near 1 while the queue in front of it stays full is the bottleneck.
+ */
+struct SyncStageStats {
+    std::string name;
+    size_t workers = 0;
+    uint64_t items = 0;                 // Files the stage has finished
+    size_t queue_depth = 0;             // Files waiting for the stage now
+    size_t max_queue_depth = 0;
+    double average_queue_depth = 0;     // Averaged over the run time
+    double busy_seconds = 0;            // Summed over the stage's workers
+    double utilisation = 0;             // busy_seconds / (workers * elapsed)
+};
+
+/**
+ * Moves a list of device files into the library as a pipeline:
+ *
+ *   device reader -> hasher pool -> writer pool -> batched DB commit
+ *
+ * Bounded queues sit between the stages, so the USB link keeps reading
+ * while earlier files are hashed and written, and memory stays capped when
+ * one stage falls behind. Before reading a file in full, the reader
+ * compares a quick hash taken through ranged reads with library files of
+ * the same size, which settles most re-imported files from 192 KB of
+ * traffic. Each device is read by one thread, since most backends
+ * serialize device access anyway; several devices can feed the same
+ * hasher, writer and commit stages, so content is deduplicated across all
+ * of them. Files too large to hold in memory, and files resumed from a
+ * .part, are streamed to disk and hashed by the reader.
+ */
+class SyncEngine {
+public:
+    struct Options {
+        size_t hasher_threads = 2;
+        size_t writer_threads = 2;
+        size_t commit_batch = 256;                      // Files per DB transaction
+        uint64_t in_memory_limit = 32 * 1024 * 1024;    // Larger files stream to disk
+        uint64_t max_queued_bytes = 128 * 1024 * 1024;  // Per queue
+        size_t max_queued_files = 256;                  // Per queue
+    };
+
+    struct Result {
+        int transferred = 0;
+        int skipped = 0;
+        int failed = 0;
+        uint64_t transferred_size = 0;
+        uint64_t bytes_read = 0;        // Device traffic, for measuring the link
+        double read_seconds = 0;        // Time spent waiting on device reads
+        std::vector<MediaInfo> failed_files;
+    };
+
+    // Existence checks on the destination go through index, which is kept
+    // up to date with the files the run writes
+    SyncEngine(PhotoDB* db, DestinationIndex& index, const Options& options);
+    // Single-device engine for run()
+    SyncEngine(DeviceHandler* device, PhotoDB* db, DestinationIndex& index, const Options& options);
+    ~SyncEngine();
+
+    SyncEngine(const SyncEngine&) = delete;
+    SyncEngine& operator=(const SyncEngine&) = delete;
+
+    // Carries out a plan's files in their order and returns once every
+    // stage has drained
+    Result run(const std::vector<PlannedFile>& files);
+
+    // Several devices at once: addDevice() each, start(), then read() every
+    // device's plan from its own thread, and finish() once they returned.
+    // Returns the device's index into finish()'s results.
+    size_t addDevice(DeviceHandler* device, const std::string& label);
+    void start();
+    // Returns once the device's files are read; later stages may still be
+    // working on them. Paths another device's plan already took are
+    // replaced with the next free numbered path.
+    void read(size_t device, const std::vector<PlannedFile>& files);
+    // One file, as soon as it is planned. expect() the number of files
+    // first, for the progress total.
+    void read(size_t device, const PlannedFile& file);
+    void expect(size_t files) { total_files_ += files; }
+    std::vector<Result> finish();
+
+    // Reader, hasher, writer and commit stages, in pipeline order.
+    // Safe to call from another thread while run() is in progress.
+    std::vector<SyncStageStats> getStageStats() const;
+
+private:
+    enum class Outcome {
+        PENDING,
+        TRANSFERRED,
+        SKIPPED,
+        FAILED
+    };
+
+    struct Source {
+        DeviceHandler* device = nullptr;
+        std::string serial;
+        std::string label;          // Prefixes log lines when several devices run
+    };
+
+    // One file on its way through the stages
+    struct Job {
+        size_t source = 0;
+        MediaInfo photo;
+        std::string local_path;
+        std::string base_path;
+        PlannedFile::Action action = PlannedFile::Action::COPY;
+        uint64_t resume_offset = 0;
+        uint64_t bytes_read = 0;    // From the device, including any retried read
+        std::vector<uint8_t> data;
+        std::string temp_path;      // Set when the reader streamed the file to disk
+        std::string hash;
+        std::string quick_hash;
+        Outcome outcome = Outcome::PENDING;
+        PhotoDB::PhotoRecord record;
+        bool has_record = false;    // Whether the commit stage writes record
+    };
+
+    // Bounded hand-off between two stages, tracking its own depth
+    class JobQueue {
+    public:
+        JobQueue(size_t max_files, uint64_t max_bytes);
+
+        // Blocks while the queue is full
+        void push(Job&& job);
+        // Blocks until a job arrives; false once closed and drained
+        bool pop(Job& job);
+        bool tryPop(Job& job);
+        void close();
+
+        void fillStats(SyncStageStats& stats, std::chrono::steady_clock::time_point now,
+                       double elapsed) const;
+
+    private:
+        const size_t max_files_;
+        const uint64_t max_bytes_;
+        std::deque<Job> jobs_;
+        uint64_t bytes_ = 0;
+        bool closed_ = false;
+
+        mutable std::mutex mutex_;
+        std::condition_variable changed_;
+
+        // Depth integrated over time, for the average
+        size_t max_depth_ = 0;
+        double depth_seconds_ = 0;
+        std::chrono::steady_clock::time_point last_change_;
+
+        void recordDepth(std::chrono::steady_clock::time_point now);
+        Job take();
+    };
+
+    struct Stage {
+        const char* name;
+        size_t workers = 0;
+        std::atomic<uint64_t> items{0};
+        std::atomic<int64_t> busy_ns{0};
+    };
+
+    PhotoDB* db_;
+    DestinationIndex& index_;
+    Options options_;
+    std::vector<Source> sources_;
+
+    JobQueue hash_queue_;
+    JobQueue write_queue_;
+    JobQueue commit_queue_;
+
+    Stage reader_{"Read"};
+    Stage hasher_{"Hash"};
+    Stage writer_{"Write"};
+    Stage committer_{"Commit"};
+
+    std::vector<std::thread> hasher_threads_;
+    std::vector<std::thread> writer_threads_;
+    std::thread commit_thread_;
+
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point finished_;
+    bool running_ = false;
+    mutable std::mutex timing_mutex_;
+
+    // Contents in flight, so the same content is never stored twice.
+    // Destination paths are unique within a plan; a file that turns out not
+    // to match what is at its path is moved to one outside the plan.
+    std::unordered_set<std::string> claimed_hashes_;
+    std::unordered_set<std::string> claimed_paths_;
+    std::mutex claims_mutex_;
+
+    // One per source. Readers fill in the read figures, the commit stage the rest.
+    std::vector<Result> results_;
+    std::atomic<size_t> total_files_{0};
+    size_t files_done_ = 0;
+
+    // Ranged reads used to extend a .part file
+    static constexpr uint32_t RESUME_CHUNK_SIZE = 4 * 1024 * 1024;
+    // Tail of a .part compared with the device before it is extended
+    static constexpr uint32_t RESUME_CHECK_SIZE = 4096;
+
+    // Stages
+    void readPlanned(size_t source, const PlannedFile& file);
+    void claimPlannedPath(PlannedFile& file);
+    bool matchLibrary(Job& job);
+    bool readFile(Job& job);
+    bool resumeFile(Job& job, Utils::SHA256Hasher& hasher, const CancellationToken& deadline,
+                    bool& appended);
+    void hashFiles();
+    void writeFiles();
+    void writeFile(Job& job);
+    void commitFiles();
+    void commitBatch(std::vector<Job>& batch);
+
+    bool claimHash(const std::string& hash);
+    void releaseHash(const std::string& hash);
+    bool holdsContent(const Job& job);
+    void copyBeside(Job& job);
+    std::string nextFreePath(const std::string& base);
+    std::string logPrefix(size_t source) const;
+    void setRecord(Job& job, const std::string& local_path, bool replace);
+    static void addBusyTime(Stage& stage, std::chrono::steady_clock::time_point start);
+};
+
+#endif // SYNC_ENGINE_H
@@ -0,0 +1,169 @@
+#include "sync_planner.h"
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+
+namespace {
+
+uint64_t newestDate(const MediaInfo& media) {
+    return media.capture_date != 0 ? media.capture_date : media.modification_date;
+}
+
+string deviceFolder(const string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? string() : path.substr(0, slash);
+}
+
+} // namespace
+
+SyncPlanner::SyncPlanner(PhotoDB* db, const string& device_serial, LocalPathFunction local_path,
+                         const DestinationIndex& index)
+    : db_(db), serial_(device_serial), local_path_(move(local_path)), index_(index) {
+}
+
+SyncPlan SyncPlanner::plan(const vector<MediaInfo>& media, Order order) const {
+    SyncPlan plan;
+    plan.files.reserve(media.size());
+    planEach(media, plan, [&plan](const PlannedFile& file) { plan.files.push_back(file); });
+    sortFiles(plan.files, order);
+    return plan;
+}
+
+void SyncPlanner::planEach(const vector<MediaInfo>& media, SyncPlan& plan,
+                           const function<void(const PlannedFile& file)>& sink) const {
+    plan.device_files = media.size();
+
+    bool have_db = db_ != nullptr && db_->isOpen();
+    unordered_set<string> planned_paths;
+
+    for (const auto& photo : media) {
+        PlannedFile file;
+        file.media = photo;
+
+        // Unchanged since a previous sync: identified from metadata alone
+        string known_hash;
+        string known_path;
+        if (have_db && !serial_.empty() &&
+            db_->findFingerprint(serial_, photo.storage_id, photo.path,
+                                 photo.file_size, photo.modification_date,
+                                 known_hash, known_path) &&
+            !known_path.empty() && index_.fileExists(known_path)) {
+            file.action = PlannedFile::Action::SKIP;
+            plan.skip_count++;
+            sink(file);
+            continue;
+        }
+
+        // The order, the path and the library all go by this one date
+        if (file.media.capture_date == 0 && capture_date_) {
+            file.media.capture_date = capture_date_(photo);
+        }
+
+        // Two device folders can hold the same file name for the same date,
+        // and a different file already on disk is never overwritten: later
+        // ones get a numbered suffix
+        string base = local_path_(file.media);
+        string candidate = base;
+        for (int n = 1;; n++) {
+            if (planned_paths.count(candidate) == 0) {
+                if (!index_.fileExists(candidate)) {
+                    break;
+                }
+                if (index_.getFileSize(candidate) == photo.file_size) {
+                    file.action = PlannedFile::Action::VERIFY;
+                    break;
+                }
+            }
+            candidate = getNumberedPath(base, n);
+        }
+        planned_paths.insert(candidate);
+        file.local_path = candidate;
+        file.base_path = base;
+
+        if (file.action != PlannedFile::Action::VERIFY) {
+            // Only a strictly shorter .part can be a prefix of this file
+            string part_path = candidate + ".part";
+            uint64_t part_size = index_.getFileSize(part_path);
+            if (part_size > 0 && part_size < photo.file_size) {
+                file.action = PlannedFile::Action::RESUME;
+                file.resume_offset = part_size;
+            }
+        }
+
+        file.bytes_to_read = photo.file_size - file.resume_offset;
+        switch (file.action) {
+            case PlannedFile::Action::VERIFY: plan.verify_count++; break;
+            case PlannedFile::Action::RESUME: plan.resume_count++; break;
+            default: plan.copy_count++; break;
+        }
+        plan.total_bytes += file.bytes_to_read;
+        sink(file);
+    }
+
+    plan.link_rate_measured = link_rate_ > 0;
+    plan.link_rate = plan.link_rate_measured ? link_rate_ : DEFAULT_LINK_RATE;
+    plan.estimated_seconds = plan.total_bytes / plan.link_rate;
+}
+
+void SyncPlanner::sortFiles(vector<PlannedFile>& files, Order order) {
+    // Stable, so files that compare equal keep their listing order
+    switch (order) {
+        case Order::NEWEST_FIRST:
+            stable_sort(files.begin(), files.end(), [](const PlannedFile& a, const PlannedFile& b) {
+                return newestDate(a.media) > newestDate(b.media);
+            });
+            break;
+        case Order::SMALLEST_FIRST:
+            stable_sort(files.begin(), files.end(), [](const PlannedFile& a, const PlannedFile& b) {
+                return a.media.file_size < b.media.file_size;
+            });
+            break;
+        case Order::BY_FOLDER:
+            stable_sort(files.begin(), files.end(), [](const PlannedFile& a, const PlannedFile& b) {
+                int folder = deviceFolder(a.media.path).compare(deviceFolder(b.media.path));
+                return folder != 0 ? folder < 0 : a.media.filename < b.media.filename;
+            });
+            break;
+        case Order::DEVICE:
+            break;
+    }
+}
+
+string SyncPlanner::getNumberedPath(const string& local_path, int n) {
+    size_t dot = local_path.find_last_of('.');
+    size_t slash = local_path.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash)) {
+        dot = local_path.size();
+    }
+    return local_path.substr(0, dot) + "-" + to_string(n) + local_path.substr(dot);
+}
+
+bool SyncPlanner::parseOrder(const string& name, Order& order) {
+    for (Order candidate : {Order::DEVICE, Order::NEWEST_FIRST, Order::SMALLEST_FIRST,
+                            Order::BY_FOLDER}) {
+        if (name == getOrderName(candidate)) {
+            order = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* SyncPlanner::getOrderName(Order order) {
+    switch (order) {
+        case Order::NEWEST_FIRST: return "newest";
+        case Order::SMALLEST_FIRST: return "smallest";
+        case Order::BY_FOLDER: return "folder";
+        default: return "device";
+    }
+}
+
+const char* SyncPlanner::getActionName(PlannedFile::Action action) {
+    switch (action) {
+        case PlannedFile::Action::SKIP: return "skip";
+        case PlannedFile::Action::VERIFY: return "verify";
+        case PlannedFile::Action::RESUME: return "resume";
+        default: return "copy";
+    }
+}
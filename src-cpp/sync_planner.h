@@ -0,0 +1,110 @@
+#ifndef SYNC_PLANNER_H
+#define SYNC_PLANNER_H
+
+#include "device_handler.h"
+#include "photo_db.h"
+#include "destination_index.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/**
+ * What a sync will do with one device file
+ */
+struct PlannedFile {
+    enum class Action {
+        SKIP,       // Known from a previous sync; nothing is read
+        VERIFY,     // A same-size file is at local_path; read once to identify it
+        COPY,       // Read in full and written to local_path
+        RESUME      // local_path + ".part" holds a prefix; only the rest is read
+    };
+
+    MediaInfo media;
+    Action action = Action::COPY;
+    std::string local_path;         // Empty for SKIP
+    std::string base_path;          // local_path before any numbered suffix
+    uint64_t resume_offset = 0;     // Bytes already in the .part file
+    uint64_t bytes_to_read = 0;     // Device traffic this file costs
+};
+
+/**
+ * Every file of a sync in the order it will run, with its expected cost
+ */
+struct SyncPlan {
+    std::vector<PlannedFile> files;
+    size_t device_files = 0;        // Enumerated, before any only-new filter
+    size_t skip_count = 0;
+    size_t verify_count = 0;
+    size_t copy_count = 0;
+    size_t resume_count = 0;
+    uint64_t total_bytes = 0;       // Sum of bytes_to_read
+    double link_rate = 0;           // Bytes per second used for the estimate
+    bool link_rate_measured = false;
+    double estimated_seconds = 0;
+};
+
+/**
+ * Turns a device listing into a SyncPlan using the library database and
+ * the destination folder, without reading from the device.
+ *
+ * Destination paths are worked out in listing order, so the numbered
+ * suffix given to a second file with the same name is stable between a
+ * dry run and the real one; the requested order is applied afterwards.
+ */
+class SyncPlanner {
+public:
+    enum class Order {
+        DEVICE,         // As enumerated
+        NEWEST_FIRST,   // Capture date, else modification date, descending
+        SMALLEST_FIRST,
+        BY_FOLDER       // Device folder, then file name
+    };
+
+    // Destination of a file before any numbered suffix
+    using LocalPathFunction = std::function<std::string(const MediaInfo& media)>;
+    // Capture date read from a file's header; 0 when it has none
+    using CaptureDateFunction = std::function<uint64_t(const MediaInfo& media)>;
+
+    // db may be null or closed: nothing is then known from earlier syncs.
+    // Destination files are looked up in index, which may be unbuilt.
+    SyncPlanner(PhotoDB* db, const std::string& device_serial, LocalPathFunction local_path,
+                const DestinationIndex& index);
+
+    // Measured device read rate in bytes per second; 0 uses a default
+    void setLinkRate(double bytes_per_second) { link_rate_ = bytes_per_second; }
+    // Dates files the listing left undated. The date is stored in the
+    // planned media before its path is chosen.
+    void setCaptureDates(CaptureDateFunction capture_date) { capture_date_ = std::move(capture_date); }
+
+    SyncPlan plan(const std::vector<MediaInfo>& media, Order order) const;
+
+    // Plans in listing order, handing each file to sink as soon as its
+    // destination is known, so a sync can read it while later headers are
+    // still probed. plan gets the totals but not the files.
+    void planEach(const std::vector<MediaInfo>& media, SyncPlan& plan,
+                  const std::function<void(const PlannedFile& file)>& sink) const;
+
+    static void sortFiles(std::vector<PlannedFile>& files, Order order);
+
+    // local_path with "-n" before the extension
+    static std::string getNumberedPath(const std::string& local_path, int n);
+
+    // "device", "newest", "smallest" or "folder"
+    static bool parseOrder(const std::string& name, Order& order);
+    static const char* getOrderName(Order order);
+    static const char* getActionName(PlannedFile::Action action);
+
+private:
+    PhotoDB* db_;
+    std::string serial_;
+    LocalPathFunction local_path_;
+    CaptureDateFunction capture_date_;
+    const DestinationIndex& index_;
+    double link_rate_ = 0;
+
+    // Typical of MTP over USB 2.0, for devices never measured
+    static constexpr double DEFAULT_LINK_RATE = 20.0 * 1024 * 1024;
+};
+
+#endif // SYNC_PLANNER_H
@@ -0,0 +1,78 @@
+#include "sync_watermark.h"
+#include <algorithm>
+
+using namespace std;
+
+WatermarkTracker::WatermarkTracker(const vector<PhotoDB::SyncWatermark>& previous,
+                                   bool increasing_object_ids)
+    : previous_(previous), increasing_object_ids_(increasing_object_ids) {
+    for (const auto& watermark : previous_) {
+        by_storage_[watermark.storage_id] = watermark;
+    }
+}
+
+bool WatermarkTracker::isNew(const MediaInfo& media) const {
+    auto it = by_storage_.find(media.storage_id);
+    if (it == by_storage_.end()) {
+        return true; // Storage never synced
+    }
+
+    const PhotoDB::SyncWatermark& watermark = it->second;
+    if (media.modification_date >= watermark.modification_date) {
+        return true;
+    }
+    return increasing_object_ids_ && media.object_id >= watermark.object_id;
+}
+
+void WatermarkTracker::resetObjectIds() {
+    for (auto& entry : by_storage_) {
+        entry.second.object_id = 0;
+    }
+}
+
+void WatermarkTracker::record(const MediaInfo& media, bool succeeded) {
+    StorageRange& range = ranges_[media.storage_id];
+    if (succeeded) {
+        range.max_date = max(range.max_date, media.modification_date);
+        range.max_object_id = max(range.max_object_id, media.object_id);
+        return;
+    }
+
+    if (!range.any_failed) {
+        range.any_failed = true;
+        range.min_failed_date = media.modification_date;
+        range.min_failed_object_id = media.object_id;
+    } else {
+        range.min_failed_date = min(range.min_failed_date, media.modification_date);
+        range.min_failed_object_id = min(range.min_failed_object_id, media.object_id);
+    }
+}
+
+vector<PhotoDB::SyncWatermark> WatermarkTracker::advanced() const {
+    vector<PhotoDB::SyncWatermark> watermarks;
+    for (const auto& entry : ranges_) {
+        const StorageRange& range = entry.second;
+
+        PhotoDB::SyncWatermark watermark;
+        watermark.storage_id = entry.first;
+        auto it = by_storage_.find(entry.first);
+        if (it != by_storage_.end()) {
+            watermark = it->second;
+        }
+
+        // Files compare strictly below the watermark to be left out, so
+        // stopping at the first failure keeps it in the next sync
+        uint64_t date = range.max_date;
+        ObjectId object_id = range.max_object_id;
+        if (range.any_failed) {
+            date = min(date, range.min_failed_date);
+            object_id = min(object_id, range.min_failed_object_id);
+        }
+
+        // Watermarks never move back: older content stays settled
+        watermark.modification_date = max(watermark.modification_date, date);
+        watermark.object_id = max(watermark.object_id, object_id);
+        watermarks.push_back(watermark);
+    }
+    return watermarks;
+}
@@ -0,0 +1,60 @@
+#ifndef SYNC_WATERMARK_H
+#define SYNC_WATERMARK_H
+
+#include "device_handler.h"
+#include "photo_db.h"
+#include <map>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Decides which files an incremental sync of one device can leave out, and
+ * moves that device's watermarks forward as files settle.
+ *
+ * A file is left out only when it is older than its storage's watermark by
+ * modification date and, on backends whose object ids increase, also by
+ * object id, so a file copied onto the phone with an old timestamp is still
+ * picked up there. Dates are compared strictly: files from the watermark's
+ * own second are looked at again and settled by their fingerprints. A file
+ * that fails holds the watermark back so the next sync tries it again.
+ * Object-id watermarks are dropped when the device reports its ids were
+ * reassigned since they were recorded.
+ *
+ * Not thread-safe; callers serialize record().
+ */
+class WatermarkTracker {
+public:
+    WatermarkTracker(const std::vector<PhotoDB::SyncWatermark>& previous,
+                     bool increasing_object_ids);
+
+    // Whether an only-new sync has to look at this file
+    bool isNew(const MediaInfo& media) const;
+
+    // The device reassigned its object ids: stored ids say nothing, so this
+    // sync looks at every file again by id and records fresh ones
+    void resetObjectIds();
+
+    // Outcome of a file the sync looked at; succeeded includes skipped
+    void record(const MediaInfo& media, bool succeeded);
+
+    // Watermarks to store after the sync, one per storage seen
+    std::vector<PhotoDB::SyncWatermark> advanced() const;
+
+    const std::vector<PhotoDB::SyncWatermark>& previous() const { return previous_; }
+
+private:
+    struct StorageRange {
+        uint64_t max_date = 0;          // Among files that settled
+        ObjectId max_object_id = 0;
+        bool any_failed = false;
+        uint64_t min_failed_date = 0;
+        ObjectId min_failed_object_id = 0;
+    };
+
+    std::vector<PhotoDB::SyncWatermark> previous_;
+    std::map<uint32_t, PhotoDB::SyncWatermark> by_storage_;
+    std::map<uint32_t, StorageRange> ranges_;
+    bool increasing_object_ids_;
+};
+
+#endif // SYNC_WATERMARK_H
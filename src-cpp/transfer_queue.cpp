@@ -1,5 +1,6 @@
 #include "transfer_queue.h"
 #include "utils.h"
+#include "capture_date_probe.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -7,6 +8,7 @@
 #include <ctime>
 #include <thread>
 #include <cstdio>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <io.h>
@@ -20,7 +22,11 @@ using namespace std;
 TransferQueue::TransferQueue() {}
 
 TransferQueue::~TransferQueue() {
-    cancel();
+    if (!cancel()) {
+        // The read ends at its deadline at the latest; the queue must outlive it
+        unique_lock<mutex> lock(run_mutex_);
+        run_finished_.wait(lock, [this]() { return !is_running_; });
+    }
 }
 
 void TransferQueue::addItem(const MediaInfo& media) {
@@ -103,7 +109,7 @@ bool TransferQueue::loadState(const string& state_file) {
         if (tokens.size() >= 9) {
             TransferItem item;
             item.status = static_cast<TransferItem::Status>(stoi(tokens[0]));
-            item.media.object_id = stoul(tokens[1]);
+            item.media.object_id = stoull(tokens[1]);
             item.media.filename = tokens[2];
             item.media.path = tokens[3];
             item.media.file_size = stoull(tokens[4]);
@@ -142,18 +148,33 @@ void TransferQueue::start() {
     
     is_running_ = true;
     is_paused_ = false;
-    cancel_requested_ = false;
+    cancel_token_.reset();
     
     transfer_start_time_ = chrono::steady_clock::now();
     bytes_at_start_ = 0;
     
+    // Capture dates are read from file headers ahead of the transfers
+    vector<MediaInfo> undated;
+    {
+        lock_guard<mutex> lock(items_mutex_);
+        for (const auto& item : items_) {
+            if (item.status == TransferItem::Status::PENDING && item.media.capture_date == 0) {
+                undated.push_back(item.media);
+            }
+        }
+    }
+    CaptureDateProbe capture_probe(device_handler_, undated, &cancel_token_);
+    
+    // Existence checks for the whole run are answered from one scan
+    index_.build(Utils::expandPath(destination_folder_));
+    
     // Process items
-    for (size_t i = 0; i < items_.size() && !cancel_requested_; i++) {
-        while (is_paused_ && !cancel_requested_) {
+    for (size_t i = 0; i < items_.size() && !cancel_token_.isCancelled(); i++) {
+        while (is_paused_ && !cancel_token_.isCancelled()) {
             std::this_thread::sleep_for(chrono::milliseconds(100));
         }
         
-        if (cancel_requested_) break;
+        if (cancel_token_.isCancelled()) break;
         
         TransferItem& item = items_[i];
         
@@ -161,10 +182,18 @@ void TransferQueue::start() {
             continue;
         }
         
+        if (item.media.capture_date == 0) {
+            item.media.capture_date = capture_probe.captureDate(item.media);
+        }
+        
         item.status = TransferItem::Status::IN_PROGRESS;
         notifyProgress();
         
-        bool success = transferItem(item);
+        // Each attempt gets its own deadline, so a stalled device costs one
+        // timeout per file rather than blocking the queue
+        CancellationToken operation(&cancel_token_,
+                                    CancellationToken::readTimeout(item.media.file_size));
+        bool success = transferItem(item, operation);
         
         if (success) {
             item.status = TransferItem::Status::COMPLETED;
@@ -172,7 +201,14 @@ void TransferQueue::start() {
                 item_completed_callback_(item);
             }
         } else {
-            if (item.retry_count < max_retries_) {
+            if (operation.timedOut()) {
+                // Retrying a stalled device stalls again; the .part file
+                // is kept, so a later run resumes where this one stopped
+                item.status = TransferItem::Status::FAILED;
+                if (item_failed_callback_) {
+                    item_failed_callback_(item);
+                }
+            } else if (item.retry_count < max_retries_) {
                 item.retry_count++;
                 item.status = TransferItem::Status::PENDING;
                 i--; // Retry this item
@@ -186,8 +222,13 @@ void TransferQueue::start() {
         
         notifyProgress();
     }
+    index_.clear();
     
-    is_running_ = false;
+    {
+        lock_guard<mutex> lock(run_mutex_);
+        is_running_ = false;
+    }
+    run_finished_.notify_all();
 }
 
 void TransferQueue::pause() {
@@ -198,14 +239,14 @@ void TransferQueue::resume() {
     is_paused_ = false;
 }
 
-void TransferQueue::cancel() {
-    cancel_requested_ = true;
+bool TransferQueue::cancel() {
+    cancel_token_.cancel();
     is_paused_ = false;
     
-    // Wait for running transfer to stop
-    while (is_running_) {
-        std::this_thread::sleep_for(chrono::milliseconds(50));
-    }
+    // Reads stop at their next chunk; one blocked in the device library
+    // returns when its transport times out
+    unique_lock<mutex> lock(run_mutex_);
+    return run_finished_.wait_for(lock, CANCEL_WAIT, [this]() { return !is_running_; });
 }
 
 TransferStats TransferQueue::getStats() const {
@@ -259,52 +300,96 @@ vector<TransferItem> TransferQueue::getItems() const {
     return items_;
 }
 
-bool TransferQueue::transferItem(TransferItem& item) {
+string TransferQueue::getLocalPath(const MediaInfo& media) const {
+    uint64_t date = media.capture_date != 0 ? media.capture_date : media.modification_date;
+    return Utils::joinPath(
+        Utils::expandPath(destination_folder_),
+        Utils::joinPath(Utils::getDateFolder(date), media.filename)
+    );
+}
+
+bool TransferQueue::transferItem(TransferItem& item, const CancellationToken& cancel) {
     if (!device_handler_ || !device_handler_->isConnected()) {
         item.error_message = "Device not connected";
         return false;
     }
     
-    // Generate paths
-    item.local_path = Utils::joinPath(
-        Utils::expandPath(destination_folder_),
-        Utils::joinPath(Utils::getDateFolder(item.media.modification_date), item.media.filename)
-    );
+    item.local_path = getLocalPath(item.media);
     item.temp_path = generateTempPath(item);
     
     // Create directory
     string dir = Utils::getDirectory(item.local_path);
-    if (!Utils::createDirectory(dir)) {
+    if (!index_.createDirectory(dir)) {
         item.error_message = "Failed to create directory: " + dir;
         return false;
     }
     
     // Check if already exists
-    if (Utils::fileExists(item.local_path)) {
-        if (Utils::getFileSize(item.local_path) == item.media.file_size) {
+    if (index_.fileExists(item.local_path)) {
+        if (index_.getFileSize(item.local_path) == item.media.file_size) {
             item.status = TransferItem::Status::SKIPPED;
             return true;
         }
     }
     
-    // Read file from device
-    vector<uint8_t> data;
-    if (!device_handler_->readFile(item.media.object_id, data)) {
-        item.error_message = "Failed to read file from device";
-        return false;
+    // Pick up an interrupted transfer where its .part file stopped
+    Utils::SHA256Hasher hasher;
+    uint64_t resume_offset = 0;
+    if (item.is_resumable && hashPartialFile(item, hasher, resume_offset, cancel)) {
+        cout << "Resuming " << item.media.filename << " at byte " << resume_offset << endl;
+        item.bytes_transferred = resume_offset;
+        
+        bool appended = false;
+        if (appendRemainingRange(item, hasher, appended, cancel)) {
+            item.hash = hasher.finalize();
+            if (!finalizeTempFile(item)) {
+                item.error_message = "Failed to finalize transfer";
+                return false;
+            }
+            return true;
+        }
+        
+        if (appended || cancel.isCancelled()) {
+            // Keep the longer .part file for the next retry
+            item.error_message = cancel.isCancelled() ? string("Read ") + cancel.reason()
+                                                      : "Failed to read file from device";
+            return false;
+        }
+        
+        // Ranged reads unsupported: fall back to a full transfer
+        hasher = Utils::SHA256Hasher();
     }
     
-    item.bytes_transferred = data.size();
+    // Stream file from device into the temp file, hashing as it arrives
+    ofstream out(item.temp_path, ios::binary | ios::trunc);
+    if (!out) {
+        item.error_message = "Failed to write temp file";
+        return false;
+    }
     
-    // Calculate hash
-    item.hash = Utils::calculateSHA256(data);
+    item.bytes_transferred = 0;
+    bool read_ok = device_handler_->readFileChunked(item.media.object_id,
+        [&](const uint8_t* chunk, size_t size) {
+            out.write(reinterpret_cast<const char*>(chunk), size);
+            hasher.update(chunk, size);
+            item.bytes_transferred += size;
+            return out.good();
+        }, &cancel);
+    out.close();
+    
+    if (!read_ok) {
+        item.error_message = cancel.isCancelled() ? string("Read ") + cancel.reason()
+                                                  : "Failed to read file from device";
+        return false;
+    }
     
-    // Write to temp file first
-    if (!Utils::writeFile(item.temp_path, data)) {
+    if (!out) {
         item.error_message = "Failed to write temp file";
         return false;
     }
     
+    item.hash = hasher.finalize();
+    
     // Verify and finalize
     if (!finalizeTempFile(item)) {
         item.error_message = "Failed to finalize transfer";
@@ -314,6 +399,101 @@ bool TransferQueue::transferItem(TransferItem& item) {
     return true;
 }
 
+bool TransferQueue::hashPartialFile(const TransferItem& item, Utils::SHA256Hasher& hasher,
+                                    uint64_t& offset, const CancellationToken& cancel) {
+    // On disk rather than the index: a failed attempt of this run may have
+    // left the .part a retry picks up
+    if (!Utils::fileExists(item.temp_path)) {
+        return false;
+    }
+    
+    // Only a strictly shorter .part can be a prefix of this object
+    uint64_t part_size = Utils::getFileSize(item.temp_path);
+    if (part_size == 0 || part_size >= item.media.file_size) {
+        return false;
+    }
+    
+    // The .part must end with what the device holds there; otherwise it was
+    // left by another file with the same name. Unsupported ranged reads fall
+    // back to a full transfer, which truncates it anyway.
+    uint32_t check_size = static_cast<uint32_t>(min<uint64_t>(RESUME_CHECK_SIZE, part_size));
+    vector<uint8_t> device_tail;
+    if (!device_handler_->readRange(item.media.object_id, part_size - check_size, check_size,
+                                    device_tail, &cancel) ||
+        device_tail.size() != check_size) {
+        return false;
+    }
+    
+    ifstream part(item.temp_path, ios::binary);
+    if (!part) {
+        return false;
+    }
+    
+    Utils::SHA256Hasher prefix_hasher;
+    vector<char> buffer(1024 * 1024);
+    vector<uint8_t> part_tail;
+    uint64_t hashed = 0;
+    while (part && hashed < part_size) {
+        part.read(buffer.data(), buffer.size());
+        streamsize got = part.gcount();
+        if (got <= 0) break;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer.data());
+        prefix_hasher.update(bytes, static_cast<size_t>(got));
+        hashed += static_cast<uint64_t>(got);
+        
+        // Keep the last check_size bytes seen
+        part_tail.insert(part_tail.end(), bytes, bytes + got);
+        if (part_tail.size() > check_size) {
+            part_tail.erase(part_tail.begin(), part_tail.end() - check_size);
+        }
+    }
+    part.close();
+    
+    if (hashed != part_size || part_tail != device_tail) {
+        cerr << "Discarding " << item.temp_path << ": not a prefix of " << item.media.filename << endl;
+        unlink(item.temp_path.c_str());
+        return false;
+    }
+    
+    hasher = prefix_hasher;
+    offset = part_size;
+    return true;
+}
+
+bool TransferQueue::appendRemainingRange(TransferItem& item, Utils::SHA256Hasher& hasher,
+                                         bool& appended, const CancellationToken& cancel) {
+    appended = false;
+    
+    ofstream out(item.temp_path, ios::binary | ios::app);
+    if (!out) {
+        return false;
+    }
+    
+    vector<uint8_t> chunk;
+    while (item.bytes_transferred < item.media.file_size && !cancel.isCancelled()) {
+        uint64_t remaining = item.media.file_size - item.bytes_transferred;
+        uint32_t length = static_cast<uint32_t>(min<uint64_t>(RESUME_CHUNK_SIZE, remaining));
+        
+        if (!device_handler_->readRange(item.media.object_id, item.bytes_transferred, length, chunk,
+                                        &cancel) ||
+            chunk.empty()) {
+            return false;
+        }
+        
+        out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+        if (!out) {
+            return false;
+        }
+        
+        hasher.update(chunk.data(), chunk.size());
+        item.bytes_transferred += chunk.size();
+        appended = true;
+    }
+    
+    out.close();
+    return out.good() && item.bytes_transferred == item.media.file_size;
+}
+
 string TransferQueue::generateTempPath(const TransferItem& item) {
     return item.local_path + ".part";
 }
@@ -347,6 +527,7 @@ bool TransferQueue::finalizeTempFile(TransferItem& item) {
         
         unlink(item.temp_path.c_str());
     }
+    index_.addFile(item.local_path, item.media.file_size);
     
     return true;
 }
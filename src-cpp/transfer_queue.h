@@ -2,10 +2,14 @@
 #define TRANSFER_QUEUE_H
 
 #include "device_handler.h"
+#include "utils.h"
+#include "cancellation_token.h"
+#include "destination_index.h"
 #include <string>
 #include <vector>
 #include <queue>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <functional>
 #include <cstdint>
@@ -84,7 +88,9 @@ public:
     void start();
     void pause();
     void resume();
-    void cancel();
+    // Stops the transfer, waiting up to CANCEL_WAIT for the current read to
+    // give up. Returns false if it is still running when the wait ends.
+    bool cancel();
     bool isRunning() const { return is_running_; }
     bool isPaused() const { return is_paused_; }
     
@@ -92,6 +98,10 @@ public:
     void setDestinationFolder(const std::string& folder) { destination_folder_ = folder; }
     void setDeviceHandler(DeviceHandler* handler) { device_handler_ = handler; }
     void setMaxRetries(int retries) { max_retries_ = retries; }
+    // Where a file is stored, organized by capture date where the header has one
+    std::string getLocalPath(const MediaInfo& media) const;
+    // Built by start() for the length of a run; unbuilt, it reads the disk
+    DestinationIndex& getDestinationIndex() { return index_; }
     
     // Callbacks
     void setProgressCallback(ProgressCallback callback) { progress_callback_ = callback; }
@@ -108,9 +118,12 @@ private:
     
     std::atomic<bool> is_running_{false};
     std::atomic<bool> is_paused_{false};
-    std::atomic<bool> cancel_requested_{false};
+    CancellationToken cancel_token_;
+    std::mutex run_mutex_;
+    std::condition_variable run_finished_;
     
     std::string destination_folder_;
+    DestinationIndex index_;
     DeviceHandler* device_handler_ = nullptr;
     int max_retries_ = 3;
     
@@ -122,8 +135,20 @@ private:
     std::chrono::steady_clock::time_point transfer_start_time_;
     uint64_t bytes_at_start_ = 0;
     
+    // Ranged reads used to extend an interrupted .part file
+    static constexpr uint32_t RESUME_CHUNK_SIZE = 4 * 1024 * 1024;
+    // Tail of a .part compared with the device before it is extended
+    static constexpr uint32_t RESUME_CHECK_SIZE = 4096;
+    
+    // How long cancel() blocks for a read stuck inside the device library
+    static constexpr std::chrono::seconds CANCEL_WAIT{5};
+    
     // Internal methods
-    bool transferItem(TransferItem& item);
+    bool transferItem(TransferItem& item, const CancellationToken& cancel);
+    bool hashPartialFile(const TransferItem& item, Utils::SHA256Hasher& hasher, uint64_t& offset,
+                         const CancellationToken& cancel);
+    bool appendRemainingRange(TransferItem& item, Utils::SHA256Hasher& hasher, bool& appended,
+                              const CancellationToken& cancel);
     std::string generateTempPath(const TransferItem& item);
     bool finalizeTempFile(TransferItem& item);
     void updateStats();
@@ -1,5 +1,5 @@
 #include "utils.h"
-#include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
@@ -8,9 +8,9 @@
 #include <ctime>
 #include <cstring>
 #include <cstdint>
-#include <iterator>
 #include <errno.h>
 #include <cstdlib>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <direct.h>
@@ -22,33 +22,126 @@
 #include <pwd.h>
 #endif
 
-std::string Utils::calculateSHA256(const std::vector<uint8_t>& data) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, data.data(), data.size());
-    SHA256_Final(hash, &sha256);
-    
+static std::string toHex(const unsigned char* hash, size_t size) {
     std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+    for (size_t i = 0; i < size; i++) {
         ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
     }
-    
     return ss.str();
 }
 
+std::string Utils::calculateSHA256(const std::vector<uint8_t>& data) {
+    SHA256Hasher hasher;
+    hasher.update(data.data(), data.size());
+    return hasher.finalize();
+}
+
 std::string Utils::calculateFileHash(const std::string& file_path) {
     std::ifstream file(file_path, std::ios::binary);
     if (!file) {
         return "";
     }
     
-    std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(file)),
-                          std::istreambuf_iterator<char>());
-    file.close();
+    // Hash in fixed-size blocks so large videos never need to fit in memory
+    SHA256Hasher hasher;
+    std::vector<char> buffer(1024 * 1024);
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        std::streamsize got = file.gcount();
+        if (got <= 0) break;
+        hasher.update(reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(got));
+    }
+    
+    if (file.bad()) {
+        return "";
+    }
+    
+    return hasher.finalize();
+}
+
+std::string Utils::calculateQuickHash(uint64_t file_size, const RangeReader& read) {
+    std::vector<std::pair<uint64_t, uint32_t>> samples;
+    if (file_size <= 3 * uint64_t(QUICK_HASH_SAMPLE)) {
+        samples.push_back({0, static_cast<uint32_t>(file_size)});
+    } else {
+        samples.push_back({0, QUICK_HASH_SAMPLE});
+        samples.push_back({file_size / 2 - QUICK_HASH_SAMPLE / 2, QUICK_HASH_SAMPLE});
+        samples.push_back({file_size - QUICK_HASH_SAMPLE, QUICK_HASH_SAMPLE});
+    }
+    
+    SHA256Hasher hasher;
+    uint8_t size_bytes[8];
+    for (int i = 0; i < 8; i++) {
+        size_bytes[i] = static_cast<uint8_t>(file_size >> (8 * i));
+    }
+    hasher.update(size_bytes, sizeof(size_bytes));
+    
+    std::vector<uint8_t> data;
+    for (const auto& sample : samples) {
+        if (sample.second == 0) {
+            continue;
+        }
+        if (!read(sample.first, sample.second, data) || data.size() != sample.second) {
+            return "";
+        }
+        hasher.update(data.data(), data.size());
+    }
+    return hasher.finalize();
+}
+
+std::string Utils::calculateQuickHash(const std::vector<uint8_t>& data) {
+    return calculateQuickHash(data.size(),
+        [&data](uint64_t offset, uint32_t length, std::vector<uint8_t>& range) {
+            range.assign(data.begin() + offset, data.begin() + offset + length);
+            return true;
+        });
+}
+
+std::string Utils::calculateFileQuickHash(const std::string& file_path) {
+    std::ifstream file(file_path, std::ios::binary);
+    if (!file) {
+        return "";
+    }
     
-    return calculateSHA256(buffer);
+    return calculateQuickHash(getFileSize(file_path),
+        [&file](uint64_t offset, uint32_t length, std::vector<uint8_t>& range) {
+            range.resize(length);
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(reinterpret_cast<char*>(range.data()), length);
+            range.resize(static_cast<size_t>(std::max<std::streamsize>(file.gcount(), 0)));
+            return static_cast<bool>(file);
+        });
+}
+
+Utils::SHA256Hasher::SHA256Hasher() : ctx_(EVP_MD_CTX_new()) {
+    EVP_DigestInit_ex(ctx_, EVP_sha256(), nullptr);
+}
+
+// Copies carry the digest state, e.g. a hashed .part prefix
+Utils::SHA256Hasher::SHA256Hasher(const SHA256Hasher& other) : ctx_(EVP_MD_CTX_new()) {
+    EVP_MD_CTX_copy_ex(ctx_, other.ctx_);
+}
+
+Utils::SHA256Hasher& Utils::SHA256Hasher::operator=(const SHA256Hasher& other) {
+    if (this != &other) {
+        EVP_MD_CTX_copy_ex(ctx_, other.ctx_);
+    }
+    return *this;
+}
+
+Utils::SHA256Hasher::~SHA256Hasher() {
+    EVP_MD_CTX_free(ctx_);
+}
+
+void Utils::SHA256Hasher::update(const uint8_t* data, size_t size) {
+    EVP_DigestUpdate(ctx_, data, size);
+}
+
+std::string Utils::SHA256Hasher::finalize() {
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    EVP_DigestFinal_ex(ctx_, hash, &length);
+    return toHex(hash, length);
 }
 
 bool Utils::fileExists(const std::string& path) {
@@ -177,20 +270,31 @@ std::string Utils::expandPath(const std::string& path) {
     return home + path.substr(1);
 }
 
-std::string Utils::formatDate(uint64_t timestamp) {
+// localtime() shares one buffer across threads; several devices may be
+// organizing files at once
+static struct tm toLocalTime(uint64_t timestamp) {
     time_t time = timestamp;
-    struct tm* timeinfo = localtime(&time);
+    struct tm timeinfo = {};
+#ifdef _WIN32
+    localtime_s(&timeinfo, &time);
+#else
+    localtime_r(&time, &timeinfo);
+#endif
+    return timeinfo;
+}
+
+std::string Utils::formatDate(uint64_t timestamp) {
+    struct tm timeinfo = toLocalTime(timestamp);
     
     char buffer[80];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo);
     return std::string(buffer);
 }
 
 std::string Utils::getDateFolder(uint64_t timestamp) {
-    time_t time = timestamp;
-    struct tm* timeinfo = localtime(&time);
+    struct tm timeinfo = toLocalTime(timestamp);
     
     char buffer[20];
-    strftime(buffer, sizeof(buffer), "%Y/%m", timeinfo);
+    strftime(buffer, sizeof(buffer), "%Y/%m", &timeinfo);
     return std::string(buffer);
 }
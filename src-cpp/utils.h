@@ -4,6 +4,11 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <functional>
+
+// OpenSSL digest context; the library itself stays out of this header
+struct evp_md_ctx_st;
 
 /**
  * Utility functions for file operations and hashing
@@ -13,6 +18,30 @@ namespace Utils {
     std::string calculateSHA256(const std::vector<uint8_t>& data);
     std::string calculateFileHash(const std::string& file_path);
     
+    // Quick fingerprint: SHA256 over the size and the first, middle and last
+    // QUICK_HASH_SAMPLE bytes, so a file can be matched through three ranged
+    // reads. Files of up to three samples are covered whole. Returns an empty
+    // string when a read fails.
+    constexpr uint32_t QUICK_HASH_SAMPLE = 64 * 1024;
+    using RangeReader = std::function<bool(uint64_t offset, uint32_t length,
+                                           std::vector<uint8_t>& data)>;
+    std::string calculateQuickHash(uint64_t file_size, const RangeReader& read);
+    std::string calculateQuickHash(const std::vector<uint8_t>& data);
+    std::string calculateFileQuickHash(const std::string& file_path);
+    
+    // Incremental SHA256 for data that arrives in chunks
+    class SHA256Hasher {
+    public:
+        SHA256Hasher();
+        SHA256Hasher(const SHA256Hasher& other);
+        SHA256Hasher& operator=(const SHA256Hasher& other);
+        ~SHA256Hasher();
+        void update(const uint8_t* data, size_t size);
+        std::string finalize();
+    private:
+        evp_md_ctx_st* ctx_;
+    };
+    
     // File operations
     bool fileExists(const std::string& path);
     bool createDirectory(const std::string& path);
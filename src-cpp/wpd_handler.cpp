@@ -1,6 +1,7 @@
 #ifdef _WIN32
 
 #include "wpd_handler.h"
+#include "media_types.h"
 #include <windows.h>
 #include <PortableDeviceApi.h>
 #include <PortableDevice.h>
@@ -248,6 +249,11 @@ std::string WPDHandler::getDeviceModel() const {
     return device_model_;
 }
 
+std::string WPDHandler::getSerialNumber() const {
+    // The PnP device path embeds the USB serial and is stable per phone
+    return wideToString(device_id_);
+}
+
 std::vector<DeviceStorageInfo> WPDHandler::getStorageInfo() const {
     std::vector<DeviceStorageInfo> storages;
     
@@ -304,52 +310,6 @@ std::vector<DeviceStorageInfo> WPDHandler::getStorageInfo() const {
     return storages;
 }
 
-bool WPDHandler::isMediaFile(const std::wstring& filename) const {
-    std::wstring ext = filename;
-    size_t pos = ext.rfind(L'.');
-    if (pos == std::wstring::npos) return false;
-    ext = ext.substr(pos);
-    
-    // Convert to lowercase
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::towlower);
-    
-    // Photo extensions
-    if (ext == L".jpg" || ext == L".jpeg" || ext == L".png" || 
-        ext == L".gif" || ext == L".bmp" || ext == L".heic" ||
-        ext == L".heif" || ext == L".webp" || ext == L".raw" ||
-        ext == L".cr2" || ext == L".nef" || ext == L".arw") {
-        return true;
-    }
-    
-    // Video extensions
-    if (ext == L".mp4" || ext == L".mov" || ext == L".avi" ||
-        ext == L".mkv" || ext == L".wmv" || ext == L".3gp" ||
-        ext == L".m4v" || ext == L".webm") {
-        return true;
-    }
-    
-    return false;
-}
-
-std::string WPDHandler::getMimeType(const std::wstring& filename) const {
-    std::wstring ext = filename;
-    size_t pos = ext.rfind(L'.');
-    if (pos == std::wstring::npos) return "application/octet-stream";
-    ext = ext.substr(pos);
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::towlower);
-    
-    if (ext == L".jpg" || ext == L".jpeg") return "image/jpeg";
-    if (ext == L".png") return "image/png";
-    if (ext == L".gif") return "image/gif";
-    if (ext == L".heic" || ext == L".heif") return "image/heic";
-    if (ext == L".mp4" || ext == L".m4v") return "video/mp4";
-    if (ext == L".mov") return "video/quicktime";
-    if (ext == L".avi") return "video/x-msvideo";
-    if (ext == L".mkv") return "video/x-matroska";
-    
-    return "application/octet-stream";
-}
-
 void WPDHandler::enumerateContent(const std::wstring& parent_id, std::vector<MediaInfo>& media) {
     if (!content_) return;
 
@@ -388,13 +348,14 @@ void WPDHandler::enumerateContent(const std::wstring& parent_id, std::vector<Med
                         std::wstring filename = name;
                         CoTaskMemFree(name);
                         
-                        if (isMediaFile(filename)) {
+                        const MediaTypes::MediaType* type = MediaTypes::classify(filename);
+                        if (type) {
                             MediaInfo info;
-                            info.object_id = static_cast<uint32_t>(object_id_map_.size());
+                            info.object_id = static_cast<ObjectId>(object_id_map_.size());
                             object_id_map_.push_back(object_ids[i]);
                             
                             info.filename = wideToString(filename);
-                            info.mime_type = getMimeType(filename);
+                            info.mime_type = type->mime_type;
                             
                             ULONGLONG size = 0;
                             values->GetUnsignedLargeIntegerValue(WPD_OBJECT_SIZE, &size);
@@ -446,7 +407,16 @@ std::vector<MediaInfo> WPDHandler::enumerateMedia(const std::string& directory_p
     return media;
 }
 
-bool WPDHandler::readFile(uint32_t object_id, std::vector<uint8_t>& data) {
+bool WPDHandler::readFile(ObjectId object_id, std::vector<uint8_t>& data) {
+    data.clear();
+    return readFileChunked(object_id, [&data](const uint8_t* chunk, size_t size) {
+        data.insert(data.end(), chunk, chunk + size);
+        return true;
+    });
+}
+
+bool WPDHandler::readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                                 const CancellationToken* cancel) {
     if (!content_ || object_id >= object_id_map_.size()) {
         setError("Invalid object ID or not connected");
         return false;
@@ -471,20 +441,87 @@ bool WPDHandler::readFile(uint32_t object_id, std::vector<uint8_t>& data) {
     }
 
     // Read file in chunks
-    data.clear();
     std::vector<BYTE> buffer(optimal_buffer_size > 0 ? optimal_buffer_size : 262144);
     ULONG bytes_read = 0;
 
     while (true) {
+        if (isCancelled(cancel)) {
+            setError(std::string("Read ") + cancel->reason());
+            return false;
+        }
         hr = stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytes_read);
-        if (FAILED(hr) || bytes_read == 0) break;
-        data.insert(data.end(), buffer.begin(), buffer.begin() + bytes_read);
+        if (FAILED(hr)) {
+            setError("Failed to read file stream");
+            return false;
+        }
+        if (bytes_read == 0) break;
+        if (!sink(buffer.data(), bytes_read)) {
+            setError("Read aborted");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WPDHandler::readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                           std::vector<uint8_t>& data, const CancellationToken* cancel) {
+    data.clear();
+
+    if (!content_ || object_id >= object_id_map_.size()) {
+        setError("Invalid object ID or not connected");
+        return false;
+    }
+
+    ComPtr<IPortableDeviceResources> resources;
+    HRESULT hr = content_->Transfer(&resources);
+    if (FAILED(hr)) {
+        setError("Failed to get transfer interface");
+        return false;
+    }
+
+    ComPtr<IStream> stream;
+    DWORD optimal_buffer_size = 0;
+    hr = resources->GetStream(object_id_map_[object_id].c_str(), WPD_RESOURCE_DEFAULT, STGM_READ,
+                               &optimal_buffer_size, &stream);
+    if (FAILED(hr)) {
+        setError("Failed to open file stream");
+        return false;
+    }
+
+    // MTP drivers that support GetPartialObject honour Seek on the resource stream
+    LARGE_INTEGER move;
+    move.QuadPart = static_cast<LONGLONG>(offset);
+    hr = stream->Seek(move, STREAM_SEEK_SET, nullptr);
+    if (FAILED(hr)) {
+        setError("Device does not support ranged reads");
+        return false;
+    }
+
+    data.resize(length);
+    ULONG total_read = 0;
+    while (total_read < length) {
+        if (isCancelled(cancel)) {
+            data.clear();
+            setError(std::string("Read ") + cancel->reason());
+            return false;
+        }
+        ULONG bytes_read = 0;
+        hr = stream->Read(data.data() + total_read, length - total_read, &bytes_read);
+        if (FAILED(hr)) {
+            data.clear();
+            setError("Failed to read file stream");
+            return false;
+        }
+        if (bytes_read == 0) break;
+        total_read += bytes_read;
     }
 
+    data.resize(total_read);
     return true;
 }
 
-bool WPDHandler::fileExists(uint32_t object_id) {
+bool WPDHandler::fileExists(ObjectId object_id) {
     return object_id < object_id_map_.size();
 }
 
@@ -29,11 +29,17 @@ public:
     std::string getDeviceName() const override;
     std::string getDeviceManufacturer() const override;
     std::string getDeviceModel() const override;
+    std::string getSerialNumber() const override;
     std::vector<DeviceStorageInfo> getStorageInfo() const override;
 
     std::vector<MediaInfo> enumerateMedia(const std::string& directory_path = "") override;
-    bool readFile(uint32_t object_id, std::vector<uint8_t>& data) override;
-    bool fileExists(uint32_t object_id) override;
+    bool readFile(ObjectId object_id, std::vector<uint8_t>& data) override;
+    bool readFileChunked(ObjectId object_id, const ChunkSink& sink,
+                         const CancellationToken* cancel = nullptr) override;
+    bool readRange(ObjectId object_id, uint64_t offset, uint32_t length,
+                   std::vector<uint8_t>& data,
+                   const CancellationToken* cancel = nullptr) override;
+    bool fileExists(ObjectId object_id) override;
 
     std::string getLastError() const override { return last_error_; }
 
@@ -44,8 +50,6 @@ private:
     std::string wideToString(const std::wstring& wstr) const;
     
     void enumerateContent(const std::wstring& parent_id, std::vector<MediaInfo>& media);
-    bool isMediaFile(const std::wstring& filename) const;
-    std::string getMimeType(const std::wstring& filename) const;
     
     void setError(const std::string& error);
 